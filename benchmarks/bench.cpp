@@ -0,0 +1,290 @@
+// Runs Orca programs repeatedly and reports their cost as JSON.
+//
+//   orc-bench [--runs=<n>] [--engine=tree|flat|vm] [--output=<file>] <file>...
+//
+// Every run happens in a freshly forked child, so the heap starts empty and
+// peak RSS and allocation counts belong to that run alone. Each program is
+// run `n` times (default 5) on each engine (default all three). Wall time
+// covers lexing through the end of execution; program output is discarded.
+
+#include "../src/gc/heap.h"
+#include "../src/interpreter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// Counts every C++ heap allocation made by the interpreter. Only this binary
+// replaces the global operators; `orc` itself is unaffected.
+static size_t allocation_count = 0;
+static size_t allocated_bytes = 0;
+
+void *operator new(size_t size) {
+  ++allocation_count;
+  allocated_bytes += size;
+  void *memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr)
+    throw std::bad_alloc();
+  return memory;
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+// Sent from a child back to the harness through a pipe.
+struct RunReport {
+  bool ok;
+  uint64_t wall_ns;
+  uint64_t allocations;
+  uint64_t allocated_bytes;
+  uint64_t gc_objects;
+  uint64_t gc_collections;
+  char error[256];
+};
+
+struct RunResult {
+  RunReport report;
+  long peak_rss_kb;
+};
+
+static void run_child(const std::string &path, Engine engine, int out) {
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd >= 0)
+    dup2(null_fd, STDOUT_FILENO);
+
+  InterpreterOptions options;
+  options.engine = engine;
+
+  RunReport report = {};
+  size_t allocations_before = allocation_count;
+  size_t bytes_before = allocated_bytes;
+  auto started = std::chrono::steady_clock::now();
+
+  try {
+    Interpreter(options).run_file(path);
+    report.ok = true;
+  } catch (const char *error) {
+    snprintf(report.error, sizeof(report.error), "%s", error);
+  } catch (const std::string &error) {
+    snprintf(report.error, sizeof(report.error), "%s", error.c_str());
+  }
+
+  fflush(stdout);
+  report.wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+  report.allocations = allocation_count - allocations_before;
+  report.allocated_bytes = allocated_bytes - bytes_before;
+  report.gc_objects = runtime_heap.stats.objects_allocated;
+  report.gc_collections = runtime_heap.stats.collections;
+
+  write(out, &report, sizeof(report));
+  _exit(report.ok ? 0 : 1);
+}
+
+static RunResult run_once(const std::string &path, Engine engine) {
+  RunResult result = {};
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    snprintf(result.report.error, sizeof(result.report.error),
+             "pipe() failed");
+    return result;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    run_child(path, engine, fds[1]);
+  }
+  close(fds[1]);
+
+  size_t received = 0;
+  char *buffer = (char *)&result.report;
+  while (pid > 0 && received < sizeof(RunReport)) {
+    ssize_t n = read(fds[0], buffer + received, sizeof(RunReport) - received);
+    if (n <= 0)
+      break;
+    received += n;
+  }
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage = {};
+  if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+    result.report = {};
+    snprintf(result.report.error, sizeof(result.report.error),
+             "could not start child process");
+    return result;
+  }
+
+  result.peak_rss_kb = usage.ru_maxrss;
+  if (received != sizeof(RunReport)) {
+    result.report = {};
+    if (WIFSIGNALED(status))
+      snprintf(result.report.error, sizeof(result.report.error),
+               "killed by signal %d", WTERMSIG(status));
+    else
+      snprintf(result.report.error, sizeof(result.report.error),
+               "exited with status %d", WEXITSTATUS(status));
+  }
+  return result;
+}
+
+static double percentile(std::vector<double> sorted, double fraction) {
+  size_t rank = (size_t)std::ceil(fraction * sorted.size());
+  return sorted[std::max(rank, (size_t)1) - 1];
+}
+
+static std::string json_string(const std::string &text) {
+  std::string escaped = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if ((unsigned char)c < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped + "\"";
+}
+
+static std::string benchmark_name(const std::string &path) {
+  std::string name = path.substr(path.find_last_of('/') + 1);
+  size_t extension = name.rfind(".orca");
+  return extension == std::string::npos ? name : name.substr(0, extension);
+}
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--runs=<n>] [--engine=tree|flat|vm] [--output=<file>] "
+          "<file>...\n",
+          program);
+}
+
+int main(int argc, char *argv[]) {
+  int runs = 5;
+  std::vector<Engine> engines = {ENGINE_TREE, ENGINE_FLAT, ENGINE_VM};
+  std::string output_path;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+
+    if (arg.rfind("--runs=", 0) == 0) {
+      runs = std::max(1, std::stoi(arg.substr(7)));
+    } else if (arg == "--engine=tree") {
+      engines = {ENGINE_TREE};
+    } else if (arg == "--engine=flat") {
+      engines = {ENGINE_FLAT};
+    } else if (arg == "--engine=vm") {
+      engines = {ENGINE_VM};
+    } else if (arg.rfind("--output=", 0) == 0) {
+      output_path = arg.substr(9);
+    } else if (arg.rfind("--", 0) == 0) {
+      print_usage(argv[0]);
+      return 1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  if (files.empty()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::sort(files.begin(), files.end());
+
+  FILE *out = stdout;
+  if (!output_path.empty()) {
+    out = fopen(output_path.c_str(), "w");
+    if (out == nullptr) {
+      fprintf(stderr, "Could not open '%s' for writing.\n",
+              output_path.c_str());
+      return 1;
+    }
+  }
+
+  bool all_ok = true;
+  bool first = true;
+  fprintf(out, "{\n  \"runs\": %d,\n  \"results\": [", runs);
+
+  for (const std::string &path : files) {
+    for (Engine engine : engines) {
+      const char *engine_name = engine == ENGINE_VM     ? "vm"
+                                : engine == ENGINE_FLAT ? "flat"
+                                                        : "tree";
+      std::string name = benchmark_name(path);
+
+      std::vector<double> wall_ms;
+      long peak_rss_kb = 0;
+      RunReport last = {};
+      std::string error;
+
+      for (int run = 0; run < runs && error.empty(); ++run) {
+        RunResult result = run_once(path, engine);
+        if (!result.report.ok) {
+          error = result.report.error;
+          break;
+        }
+        wall_ms.push_back(result.report.wall_ns / 1e6);
+        peak_rss_kb = std::max(peak_rss_kb, result.peak_rss_kb);
+        last = result.report;
+      }
+
+      fprintf(out, "%s\n    {\n      \"benchmark\": %s,\n", first ? "" : ",",
+              json_string(name).c_str());
+      fprintf(out, "      \"engine\": \"%s\",\n", engine_name);
+      first = false;
+
+      if (!error.empty()) {
+        all_ok = false;
+        fprintf(stderr, "%-20s %-4s error: %s\n", name.c_str(), engine_name,
+                error.c_str());
+        fprintf(out, "      \"error\": %s\n    }", json_string(error).c_str());
+        continue;
+      }
+
+      std::sort(wall_ms.begin(), wall_ms.end());
+      double median = percentile(wall_ms, 0.5);
+      fprintf(stderr, "%-20s %-4s median %10.2f ms\n", name.c_str(),
+              engine_name, median);
+
+      fprintf(out,
+              "      \"wall_ms\": {\"min\": %.3f, \"median\": %.3f, "
+              "\"p95\": %.3f},\n",
+              wall_ms.front(), median, percentile(wall_ms, 0.95));
+      fprintf(out, "      \"peak_rss_kb\": %ld,\n", peak_rss_kb);
+      fprintf(out, "      \"allocations\": %llu,\n",
+              (unsigned long long)last.allocations);
+      fprintf(out, "      \"allocated_bytes\": %llu,\n",
+              (unsigned long long)last.allocated_bytes);
+      fprintf(out, "      \"gc_objects\": %llu,\n",
+              (unsigned long long)last.gc_objects);
+      fprintf(out, "      \"gc_collections\": %llu\n    }",
+              (unsigned long long)last.gc_collections);
+    }
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+  if (out != stdout)
+    fclose(out);
+
+  return all_ok ? 0 : 1;
+}
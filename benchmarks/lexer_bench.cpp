@@ -0,0 +1,86 @@
+// Measures Lexer throughput in MB/s.
+//
+//   orc-lexer-bench [--iterations=<n>] [file...]
+//
+// Each file is lexed `n` times (default 20) and the best and median rates are
+// reported. Without files, a few megabytes of generated Orca code are used.
+
+#include "../src/lexer.h"
+#include "../src/source_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static std::string generate_source(size_t target_bytes) {
+  std::string source;
+  for (int i = 0; source.size() < target_bytes; ++i) {
+    std::string n = std::to_string(i);
+    source += "// Generated function " + n + "\n";
+    source += "class Point" + n + " {\n";
+    source += "  init(x, y) { this.x = x; this.y = y; }\n";
+    source += "  length() { return this.x * this.x + this.y * this.y; }\n";
+    source += "}\n";
+    source += "fun compute" + n + "(a, b) {\n";
+    source += "  var total = 0;\n";
+    source += "  while (total <= 1000.25) {\n";
+    source += "    if (a != b) { total = total + a / 2; } else { return nil; }\n";
+    source += "  }\n";
+    source += "  print \"result \" + \"" + n + "\";\n";
+    source += "  return Point" + n + "(total, [1, 2, 3][0]).length();\n";
+    source += "}\n";
+  }
+  return source;
+}
+
+static void bench(const std::string &name, std::string_view source,
+                  int iterations) {
+  std::vector<double> rates;
+  size_t token_count = 0;
+
+  for (int i = 0; i < iterations; ++i) {
+    auto started = std::chrono::steady_clock::now();
+    Lexer lexer(source);
+    std::vector<Token> tokens = lexer.scan_tokens();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - started;
+
+    token_count = tokens.size();
+    rates.push_back(source.size() / 1e6 / elapsed.count());
+  }
+
+  std::sort(rates.begin(), rates.end());
+  printf("%s: %.2f MB, %zu tokens, best %.1f MB/s, median %.1f MB/s\n",
+         name.c_str(), source.size() / 1e6, token_count, rates.back(),
+         rates[rates.size() / 2]);
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 20;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--iterations=", 0) == 0) {
+      iterations = std::max(1, std::stoi(arg.substr(13)));
+    } else if (arg.rfind("--", 0) == 0) {
+      fprintf(stderr, "usage: orc-lexer-bench [--iterations=<n>] [file...]\n");
+      return 1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  if (files.empty()) {
+    std::string source = generate_source(4 * 1024 * 1024);
+    bench("<generated>", source, iterations);
+    return 0;
+  }
+
+  for (const std::string &path : files) {
+    SourceFile file(path);
+    bench(path, file.text(), iterations);
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+#include "arena.h"
+#include <algorithm>
+
+Arena::~Arena() {
+  for (char *block : blocks)
+    delete[] block;
+}
+
+// Starts a new block big enough for `size` bytes at `alignment`. An oversized
+// request gets a block of its own; the rest of the current block is given up.
+char *Arena::grow(size_t size, size_t alignment) {
+  size_t block_size = std::max(BLOCK_SIZE, size + alignment);
+  char *block = new char[block_size];
+  blocks.push_back(block);
+
+  cursor = block;
+  limit = block + block_size;
+  return (char *)(((uintptr_t)block + alignment - 1) & ~(alignment - 1));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A bump-pointer allocator for objects that all die together. Memory is
+// carved out of large blocks which are released in one go when the arena is
+// destroyed. Destructors never run, so only trivially destructible types may
+// be placed in an arena.
+class Arena {
+public:
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+  Arena() : cursor(nullptr), limit(nullptr), used(0) {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+
+  void *allocate(size_t size, size_t alignment) {
+    uintptr_t start = ((uintptr_t)cursor + alignment - 1) & ~(alignment - 1);
+    if (cursor == nullptr || start + size > (uintptr_t)limit)
+      start = (uintptr_t)grow(size, alignment);
+
+    cursor = (char *)start + size;
+    used += size;
+    return (void *)start;
+  }
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena objects are never destroyed.");
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Copies `items` into the arena, e.g. to turn a list built up in a
+  // temporary vector into part of a node.
+  template <typename T> std::span<T> copy(const std::vector<T> &items) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena objects are never destroyed.");
+    if (items.empty())
+      return {};
+
+    T *data = (T *)allocate(sizeof(T) * items.size(), alignof(T));
+    std::uninitialized_copy(items.begin(), items.end(), data);
+    return std::span<T>(data, items.size());
+  }
+
+  // Bytes handed out so far, not counting padding or unused block tails.
+  size_t bytes_used() const { return used; }
+
+private:
+  char *grow(size_t size, size_t alignment);
+
+  std::vector<char *> blocks;
+  char *cursor;
+  char *limit;
+  size_t used;
+};
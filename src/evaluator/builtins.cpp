@@ -0,0 +1,152 @@
+#include "builtins.h"
+#include "native.h"
+#include <chrono>
+#include <charconv>
+#include <cmath>
+
+void throw_native_argument_error(int position, const char *expected) {
+  throw "Argument " + std::to_string(position) + " should be " + expected +
+      ".";
+}
+
+// Timers count from startup so that the result stays small enough to keep
+// useful precision once it is narrowed to a language-level number.
+static const std::chrono::steady_clock::time_point started =
+    std::chrono::steady_clock::now();
+
+static double native_clock() {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - started;
+  return elapsed.count();
+}
+
+static double native_nanotime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - started)
+      .count();
+}
+
+static double native_len(Value value) {
+  if (value.is_string())
+    return string_length(value);
+  if (value.get_type() == RT_ARRAY)
+    return ((RuntimeArrayValue *)value.as_object())->array_values.size();
+  throw "Can only take the length of a string or an array.";
+}
+
+static std::string native_str(Value value) { return value.as_string(); }
+
+static Value native_num(Value value) {
+  if (value.is_number())
+    return value;
+  if (!value.is_string())
+    throw "Can only convert a string to a number.";
+
+  std::string_view text = string_value(value);
+  const char *end = text.data() + text.size();
+  double number;
+  std::from_chars_result parsed = std::from_chars(text.data(), end, number);
+  if (parsed.ec != std::errc() || parsed.ptr != end)
+    throw "Could not convert '" + std::string(text) + "' to a number.";
+  return Value::number(number);
+}
+
+static double native_sqrt(double x) { return std::sqrt(x); }
+static double native_abs(double x) { return std::fabs(x); }
+static double native_floor(double x) { return std::floor(x); }
+static double native_ceil(double x) { return std::ceil(x); }
+static double native_sin(double x) { return std::sin(x); }
+static double native_cos(double x) { return std::cos(x); }
+static double native_exp(double x) { return std::exp(x); }
+static double native_log(double x) { return std::log(x); }
+static double native_pow(double x, double y) { return std::pow(x, y); }
+static double native_min(double x, double y) { return std::fmin(x, y); }
+static double native_max(double x, double y) { return std::fmax(x, y); }
+
+// Index of the first occurrence of `needle` in `text`, or -1.
+static double native_find(std::string_view text, std::string_view needle) {
+  size_t found = text.find(needle);
+  return found == std::string::npos ? -1 : (double)found;
+}
+
+// The characters of `text` from `start` up to `end`.
+static Value native_slice(Value text, double start, double end) {
+  if (!text.is_string())
+    throw_native_argument_error(1, "a string");
+  if (start < 0 || end < start || end > string_length(text))
+    throw "Index key not in range.";
+  return make_slice(text, (size_t)start, (size_t)end - (size_t)start);
+}
+
+// An empty separator splits `text` into single characters. The pieces are
+// slices of `text`.
+static Value native_split(Value text, std::string_view separator) {
+  if (!text.is_string())
+    throw_native_argument_error(1, "a string");
+  std::string_view chars = string_value(text);
+
+  RuntimeArrayValue *parts = runtime_heap.allocate<RuntimeArrayValue>(
+      std::vector<Value>());
+  GcRootScope roots;
+  roots.add(parts);
+
+  if (separator.empty()) {
+    parts->array_values.reserve(chars.size());
+    for (char c : chars)
+      parts->array_values.push_back(character_string(c));
+    runtime_heap.grew(parts);
+    return Value::object(parts);
+  }
+
+  size_t start = 0;
+  while (true) {
+    size_t found = chars.find(separator, start);
+    if (found == std::string::npos)
+      break;
+    parts->array_values.push_back(make_slice(text, start, found - start));
+    start = found + separator.size();
+  }
+  parts->array_values.push_back(make_slice(text, start, chars.size() - start));
+  runtime_heap.grew(parts);
+  return Value::object(parts);
+}
+
+static std::string native_join(RuntimeArrayValue *array,
+                               std::string_view separator) {
+  std::string joined;
+  for (size_t i = 0; i < array->array_values.size(); ++i) {
+    if (i > 0)
+      joined += separator;
+    Value value = array->array_values[i];
+    if (value.is_string())
+      joined += string_value(value);
+    else
+      joined += value.as_string();
+  }
+  return joined;
+}
+
+void install_stdlib(GlobalTable &globals) {
+  define_native<native_clock>(globals, "clock");
+  define_native<native_nanotime>(globals, "nanotime");
+  define_native<native_len>(globals, "len");
+  define_native<native_str>(globals, "str");
+  define_native<native_num>(globals, "num");
+
+  define_native<native_sqrt>(globals, "sqrt");
+  define_native<native_abs>(globals, "abs");
+  define_native<native_floor>(globals, "floor");
+  define_native<native_ceil>(globals, "ceil");
+  define_native<native_sin>(globals, "sin");
+  define_native<native_cos>(globals, "cos");
+  define_native<native_exp>(globals, "exp");
+  define_native<native_log>(globals, "log");
+  define_native<native_pow>(globals, "pow");
+  define_native<native_min>(globals, "min");
+  define_native<native_max>(globals, "max");
+
+  define_native<native_find>(globals, "find");
+  define_native<native_slice>(globals, "slice");
+  define_native<native_split>(globals, "split");
+  define_native<native_join>(globals, "join");
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "../variable/global_table.h"
+
+// Defines the built-in native functions (clock, nanotime, len, str, num, the
+// math functions and find/split/join for strings) as globals in `globals`.
+void install_stdlib(GlobalTable &globals);
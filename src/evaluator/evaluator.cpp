@@ -3,354 +3,452 @@
 #include "runtime_callable.h"
 #include "runtime_value.h"
 
-RuntimeValue operator-(RuntimeValue lhs, RuntimeValue const &rhs) {
-  if (lhs.get_type() == RT_NUMBER && rhs.get_type() == RT_NUMBER) {
-    return RuntimeValue(lhs.as_number() - rhs.as_number());
-  }
-
-  throw "Cannot add different types.";
-}
-
-RuntimeValue operator+(RuntimeValue lhs, RuntimeValue const &rhs) {
-  if (lhs.get_type() == RT_STRING && rhs.get_type() == RT_STRING) {
-    return RuntimeValue(lhs.as_string() + rhs.as_string());
-  }
-
-  if (lhs.get_type() == RT_NUMBER && rhs.get_type() == RT_NUMBER) {
-    return RuntimeValue(lhs.as_number() + rhs.as_number());
-  }
-
-  throw "Cannot add different types.";
-}
-
-RuntimeValue operator*(RuntimeValue lhs, RuntimeValue const &rhs) {
-  if (lhs.get_type() == RT_NUMBER && rhs.get_type() == RT_NUMBER) {
-    return RuntimeValue(lhs.as_number() * rhs.as_number());
-  }
-
-  throw "Cannot perform substraction on different types.";
-}
-
-RuntimeValue operator/(RuntimeValue lhs, RuntimeValue const &rhs) {
-  if (lhs.get_type() == RT_NUMBER && rhs.get_type() == RT_NUMBER) {
-    return RuntimeValue(lhs.as_number() / rhs.as_number());
-  }
-
-  throw "Cannot perform division on different types.";
-}
-
-bool operator==(RuntimeValue lhs, RuntimeValue const &rhs) {
-  if (lhs.get_type() == RT_STRING && rhs.get_type() == RT_STRING)
-    return lhs.as_string() == rhs.as_string();
-
-  if (lhs.get_type() == RT_NUMBER && rhs.get_type() == RT_NUMBER)
-    return lhs.as_number() == rhs.as_number();
-
-  if (lhs.get_type() == RT_BOOL && rhs.get_type() == RT_BOOL)
-    return lhs.as_bool() == rhs.as_bool();
-
-  if (lhs.get_type() == RT_NIL && rhs.get_type() == RT_NIL)
-    return true;
-
-  throw "Cannot perform division on different types.";
-}
-
-bool operator!=(RuntimeValue lhs, RuntimeValue const &rhs) {
-  return !(lhs == rhs);
+void Evaluator::mark_roots(Heap &heap) {
+  for (Value value : globals.values)
+    heap.mark(value);
+  heap.mark(environment);
+  heap.mark(return_value);
 }
 
-bool operator<(RuntimeValue lhs, RuntimeValue const &rhs) {
-  if (lhs.get_type() == RT_NUMBER && rhs.get_type() == RT_NUMBER)
-    return lhs.as_number() < rhs.as_number();
-
-  throw "Cannot perform division on different types.";
-}
-
-bool operator>(RuntimeValue lhs, RuntimeValue const &rhs) {
-  if (lhs.get_type() == RT_NUMBER && rhs.get_type() == RT_NUMBER)
-    return lhs.as_number() > rhs.as_number();
-
-  throw "Cannot perform division on different types.";
-}
-
-bool operator<=(RuntimeValue lhs, RuntimeValue const &rhs) {
-  return lhs < rhs || lhs == rhs;
-}
-
-bool operator>=(RuntimeValue lhs, RuntimeValue const &rhs) {
-  return lhs > rhs || lhs == rhs;
-}
-
-void Evaluator::execute_block(BlockStmt block, Environment *env) {
+void Evaluator::execute_block(std::span<Statement *> statements,
+                              Environment *env) {
   Environment *previous = environment;
+  GcRootScope roots;
+  roots.add(previous);
   environment = env;
 
-  try {
-    for (Statement *statement : block.statements) {
-      evaluate(statement);
-    }
-  } catch (RuntimeValue *return_value) {
-    environment = previous;
-    throw return_value;
+  for (Statement *statement : statements) {
+    evaluate(statement);
+    if (completion != COMPLETION_NORMAL)
+      break;
   }
 
   environment = previous;
 }
 
-void Evaluator::resolve(Expression *expression, int depth) {
-  locals.insert_or_assign(expression, depth);
+Value Evaluator::execute_body(std::span<Statement *> statements,
+                              Environment *env) {
+  execute_block(statements, env);
+  if (completion != COMPLETION_RETURN)
+    return Value::nil();
+
+  Value result = return_value;
+  completion = COMPLETION_NORMAL;
+  return_value = Value::nil();
+  return result;
 }
 
-RuntimeValue *Evaluator::evaluate(Expression *expression) {
+Value Evaluator::evaluate(Expression *expression) {
   return expression->accept(*this);
 }
 
-RuntimeValue *Evaluator::visit(BinaryExpr *expr) {
-  RuntimeValue *left = expr->left.accept(*this);
-  RuntimeValue *right = expr->right.accept(*this);
+Value Evaluator::visit(BinaryExpr *expr) {
+  Value left = expr->left.accept(*this);
+  GcRootScope roots;
+  roots.add(left);
+  Value right = expr->right.accept(*this);
 
-  line = expr->op.line;
+  at("binary", expr->op.line);
+  return binary_operation(expr->op.type, left, right);
+};
 
-  switch (expr->op.type) {
+Value Evaluator::binary_operation(TokenType op, Value left, Value right) {
+  switch (op) {
   case MINUS:
-    return new RuntimeValue(*left - *right);
+    return left - right;
   case SLASH:
-    return new RuntimeValue(*left / *right);
+    return left / right;
   case STAR:
-    return new RuntimeValue(*left * *right);
+    return left * right;
   case PLUS:
-    return new RuntimeValue(*left + *right);
+    return left + right;
 
   case GREATER:
-    return new RuntimeValue(*left > *right);
+    return Value::boolean(left > right);
   case GREATER_EQUAL:
-    return new RuntimeValue(*left >= *right);
+    return Value::boolean(left >= right);
   case LESS:
-    return new RuntimeValue(*left < *right);
+    return Value::boolean(left < right);
   case LESS_EQUAL:
-    return new RuntimeValue(*left <= *right);
+    return Value::boolean(left <= right);
   case EQUAL_EQUAL:
-    return new RuntimeValue(*left == *right);
+    return Value::boolean(left == right);
   case BANG_EQUAL:
-    return new RuntimeValue(*left != *right);
+    return Value::boolean(left != right);
   }
 
-  return new RuntimeValue();
-};
+  return Value::nil();
+}
 
-RuntimeValue *Evaluator::visit(GroupingExpr *expr) {
-  return expr->accept(*this);
-};
+Value Evaluator::visit(GroupingExpr *expr) { return expr->expr.accept(*this); };
 
-RuntimeValue *Evaluator::visit(LiteralExpr *expr) {
-  return new RuntimeValue(expr->value);
+Value Evaluator::visit(LiteralExpr *expr) {
+  if (expr->value.type != STR)
+    return literal_to_value(expr->value);
+
+  if (expr->cached_string.is_undefined()) {
+    site_kind = "literal";
+    expr->cached_string = literal_to_value(expr->value);
+  }
+  return expr->cached_string;
 };
 
-RuntimeValue *Evaluator::visit(UnaryExpr *expr) {
-  RuntimeValue *right = expr->right.accept(*this);
+Value Evaluator::visit(UnaryExpr *expr) {
+  Value right = expr->right.accept(*this);
 
   line = expr->op.line;
+  return unary_operation(expr->op.type, right);
+};
 
-  switch (expr->op.type) {
+Value Evaluator::unary_operation(TokenType op, Value right) {
+  switch (op) {
   case MINUS: {
-    if (right->is_number())
-      return new RuntimeValue(RuntimeValue(float(0)) - *right);
+    if (right.is_number())
+      return Value::number(0) - right;
     break;
   }
   case BANG:
-    return new RuntimeValue(!right->is_truthy());
+    return Value::boolean(!right.is_truthy());
 
   default:
-    throw "Expected unary operation, found " +
-                             expr->op.lexeme;
+    throw "Expected unary operation, found " + token_type_as_str(op);
   }
 
-  return new RuntimeValue();
+  return Value::nil();
+}
+
+Value Evaluator::visit(CallExpr *expr) {
+  if (expr->callee->getType() == GET_EXPR)
+    return invoke((GetExpr *)expr->callee, expr);
+
+  Value callee = evaluate(expr->callee);
+  GcRootScope roots;
+  roots.add(callee);
+
+  std::vector<Value> arguments;
+  evaluate_arguments(expr, arguments, roots);
+  at("call", expr->paren.line);
+  return call_value(callee, arguments);
 };
 
-RuntimeValue *Evaluator::visit(CallExpr *expr) {
-  RuntimeValue *callee = evaluate(expr->callee);
+Value Evaluator::call_value(Value callee, std::vector<Value> &arguments) {
+  if (!callee.is_callable())
+    throw "Attempted to call non-callable object.";
 
-  std::vector<RuntimeValue *> arguments;
-  for (auto arg : expr->arguments)
-    arguments.push_back(evaluate(arg));
+  RuntimeCallable *callable = (RuntimeCallable *)callee.as_object();
+  if (arguments.size() != callable->arity())
+    throw "Received incorrect number of args.";
+  return callable->call(this, arguments);
+}
 
-  if (callee->is_callable()) {
-    RuntimeFunction *callee_callable = (RuntimeFunction *)callee;
-    if (arguments.size() != callee_callable->arity()) {
-      throw "Received incorrect number of args.";
-    }
-    return callee_callable->call(this, arguments);
+// `obj.name(args)`. A method is called with `obj` as its receiver directly
+// rather than going through a bound method; a field is called like any other
+// value.
+Value Evaluator::invoke(GetExpr *get, CallExpr *expr) {
+  Value obj = evaluate(get->obj);
+  GcRootScope roots;
+  roots.add(obj);
+
+  if (obj.get_type() == RT_ARRAY) {
+    std::vector<Value> arguments;
+    evaluate_arguments(expr, arguments, roots);
+    at("call", expr->paren.line);
+    return ((RuntimeArrayValue *)obj.as_object())
+        ->call_method(get->name.lexeme, arguments.data(), arguments.size());
   }
 
-  throw "Attempted to call non-callable object.";
-};
+  if (obj.get_type() != RT_INSTANCE)
+    throw "Only object instances have properties.";
 
-RuntimeValue *Evaluator::visit(VariableReferenceExpr *expr) {
-  return lookup_variable(expr->op, expr);
-};
+  RuntimeClassInstance *instance = (RuntimeClassInstance *)obj.as_object();
+  Value *field = instance->find_field(get->symbol, get->cache);
+  if (field != nullptr) {
+    Value callee = *field;
+    roots.add(callee);
+
+    std::vector<Value> arguments;
+    evaluate_arguments(expr, arguments, roots);
+    at("call", expr->paren.line);
+    return call_value(callee, arguments);
+  }
+
+  RuntimeCallable *method = find_class_method(instance->class_, get->symbol);
+  if (method == nullptr)
+    throw "Undefined property " + std::string(get->name.lexeme);
+
+  std::vector<Value> arguments;
+  evaluate_arguments(expr, arguments, roots);
+  at("call", expr->paren.line);
+
+  if (arguments.size() != method->arity())
+    throw "Received incorrect number of args.";
+  return method->call_method(this, obj, arguments);
+}
 
-RuntimeValue *Evaluator::lookup_variable(Token name, Expression *expr) {
-  if (locals.count(expr) > 0) {
-    int distance = locals.at(expr);
-    return environment->get_at(distance, name);
+void Evaluator::evaluate_arguments(CallExpr *expr,
+                                   std::vector<Value> &arguments,
+                                   GcRootScope &roots) {
+  for (auto arg : expr->arguments) {
+    arguments.push_back(evaluate(arg));
+    roots.add(arguments.back());
   }
+}
+
+Value Evaluator::visit(VariableReferenceExpr *expr) {
+  return lookup_variable(expr->resolved);
+};
+
+Value Evaluator::lookup_variable(const VariableSlot &resolved) {
+  if (resolved.is_global())
+    return globals.get(resolved.slot);
 
-  return globals->get(name);
+  return environment->get_at(resolved.depth, resolved.slot);
 }
 
-RuntimeValue *Evaluator::visit(GetExpr *expr) {
-  RuntimeValue *obj = evaluate(expr->obj);
+void Evaluator::assign_variable(const VariableSlot &resolved, Value value) {
+  if (resolved.is_global())
+    globals.assign(resolved.slot, value);
+  else
+    environment->assign_at(resolved.depth, resolved.slot, value);
+}
 
-  if (obj->get_type() == RT_INSTANCE)
-    return ((RuntimeClassInstance *)obj)->get(expr->name);
+void Evaluator::define_variable(const VariableSlot &resolved, Value value) {
+  if (resolved.is_global())
+    globals.define(resolved.slot, value);
+  else
+    environment->assign_at(resolved.depth, resolved.slot, value);
+}
 
-  throw "Only object instances have properties.";
+Value Evaluator::visit(GetExpr *expr) {
+  Value obj = evaluate(expr->obj);
+  at("get", expr->name.line);
+  return get_property(obj, expr->symbol, expr->cache);
 };
 
-RuntimeValue *Evaluator::visit(SetExpr *expr) {
-  RuntimeValue *obj = evaluate(expr->obj);
+Value Evaluator::get_property(Value obj, const Symbol *name,
+                              PropertyCache &cache) {
+  GcRootScope roots;
+  roots.add(obj);
+
+  if (obj.get_type() == RT_INSTANCE)
+    return ((RuntimeClassInstance *)obj.as_object())->get(name, cache);
+
+  throw "Only object instances have properties.";
+}
 
-  if (obj->get_type() != RT_INSTANCE)
+Value Evaluator::visit(SetExpr *expr) {
+  Value obj = evaluate(expr->obj);
+
+  if (obj.get_type() != RT_INSTANCE)
     throw "Only instances have fields.";
 
-  RuntimeValue *value = evaluate(expr->value);
-  ((RuntimeClassInstance *)obj)->set(expr->name, value);
+  GcRootScope roots;
+  roots.add(obj);
+  Value value = evaluate(expr->value);
+  ((RuntimeClassInstance *)obj.as_object())
+      ->set(expr->symbol, value, expr->cache);
 
   return value;
 };
 
-RuntimeValue *Evaluator::visit(ThisExpr *expr) {
-  return lookup_variable(expr->keyword, expr);
+Value Evaluator::visit(ThisExpr *expr) {
+  return lookup_variable(expr->resolved);
 };
 
-RuntimeValue *Evaluator::visit(ArrayExpr *expr) {
-  std::vector<RuntimeValue *> values;
-  int array_length = evaluate(expr->length)->as_number();
+Value Evaluator::visit(ArrayExpr *expr) {
+  std::vector<Value> values;
+  GcRootScope roots;
+  int array_length = evaluate(expr->length).as_number();
 
   for (int i = 0; i < array_length; ++i) {
     if (i >= expr->values.size())
-      values.push_back(new RuntimeValue());
+      values.push_back(Value::nil());
     else
       values.push_back(evaluate(expr->values[i]));
+    roots.add(values.back());
   }
 
-  return new RuntimeArrayValue(values);
+  at("array", expr->bracket.line);
+  return Value::object(runtime_heap.allocate<RuntimeArrayValue>(values));
 };
 
-RuntimeValue *Evaluator::visit(IndexExpr *expr) {
-  RuntimeValue *index = evaluate(expr->index);
-  RuntimeValue *obj = evaluate(expr->obj);
+Value Evaluator::visit(IndexExpr *expr) {
+  Value index = evaluate(expr->index);
+  GcRootScope roots;
+  roots.add(index);
+  Value obj = evaluate(expr->obj);
+  at("index", expr->bracket.line);
+  return index_value(obj, index);
+};
 
-  if (obj->get_type() != RT_ARRAY && obj->get_type() != RT_STRING)
+Value Evaluator::index_value(Value obj, Value index) {
+  if (obj.get_type() != RT_ARRAY && obj.get_type() != RT_STRING)
     throw "Index should be into an array or string.";
 
-  if (!index->is_number())
+  if (!index.is_number())
     throw "Index key should be a number.";
 
-  if (obj->get_type() == RT_STRING) {
-    if (index->as_number() < 0 || index->as_number() >= obj->as_string().size())
+  if (obj.get_type() == RT_STRING) {
+    std::string_view str = string_value(obj);
+    int64_t at = element_index(index, str.size());
+    if (at < 0)
       throw "Index key not in range.";
 
-    return new RuntimeValue(
-        std::string(1, obj->as_string()[index->as_number()]));
+    return character_string(str[at]);
   }
 
-  return ((RuntimeArrayValue *)obj)->get(index->as_number());
-};
+  const std::vector<Value> &values =
+      ((RuntimeArrayValue *)obj.as_object())->array_values;
+  int64_t at = element_index(index, values.size());
+  if (at < 0)
+    throw "Index key out of bounds.";
+  return values[at];
+}
 
-RuntimeValue *Evaluator::visit(SetIndexExpr *expr) {
-  RuntimeValue *value = evaluate(expr->value);
-  RuntimeValue *index = evaluate(expr->index);
-  RuntimeValue *obj = evaluate(expr->obj);
+Value Evaluator::visit(SetIndexExpr *expr) {
+  Value value = evaluate(expr->value);
+  GcRootScope roots;
+  roots.add(value);
+  Value index = evaluate(expr->index);
+  roots.add(index);
+  Value obj = evaluate(expr->obj);
+  set_index_value(obj, index, value);
+  return Value::nil();
+};
 
-  if (obj->get_type() != RT_ARRAY)
+void Evaluator::set_index_value(Value obj, Value index, Value value) {
+  if (obj.get_type() != RT_ARRAY)
     throw "Index should be into an array.";
 
-  if (!index->is_number())
+  if (!index.is_number())
     throw "Index key should be a number.";
 
-  if (index->as_number() < 0 ||
-      index->as_number() >= ((RuntimeArrayValue *)obj)->array_values.size())
+  RuntimeArrayValue *array = (RuntimeArrayValue *)obj.as_object();
+  int64_t at = element_index(index, array->array_values.size());
+  if (at < 0)
     throw "Index key not in range.";
 
-  ((RuntimeArrayValue *)obj)->set(index->as_number(), value);
-
-  return new RuntimeValue();
-};
+  array->array_values[at] = value;
+}
 
-RuntimeValue *Evaluator::visit(ExpressionStmt *stmt) {
+Value Evaluator::visit(ExpressionStmt *stmt) {
   return evaluate(stmt->expression);
 };
 
-RuntimeValue *Evaluator::visit(PrintStmt *stmt) {
-  RuntimeValue *value = stmt->expression->accept(*this);
-  printf("%s\n", value->as_string().c_str());
-  return new RuntimeValue();
+Value Evaluator::visit(PrintStmt *stmt) {
+  Value value = stmt->expression->accept(*this);
+  printf("%s\n", value.as_string().c_str());
+  return Value::nil();
 };
 
-RuntimeValue *Evaluator::visit(VariableDeclarationStmt *stmt) {
-  environment->define(stmt->name.lexeme, evaluate(stmt->initializer));
-  return new RuntimeValue();
+Value Evaluator::visit(VariableDeclarationStmt *stmt) {
+  line = stmt->name.line;
+  define_variable(stmt->resolved, evaluate(stmt->initializer));
+  return Value::nil();
 };
 
-RuntimeValue *Evaluator::visit(AssignmentStmt *stmt) {
-  RuntimeValue *value = evaluate(stmt->value);
-
-  if (locals.count(stmt)) {
-    int distance = locals.at(stmt);
-    environment->assign_at(distance, stmt->name.lexeme, value);
-  } else {
-    environment->assign(stmt->name.lexeme, value);
-  }
-
+Value Evaluator::visit(AssignmentStmt *stmt) {
+  line = stmt->name.line;
+  Value value = evaluate(stmt->value);
+  assign_variable(stmt->resolved, value);
   return value;
 };
 
-RuntimeValue *Evaluator::visit(BlockStmt *stmt) {
-  execute_block(*stmt, new Environment(environment));
-  return new RuntimeValue();
+Value Evaluator::visit(BlockStmt *stmt) {
+  if (stmt->scope_size == 0) {
+    for (Statement *statement : stmt->statements) {
+      evaluate(statement);
+      if (completion != COMPLETION_NORMAL)
+        break;
+    }
+    return Value::nil();
+  }
+
+  // Blocks have no token of their own, so their environments are charged to
+  // the line last run.
+  site_kind = "block";
+  execute_block(stmt->statements,
+                runtime_heap.allocate<Environment>(environment,
+                                                   stmt->scope_size));
+  return Value::nil();
 };
 
-RuntimeValue *Evaluator::visit(IfStmt *stmt) {
-  if (evaluate(stmt->condition)->is_truthy()) {
+Value Evaluator::visit(IfStmt *stmt) {
+  if (evaluate(stmt->condition).is_truthy()) {
     evaluate(stmt->then_branch);
-  } else {
+  } else if (stmt->else_branch != nullptr) {
     evaluate(stmt->else_branch);
   }
 
-  return new RuntimeValue();
+  return Value::nil();
 };
 
-RuntimeValue *Evaluator::visit(WhileStmt *stmt) {
-  while (evaluate(stmt->condition)->is_truthy()) {
+Value Evaluator::visit(WhileStmt *stmt) {
+  while (evaluate(stmt->condition).is_truthy()) {
     evaluate(stmt->body);
+    if (completion != COMPLETION_NORMAL)
+      break;
   }
 
-  return new RuntimeValue();
+  return Value::nil();
 };
 
-RuntimeValue *Evaluator::visit(ReturnStmt *stmt) {
-  throw evaluate(stmt->value);
+Value Evaluator::visit(ForStmt *stmt) {
+  Environment *previous = environment;
+  GcRootScope roots;
+  roots.add(previous);
+  at("for", stmt->keyword.line);
+  if (stmt->scope_size > 0)
+    environment =
+        runtime_heap.allocate<Environment>(environment, stmt->scope_size);
+
+  if (stmt->initializer != nullptr)
+    evaluate(stmt->initializer);
+
+  while (evaluate(stmt->condition).is_truthy()) {
+    evaluate(stmt->body);
+    if (completion != COMPLETION_NORMAL)
+      break;
+    if (stmt->increment != nullptr)
+      evaluate(stmt->increment);
+  }
+
+  environment = previous;
+  return Value::nil();
 };
 
-RuntimeValue *Evaluator::visit(ClassStmt *stmt) {
-  environment->define(stmt->name.lexeme, new RuntimeValue());
+Value Evaluator::visit(ReturnStmt *stmt) {
+  line = stmt->keyword.line;
+  return_value = evaluate(stmt->value);
+  completion = COMPLETION_RETURN;
+  return Value::nil();
+};
 
-  std::unordered_map<std::string, RuntimeFunction *> methods;
-  for (FunctionDeclarationStmt method : stmt->methods) {
-    RuntimeFunction *function = new RuntimeFunction(method, environment);
-    methods.insert_or_assign(method.name.lexeme, function);
+Value Evaluator::visit(ClassStmt *stmt) {
+  at("class", stmt->name.line);
+  define_variable(stmt->resolved, Value::nil());
+
+  SymbolMap<RuntimeCallable *> methods;
+  GcRootScope roots;
+  for (FunctionDeclarationStmt *method : stmt->methods) {
+    RuntimeFunction *function =
+        runtime_heap.allocate<RuntimeFunction>(method, environment);
+    roots.add(function);
+    methods.insert_or_assign(intern(method->name.lexeme), function);
   }
 
-  RuntimeClass *class_ = new RuntimeClass(stmt->name.lexeme, methods);
-  environment->assign(stmt->name.lexeme, class_);
+  RuntimeClass *class_ =
+      runtime_heap.allocate<RuntimeClass>(std::string(stmt->name.lexeme),
+                                          methods);
+  define_variable(stmt->resolved, Value::object(class_));
 
-  return new RuntimeValue();
+  return Value::nil();
 };
 
-RuntimeValue *Evaluator::visit(FunctionDeclarationStmt *stmt) {
-  environment->define(stmt->name.lexeme,
-                      new RuntimeFunction(*stmt, environment));
-  return new RuntimeValue();
+Value Evaluator::visit(FunctionDeclarationStmt *stmt) {
+  at("function", stmt->name.line);
+  define_variable(stmt->resolved,
+                  Value::object(runtime_heap.allocate<RuntimeFunction>(
+                      stmt, environment)));
+  return Value::nil();
 };
@@ -1,48 +1,107 @@
 #pragma once
 
 #include "../parser/expression.h"
+#include "../parser/flat_ast.h"
+#include "../profiler.h"
 #include "../variable/environment.h"
+#include "../variable/global_table.h"
+#include "builtins.h"
 
-class Evaluator : public ExpressionVisitor<RuntimeValue *> {
+// How the most recently executed statement finished. Anything other than
+// normal completion stops execution of the enclosing statement lists until
+// something consumes it: a function call consumes a return.
+enum CompletionType { COMPLETION_NORMAL, COMPLETION_RETURN };
+
+class Evaluator : public ExpressionVisitor<Value>,
+                  public GcRootSource,
+                  public AllocationSiteSource {
 public:
-  Evaluator() : line(1) {
-    globals = new Environment();
-    environment = globals;
+  Evaluator()
+      : environment(nullptr), completion(COMPLETION_NORMAL),
+        return_value(Value::nil()), line(1) {
+    runtime_heap.add_root_source(this);
+    install_stdlib(globals);
+  }
+
+  ~Evaluator() { runtime_heap.remove_root_source(this); }
+
+  void mark_roots(Heap &heap) override;
+  AllocationSite allocation_site() const override {
+    return AllocationSite{site_kind, line};
   }
 
-  RuntimeValue *evaluate(Expression *expression);
-
-  RuntimeValue *visit(BinaryExpr *expr) override;
-  RuntimeValue *visit(GroupingExpr *expr) override;
-  RuntimeValue *visit(LiteralExpr *expr) override;
-  RuntimeValue *visit(UnaryExpr *expr) override;
-  RuntimeValue *visit(CallExpr *expr) override;
-  RuntimeValue *visit(VariableReferenceExpr *expr) override;
-  RuntimeValue *visit(GetExpr *expr) override;
-  RuntimeValue *visit(SetExpr *expr) override;
-  RuntimeValue *visit(ThisExpr *expr) override;
-  RuntimeValue *visit(ArrayExpr *expr) override;
-  RuntimeValue *visit(IndexExpr *expr) override;
-  RuntimeValue *visit(SetIndexExpr *expr) override;
-
-  RuntimeValue *visit(ExpressionStmt *stmt) override;
-  RuntimeValue *visit(PrintStmt *stmt) override;
-  RuntimeValue *visit(VariableDeclarationStmt *stmt) override;
-  RuntimeValue *visit(AssignmentStmt *stmt) override;
-  RuntimeValue *visit(BlockStmt *stmt) override;
-  RuntimeValue *visit(IfStmt *stmt) override;
-  RuntimeValue *visit(WhileStmt *stmt) override;
-  RuntimeValue *visit(ReturnStmt *stmt) override;
-  RuntimeValue *visit(ClassStmt *stmt) override;
-  RuntimeValue *visit(FunctionDeclarationStmt *stmt) override;
-
-  RuntimeValue *lookup_variable(Token name, Expression *expr);
-
-  void execute_block(BlockStmt block, Environment *env);
-  void resolve(Expression *expression, int depth);
+  Value evaluate(Expression *expression);
+
+  Value visit(BinaryExpr *expr) override;
+  Value visit(GroupingExpr *expr) override;
+  Value visit(LiteralExpr *expr) override;
+  Value visit(UnaryExpr *expr) override;
+  Value visit(CallExpr *expr) override;
+  Value visit(VariableReferenceExpr *expr) override;
+  Value visit(GetExpr *expr) override;
+  Value visit(SetExpr *expr) override;
+  Value visit(ThisExpr *expr) override;
+  Value visit(ArrayExpr *expr) override;
+  Value visit(IndexExpr *expr) override;
+  Value visit(SetIndexExpr *expr) override;
+
+  Value visit(ExpressionStmt *stmt) override;
+  Value visit(PrintStmt *stmt) override;
+  Value visit(VariableDeclarationStmt *stmt) override;
+  Value visit(AssignmentStmt *stmt) override;
+  Value visit(BlockStmt *stmt) override;
+  Value visit(IfStmt *stmt) override;
+  Value visit(WhileStmt *stmt) override;
+  Value visit(ForStmt *stmt) override;
+  Value visit(ReturnStmt *stmt) override;
+  Value visit(ClassStmt *stmt) override;
+  Value visit(FunctionDeclarationStmt *stmt) override;
 
+  // Operations shared by the pointer-based and the flat syntax tree.
+  Value binary_operation(TokenType op, Value left, Value right);
+  Value unary_operation(TokenType op, Value right);
+  Value call_value(Value callee, std::vector<Value> &arguments);
+  Value get_property(Value obj, const Symbol *name, PropertyCache &cache);
+  Value index_value(Value obj, Value index);
+  void set_index_value(Value obj, Value index, Value value);
+
+  Value invoke(GetExpr *get, CallExpr *expr);
+  void evaluate_arguments(CallExpr *expr, std::vector<Value> &arguments,
+                          GcRootScope &roots);
+
+  Value lookup_variable(const VariableSlot &resolved);
+  void assign_variable(const VariableSlot &resolved, Value value);
+  void define_variable(const VariableSlot &resolved, Value value);
+
+  void execute_block(std::span<Statement *> statements, Environment *env);
+  // Runs a function body and consumes its return, if any.
+  Value execute_body(std::span<Statement *> statements, Environment *env);
+
+  // The same evaluation over a flat tree, which must have been resolved.
+  void execute(FlatAst &ast);
+  Value evaluate(FlatAst &ast, NodeIndex node);
+  Value invoke(FlatAst &ast, NodeIndex get, NodeIndex call);
+  void evaluate_arguments(FlatAst &ast, NodeIndex call,
+                          std::vector<Value> &arguments, GcRootScope &roots);
+  // Run the operands of `parent`, a block or a function declaration.
+  void execute_block(FlatAst &ast, NodeIndex parent, Environment *env);
+  Value execute_body(FlatAst &ast, NodeIndex parent, Environment *env);
+
+  // Null while executing top-level code, which only has globals.
   Environment *environment;
-  Environment *globals;
-  std::unordered_map<Expression *, int> locals;
+  GlobalTable globals;
+  CompletionType completion;
+  // Set along with COMPLETION_RETURN.
+  Value return_value;
+  // The line being run, or over a FlatAst the source offset of the node
+  // being run, and the kind of that node if it may allocate. Only the
+  // profilers read them.
   int line;
+  const char *site_kind = "script";
+  void at(const char *kind, int line) {
+    site_kind = kind;
+    this->line = line;
+  }
+  // Set while profiling; functions push their frames onto it.
+  ShadowStack *profile_stack = nullptr;
 };
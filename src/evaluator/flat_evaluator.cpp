@@ -0,0 +1,326 @@
+#include "evaluator.h"
+#include "runtime_callable.h"
+
+// Mirrors the visitor in evaluator.cpp, node kind by node kind.
+
+void Evaluator::execute(FlatAst &ast) {
+  for (NodeIndex statement : ast.statements)
+    evaluate(ast, statement);
+}
+
+void Evaluator::execute_block(FlatAst &ast, NodeIndex parent,
+                              Environment *env) {
+  Environment *previous = environment;
+  GcRootScope roots;
+  roots.add(previous);
+  environment = env;
+
+  for (NodeIndex statement : FlatOperands(ast, parent)) {
+    evaluate(ast, statement);
+    if (completion != COMPLETION_NORMAL)
+      break;
+  }
+
+  environment = previous;
+}
+
+Value Evaluator::execute_body(FlatAst &ast, NodeIndex parent,
+                              Environment *env) {
+  execute_block(ast, parent, env);
+  if (completion != COMPLETION_RETURN)
+    return Value::nil();
+
+  Value result = return_value;
+  completion = COMPLETION_NORMAL;
+  return_value = Value::nil();
+  return result;
+}
+
+void Evaluator::evaluate_arguments(FlatAst &ast, NodeIndex call,
+                                   std::vector<Value> &arguments,
+                                   GcRootScope &roots) {
+  for (NodeIndex argument : FlatOperands(ast, call, 1)) {
+    arguments.push_back(evaluate(ast, argument));
+    roots.add(arguments.back());
+  }
+}
+
+Value Evaluator::invoke(FlatAst &ast, NodeIndex get, NodeIndex call) {
+  Value obj = evaluate(ast, ast.first_operand(get));
+  GcRootScope roots;
+  roots.add(obj);
+
+  const Symbol *name = ast.property_names[ast.data[get]];
+
+  if (obj.get_type() == RT_ARRAY) {
+    std::vector<Value> arguments;
+    evaluate_arguments(ast, call, arguments, roots);
+    at("call", ast.spans[call].offset);
+    return ((RuntimeArrayValue *)obj.as_object())
+        ->call_method(name->name, arguments.data(), arguments.size());
+  }
+
+  if (obj.get_type() != RT_INSTANCE)
+    throw "Only object instances have properties.";
+
+  RuntimeClassInstance *instance = (RuntimeClassInstance *)obj.as_object();
+  Value *field = instance->find_field(name, ast.caches[ast.data[get]]);
+  if (field != nullptr) {
+    Value callee = *field;
+    roots.add(callee);
+
+    std::vector<Value> arguments;
+    evaluate_arguments(ast, call, arguments, roots);
+    at("call", ast.spans[call].offset);
+    return call_value(callee, arguments);
+  }
+
+  RuntimeCallable *method = find_class_method(instance->class_, name);
+  if (method == nullptr)
+    throw "Undefined property " + name->name;
+
+  std::vector<Value> arguments;
+  evaluate_arguments(ast, call, arguments, roots);
+  at("call", ast.spans[call].offset);
+
+  if (arguments.size() != method->arity())
+    throw "Received incorrect number of args.";
+  return method->call_method(this, obj, arguments);
+}
+
+Value Evaluator::evaluate(FlatAst &ast, NodeIndex node) {
+  switch (ast.kind(node)) {
+  case BINARY_EXPR: {
+    Value left = evaluate(ast, ast.first_operand(node));
+    GcRootScope roots;
+    roots.add(left);
+    Value right = evaluate(ast, ast.operand(node, 1));
+    at("binary", ast.spans[node].offset);
+    return binary_operation((TokenType)ast.data[node], left, right);
+  }
+
+  case GROUPING_EXPR:
+    return evaluate(ast, ast.first_operand(node));
+
+  case LITERAL_EXPR: {
+    Value &value = ast.literal_values[ast.data[node]];
+    if (value.is_undefined()) {
+      at("literal", ast.spans[node].offset);
+      value = interned_string(intern(ast.text(node)));
+    }
+    return value;
+  }
+
+  case UNARY_EXPR: {
+    Value right = evaluate(ast, ast.first_operand(node));
+    line = ast.spans[node].offset;
+    return unary_operation((TokenType)ast.data[node], right);
+  }
+
+  case CALL_EXPR: {
+    NodeIndex callee_node = ast.first_operand(node);
+    if (ast.kind(callee_node) == GET_EXPR)
+      return invoke(ast, callee_node, node);
+
+    Value callee = evaluate(ast, callee_node);
+    GcRootScope roots;
+    roots.add(callee);
+
+    std::vector<Value> arguments;
+    evaluate_arguments(ast, node, arguments, roots);
+    at("call", ast.spans[node].offset);
+    return call_value(callee, arguments);
+  }
+
+  case VARIABLE_REFERENCE_EXPR:
+  case THIS_EXPR:
+    return lookup_variable(ast.resolved[ast.data[node]]);
+
+  case GET_EXPR: {
+    Value obj = evaluate(ast, ast.first_operand(node));
+    at("get", ast.spans[node].offset);
+    return get_property(obj, ast.property_names[ast.data[node]],
+                        ast.caches[ast.data[node]]);
+  }
+
+  case SET_EXPR: {
+    Value obj = evaluate(ast, ast.first_operand(node));
+
+    if (obj.get_type() != RT_INSTANCE)
+      throw "Only instances have fields.";
+
+    GcRootScope roots;
+    roots.add(obj);
+    Value value = evaluate(ast, ast.operand(node, 1));
+    ((RuntimeClassInstance *)obj.as_object())
+        ->set(ast.property_names[ast.data[node]], value,
+              ast.caches[ast.data[node]]);
+
+    return value;
+  }
+
+  case ARRAY_EXPR: {
+    NodeIndex length = ast.first_operand(node);
+    std::vector<Value> values;
+    GcRootScope roots;
+    int array_length = evaluate(ast, length).as_number();
+
+    NodeIndex value = ast.next_operand(length);
+    for (int i = 0; i < array_length; ++i) {
+      if (!ast.is_operand_of(value, node)) {
+        values.push_back(Value::nil());
+      } else {
+        values.push_back(evaluate(ast, value));
+        value = ast.next_operand(value);
+      }
+      roots.add(values.back());
+    }
+
+    at("array", ast.spans[node].offset);
+    return Value::object(runtime_heap.allocate<RuntimeArrayValue>(values));
+  }
+
+  case INDEX_EXPR: {
+    Value index = evaluate(ast, ast.operand(node, 1));
+    GcRootScope roots;
+    roots.add(index);
+    Value obj = evaluate(ast, ast.first_operand(node));
+    at("index", ast.spans[node].offset);
+    return index_value(obj, index);
+  }
+
+  case SET_INDEX_EXPR: {
+    Value value = evaluate(ast, ast.operand(node, 2));
+    GcRootScope roots;
+    roots.add(value);
+    Value index = evaluate(ast, ast.operand(node, 1));
+    roots.add(index);
+    Value obj = evaluate(ast, ast.first_operand(node));
+    set_index_value(obj, index, value);
+    return Value::nil();
+  }
+
+  case EXPRESSION_STMT:
+    return evaluate(ast, ast.first_operand(node));
+
+  case PRINT_STMT: {
+    Value value = evaluate(ast, ast.first_operand(node));
+    printf("%s\n", value.as_string().c_str());
+    return Value::nil();
+  }
+
+  case VARIABLE_DECLARATION_STMT:
+    line = ast.spans[node].offset;
+    define_variable(ast.resolved[ast.data[node]],
+                    evaluate(ast, ast.first_operand(node)));
+    return Value::nil();
+
+  case ASSIGNMENT_STMT: {
+    line = ast.spans[node].offset;
+    Value value = evaluate(ast, ast.first_operand(node));
+    assign_variable(ast.resolved[ast.data[node]], value);
+    return value;
+  }
+
+  case BLOCK_STMT:
+    if (ast.data[node] == 0) {
+      for (NodeIndex statement : FlatOperands(ast, node)) {
+        evaluate(ast, statement);
+        if (completion != COMPLETION_NORMAL)
+          break;
+      }
+      return Value::nil();
+    }
+
+    site_kind = "block";
+    execute_block(ast, node,
+                  runtime_heap.allocate<Environment>(environment,
+                                                     ast.data[node]));
+    return Value::nil();
+
+  case IF_STMT: {
+    NodeIndex then_branch = ast.operand(node, 1);
+    NodeIndex else_branch = ast.next_operand(then_branch);
+    if (evaluate(ast, ast.first_operand(node)).is_truthy())
+      evaluate(ast, then_branch);
+    else if (ast.is_operand_of(else_branch, node))
+      evaluate(ast, else_branch);
+    return Value::nil();
+  }
+
+  case WHILE_STMT: {
+    NodeIndex condition = ast.first_operand(node);
+    NodeIndex body = ast.operand(node, 1);
+    while (evaluate(ast, condition).is_truthy()) {
+      evaluate(ast, body);
+      if (completion != COMPLETION_NORMAL)
+        break;
+    }
+    return Value::nil();
+  }
+
+  case FOR_STMT: {
+    NodeIndex initializer = ast.first_operand(node);
+    NodeIndex condition = ast.next_operand(initializer);
+    NodeIndex body = ast.next_operand(condition);
+    NodeIndex increment = ast.next_operand(body);
+    bool has_increment = ast.is_operand_of(increment, node);
+
+    Environment *previous = environment;
+    GcRootScope roots;
+    roots.add(previous);
+    at("for", ast.spans[node].offset);
+    if (ast.data[node] > 0)
+      environment =
+          runtime_heap.allocate<Environment>(environment, ast.data[node]);
+
+    evaluate(ast, initializer);
+    while (evaluate(ast, condition).is_truthy()) {
+      evaluate(ast, body);
+      if (completion != COMPLETION_NORMAL)
+        break;
+      if (has_increment)
+        evaluate(ast, increment);
+    }
+
+    environment = previous;
+    return Value::nil();
+  }
+
+  case RETURN_STMT:
+    line = ast.spans[node].offset;
+    return_value = evaluate(ast, ast.first_operand(node));
+    completion = COMPLETION_RETURN;
+    return Value::nil();
+
+  case CLASS_STMT: {
+    at("class", ast.spans[node].offset);
+    const VariableSlot &resolved = ast.resolved[ast.data[node]];
+    define_variable(resolved, Value::nil());
+
+    SymbolMap<RuntimeCallable *> methods;
+    GcRootScope roots;
+    for (NodeIndex method : FlatOperands(ast, node)) {
+      RuntimeFlatFunction *function =
+          runtime_heap.allocate<RuntimeFlatFunction>(&ast, method,
+                                                     environment);
+      roots.add(function);
+      methods.insert_or_assign(intern(ast.text(method)), function);
+    }
+
+    RuntimeClass *class_ = runtime_heap.allocate<RuntimeClass>(
+        std::string(ast.text(node)), methods);
+    define_variable(resolved, Value::object(class_));
+    return Value::nil();
+  }
+
+  case FUNCTION_DECLARATION_STMT:
+    at("function", ast.spans[node].offset);
+    define_variable(ast.functions[ast.data[node]].resolved,
+                    Value::object(runtime_heap.allocate<RuntimeFlatFunction>(
+                        &ast, node, environment)));
+    return Value::nil();
+  }
+
+  return Value::nil();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../variable/global_table.h"
+#include "runtime_callable.h"
+#include <string>
+#include <utility>
+
+// Entry point of a native function. `args` points at exactly `arity()`
+// arguments, which the caller keeps rooted for the duration of the call.
+typedef Value (*NativeFn)(Value *args);
+
+// A function implemented in C++. Both engines check the argument count before
+// calling it; the VM passes its arguments straight off the stack.
+class RuntimeNativeFunction : public RuntimeCallable {
+public:
+  RuntimeNativeFunction(std::string name, int param_count, NativeFn function)
+      : name(name), param_count(param_count), function(function) {}
+
+  RuntimeValueType get_type() const override { return RT_NATIVE; }
+  std::string as_string() const override { return "<native : " + name + ">"; }
+  int arity() const override { return param_count; }
+
+  Value call(Evaluator *evaluator, std::vector<Value> &arguments) override {
+    return function(arguments.data());
+  }
+
+  std::string name;
+  int param_count;
+  NativeFn function;
+};
+
+[[noreturn]] void throw_native_argument_error(int position,
+                                              const char *expected);
+
+// Converts an argument to the parameter type of a wrapped C++ function.
+template <typename T> struct NativeArg;
+
+template <> struct NativeArg<Value> {
+  static Value unbox(Value value, int) { return value; }
+};
+
+template <> struct NativeArg<double> {
+  static double unbox(Value value, int position) {
+    if (!value.is_number())
+      throw_native_argument_error(position, "a number");
+    return value.as_number();
+  }
+};
+
+template <> struct NativeArg<std::string_view> {
+  static std::string_view unbox(Value value, int position) {
+    if (!value.is_string())
+      throw_native_argument_error(position, "a string");
+    return string_value(value);
+  }
+};
+
+template <> struct NativeArg<RuntimeArrayValue *> {
+  static RuntimeArrayValue *unbox(Value value, int position) {
+    if (value.get_type() != RT_ARRAY)
+      throw_native_argument_error(position, "an array");
+    return (RuntimeArrayValue *)value.as_object();
+  }
+};
+
+inline Value native_result(Value value) { return value; }
+inline Value native_result(double number) { return Value::number(number); }
+inline Value native_result(bool boolean) { return Value::boolean(boolean); }
+inline Value native_result(std::string string) {
+  return make_string(std::move(string));
+}
+
+template <typename R, typename... Args>
+constexpr int native_arity(R (*)(Args...)) {
+  return sizeof...(Args);
+}
+
+template <typename R, typename... Args, size_t... I>
+Value call_native(R (*function)(Args...), Value *args,
+                  std::index_sequence<I...>) {
+  return native_result(function(NativeArg<Args>::unbox(args[I], I + 1)...));
+}
+
+// Adapts `F`, an ordinary C++ function over Values, numbers, strings and
+// arrays, to the NativeFn calling convention. The arity and the conversions
+// are fixed at compile time.
+template <auto F> Value native_thunk(Value *args) {
+  return call_native(F, args, std::make_index_sequence<native_arity(F)>());
+}
+
+// Defines the global `name` as a native function wrapping `F`.
+template <auto F> void define_native(GlobalTable &globals, const char *name) {
+  RuntimeNativeFunction *native = runtime_heap.allocate<RuntimeNativeFunction>(
+      name, native_arity(F), native_thunk<F>);
+  globals.define(globals.index_of(name), Value::object(native));
+}
@@ -1,46 +1,121 @@
 #include "runtime_callable.h"
 
-bool RuntimeCallable::is_callable() { return true; }
+bool RuntimeCallable::is_callable() const { return true; }
 
 std::string RuntimeCallable::as_string() const { return "<func>"; }
 
 int RuntimeCallable::arity() const { return 0; };
 
-RuntimeValue *RuntimeCallable::call(Evaluator *evaluator,
-                                    std::vector<RuntimeValue *> arguments) {
-  return new RuntimeValue();
+Value RuntimeCallable::call(Evaluator *evaluator,
+                            std::vector<Value> &arguments) {
+  return Value::nil();
 }
 
+Value RuntimeCallable::call_method(Evaluator *evaluator, Value receiver,
+                                   std::vector<Value> &arguments) {
+  return call(evaluator, arguments);
+}
+
+RuntimeCallable *RuntimeCallable::bind(RuntimeObject *instance) { return this; }
+
 // =======================
 // === RuntimeFunction ===
 // =======================
 
-RuntimeValue *RuntimeFunction::call(Evaluator *evaluator,
-                                    std::vector<RuntimeValue *> arguments) {
+RuntimeCallable *RuntimeFunction::bind(RuntimeObject *instance) {
+  return runtime_heap.allocate<RuntimeBoundMethod>(Value::object(instance),
+                                                   this);
+}
+
+Value RuntimeFunction::call(Evaluator *evaluator,
+                            std::vector<Value> &arguments) {
   Environment *env =
-      new Environment(closure == nullptr ? evaluator->environment : closure);
+      runtime_heap.allocate<Environment>(closure, declaration->scope_size);
 
   for (int i = 0; i < arguments.size(); ++i) {
-    env->define(declaration.params[i].lexeme, arguments[i]);
+    env->slots[i] = arguments[i];
   }
 
-  try {
-    evaluator->execute_block(BlockStmt(declaration.body), env);
-  } catch (RuntimeValue *return_value) {
-    return return_value;
+  return execute(evaluator, env);
+}
+
+Value RuntimeFunction::call_method(Evaluator *evaluator, Value receiver,
+                                   std::vector<Value> &arguments) {
+  Environment *env =
+      runtime_heap.allocate<Environment>(closure, declaration->scope_size);
+
+  env->slots[0] = receiver;
+  for (int i = 0; i < arguments.size(); ++i) {
+    env->slots[i + 1] = arguments[i];
   }
 
-  return new RuntimeValue();
+  return execute(evaluator, env);
+}
+
+Value RuntimeFunction::execute(Evaluator *evaluator, Environment *env) {
+  ProfileScope profile(evaluator->profile_stack, declaration->name.lexeme,
+                       declaration->name.line);
+  return evaluator->execute_body(declaration->body, env);
 }
 
 std::string RuntimeFunction::as_string() const {
-  return "<func : " + declaration.name.lexeme + ">";
+  return "<func : " + std::string(declaration->name.lexeme) + ">";
+}
+
+int RuntimeFunction::arity() const { return declaration->params.size(); }
+
+// ===========================
+// === RuntimeFlatFunction ===
+// ===========================
+
+RuntimeCallable *RuntimeFlatFunction::bind(RuntimeObject *instance) {
+  return runtime_heap.allocate<RuntimeBoundMethod>(Value::object(instance),
+                                                   this);
+}
+
+Value RuntimeFlatFunction::call(Evaluator *evaluator,
+                                std::vector<Value> &arguments) {
+  Environment *env =
+      runtime_heap.allocate<Environment>(closure, function().scope_size);
+
+  for (int i = 0; i < arguments.size(); ++i) {
+    env->slots[i] = arguments[i];
+  }
+
+  ProfileScope profile(evaluator->profile_stack, ast->text(declaration),
+                       ast->spans[declaration].offset);
+  return evaluator->execute_body(*ast, declaration, env);
 }
 
-int RuntimeFunction::arity() const { return declaration.params.size(); }
+Value RuntimeFlatFunction::call_method(Evaluator *evaluator, Value receiver,
+                                       std::vector<Value> &arguments) {
+  Environment *env =
+      runtime_heap.allocate<Environment>(closure, function().scope_size);
 
-RuntimeFunction *find_class_method(RuntimeClass *class_, std::string name) {
+  env->slots[0] = receiver;
+  for (int i = 0; i < arguments.size(); ++i) {
+    env->slots[i + 1] = arguments[i];
+  }
+
+  ProfileScope profile(evaluator->profile_stack, ast->text(declaration),
+                       ast->spans[declaration].offset);
+  return evaluator->execute_body(*ast, declaration, env);
+}
+
+std::string RuntimeFlatFunction::as_string() const {
+  return "<func : " + std::string(ast->text(declaration)) + ">";
+}
+
+int RuntimeFlatFunction::arity() const { return function().param_count; }
+
+RuntimeCallable *find_class_method(RuntimeClass *class_, const Symbol *name) {
   return class_->find_method(name);
 }
 
 std::string get_class_name(RuntimeClass *class_) { return class_->name; }
+
+void RuntimeClassInstance::trace(Heap &heap) {
+  heap.mark(class_);
+  for (Value field : fields)
+    heap.mark(field);
+}
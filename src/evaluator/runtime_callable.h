@@ -1,56 +1,116 @@
+#pragma once
+
 #include "../variable/environment.h"
 #include "./evaluator.h"
 #include "./runtime_value.h"
+#include "./shape.h"
 
-class RuntimeCallable : public RuntimeValue {
+class RuntimeCallable : public RuntimeObject {
 public:
-  RuntimeCallable() { this->is_literal_value = false; }
-  bool is_callable() override;
+  bool is_callable() const override;
   std::string as_string() const override;
 
   RuntimeValueType get_type() const override { return RT_CALLABLE; };
 
   virtual int arity() const;
-  virtual RuntimeValue *call(Evaluator *evaluator,
-                             std::vector<RuntimeValue *> arguments);
+  virtual Value call(Evaluator *evaluator, std::vector<Value> &arguments);
+  // Calls this as a method of `receiver`, which becomes `this`.
+  virtual Value call_method(Evaluator *evaluator, Value receiver,
+                            std::vector<Value> &arguments);
+  virtual RuntimeCallable *bind(RuntimeObject *instance);
 };
 
 class Environment;
 
+// The declaration is owned by the AST, which outlives every function object.
+// Methods are resolved with `this` in slot 0 of their own scope, ahead of the
+// parameters, so calling one never needs an extra environment.
 class RuntimeFunction : public RuntimeCallable {
 public:
-  RuntimeFunction(FunctionDeclarationStmt declaration, Environment *closure)
+  RuntimeFunction(FunctionDeclarationStmt *declaration, Environment *closure)
       : declaration(declaration), closure(closure) {}
 
-  RuntimeFunction *bind(RuntimeValue *instance) {
-    Environment *environment = new Environment(closure);
-    environment->define("this", instance);
-    return new RuntimeFunction(declaration, environment);
-  }
+  RuntimeCallable *bind(RuntimeObject *instance) override;
 
-  RuntimeValue *call(Evaluator *evaluator,
-                     std::vector<RuntimeValue *> arguments) override;
+  Value call(Evaluator *evaluator, std::vector<Value> &arguments) override;
+  Value call_method(Evaluator *evaluator, Value receiver,
+                    std::vector<Value> &arguments) override;
   std::string as_string() const override;
   int arity() const override;
 
-  bool is_callable() override { return true; };
+  RuntimeValueType get_type() const override { return RT_FUNCTION; };
+
+  void trace(Heap &heap) override { heap.mark(closure); }
+
+  FunctionDeclarationStmt *declaration;
+  Environment *closure = nullptr;
+
+private:
+  Value execute(Evaluator *evaluator, Environment *env);
+};
+
+// A function declared in a FlatAst, which outlives every function object.
+class RuntimeFlatFunction : public RuntimeCallable {
+public:
+  RuntimeFlatFunction(FlatAst *ast, NodeIndex declaration,
+                      Environment *closure)
+      : ast(ast), declaration(declaration), closure(closure) {}
+
+  RuntimeCallable *bind(RuntimeObject *instance) override;
+
+  Value call(Evaluator *evaluator, std::vector<Value> &arguments) override;
+  Value call_method(Evaluator *evaluator, Value receiver,
+                    std::vector<Value> &arguments) override;
+  std::string as_string() const override;
+  int arity() const override;
 
   RuntimeValueType get_type() const override { return RT_FUNCTION; };
 
-  FunctionDeclarationStmt declaration;
+  void trace(Heap &heap) override { heap.mark(closure); }
+
+  FlatAst *ast;
+  NodeIndex declaration;
   Environment *closure = nullptr;
+
+private:
+  const FlatFunction &function() const {
+    return ast->functions[ast->data[declaration]];
+  }
+};
+
+// A method read off an instance as a value, e.g. `var f = obj.method;`.
+// Calling `obj.method()` directly never creates one.
+class RuntimeBoundMethod : public RuntimeCallable {
+public:
+  RuntimeBoundMethod(Value receiver, RuntimeCallable *method)
+      : receiver(receiver), method(method) {}
+
+  RuntimeValueType get_type() const override { return RT_BOUND_METHOD; }
+  std::string as_string() const override { return method->as_string(); }
+  int arity() const override { return method->arity(); }
+
+  Value call(Evaluator *evaluator, std::vector<Value> &arguments) override {
+    return method->call_method(evaluator, receiver, arguments);
+  }
+
+  void trace(Heap &heap) override {
+    heap.mark(receiver);
+    heap.mark(method);
+  }
+
+  Value receiver;
+  RuntimeCallable *method;
 };
 
 class RuntimeClass;
 
-RuntimeFunction *find_class_method(RuntimeClass *class_, std::string name);
+RuntimeCallable *find_class_method(RuntimeClass *class_, const Symbol *name);
 std::string get_class_name(RuntimeClass *class_);
 
-class RuntimeClassInstance : public RuntimeValue {
+class RuntimeClassInstance : public RuntimeObject {
 public:
-  RuntimeClassInstance(RuntimeClass *class_) : class_(class_) {
-    is_literal_value = false;
-  }
+  RuntimeClassInstance(RuntimeClass *class_)
+      : class_(class_), shape(Shape::empty()) {}
 
   RuntimeValueType get_type() const override { return RT_INSTANCE; }
 
@@ -58,60 +118,118 @@ public:
     return "<instance : " + get_class_name(class_) + ">";
   }
 
-  void set(Token name, RuntimeValue *obj) {
-    fields.insert_or_assign(name.lexeme, obj);
+  void trace(Heap &heap) override;
+
+  size_t owned_bytes() const override {
+    return fields.capacity() * sizeof(Value);
   }
 
-  RuntimeValue *get(Token name) {
+  Value *find_field(const Symbol *name, PropertyCache &cache) {
+    const PropertyCacheEntry *hit = cache.find(shape);
+    if (hit != nullptr)
+      return &fields[hit->slot];
 
-    if (fields.count(name.lexeme) > 0)
-      return fields.at(name.lexeme);
+    int slot = shape->slot_of(name);
+    if (slot == -1)
+      return nullptr;
 
-    RuntimeFunction *method = find_class_method(class_, name.lexeme);
+    cache.add(shape, slot);
+    return &fields[slot];
+  }
+
+  // Fields shadow methods; a method is returned bound to this instance.
+  Value get(const Symbol *name, PropertyCache &cache) {
+    Value *field = find_field(name, cache);
+    if (field != nullptr)
+      return *field;
+
+    RuntimeCallable *method = find_class_method(class_, name);
     if (method != nullptr) {
-      return method->bind(this);
+      return Value::object(method->bind(this));
     }
 
-    throw "Undefined property " + name.lexeme;
+    throw "Undefined property " + name->name;
+  }
+
+  void set(const Symbol *name, Value value, PropertyCache &cache) {
+    const PropertyCacheEntry *hit = cache.find(shape);
+    if (hit != nullptr) {
+      if (hit->transition != nullptr) {
+        shape = hit->transition;
+        fields.push_back(value);
+        runtime_heap.grew(this);
+      } else {
+        fields[hit->slot] = value;
+      }
+      return;
+    }
+
+    int slot = shape->slot_of(name);
+    if (slot != -1) {
+      cache.add(shape, slot);
+      fields[slot] = value;
+      return;
+    }
+
+    Shape *next = shape->with_field(name);
+    cache.add(shape, fields.size(), next);
+    shape = next;
+    fields.push_back(value);
+    runtime_heap.grew(this);
   }
 
   RuntimeClass *class_;
-  std::unordered_map<std::string, RuntimeValue *> fields;
+  Shape *shape;
+  // Indexed by the slots recorded in `shape`.
+  std::vector<Value> fields;
 };
 
 class RuntimeClass : public RuntimeCallable {
 public:
-  RuntimeClass(std::string name,
-               std::unordered_map<std::string, RuntimeFunction *> methods)
+  RuntimeClass(std::string name, SymbolMap<RuntimeCallable *> methods)
       : name(name), methods(methods) {}
 
   std::string as_string() const override { return "<class: " + name + ">"; }
 
-  RuntimeValue *call(Evaluator *evaluator,
-                     std::vector<RuntimeValue *> arguments) override {
-    RuntimeClassInstance *instance = new RuntimeClassInstance(this);
+  RuntimeValueType get_type() const override { return RT_CLASS; };
 
-    RuntimeFunction *initializer = find_method("init");
-    if (initializer != nullptr) {
-      initializer->bind((RuntimeValue *)instance)->call(evaluator, arguments);
-    }
+  Value call(Evaluator *evaluator, std::vector<Value> &arguments) override {
+    RuntimeClassInstance *instance =
+        runtime_heap.allocate<RuntimeClassInstance>(this);
+    GcRootScope roots;
+    roots.add(instance);
 
-    return instance;
+    RuntimeCallable *initializer = find_initializer();
+    if (initializer != nullptr)
+      initializer->call_method(evaluator, Value::object(instance), arguments);
+
+    return Value::object(instance);
+  }
+
+  void trace(Heap &heap) override {
+    for (auto &method : methods)
+      heap.mark(method.second);
   }
 
-  RuntimeFunction *find_method(std::string name) const {
-    if (methods.count(name) > 0)
-      return methods.at(name);
+  RuntimeCallable *find_method(const Symbol *name) const {
+    auto method = methods.find(name);
+    if (method != methods.end())
+      return method->second;
     return nullptr;
   }
 
+  RuntimeCallable *find_initializer() const {
+    static const Symbol *init = intern("init");
+    return find_method(init);
+  }
+
   int arity() const override {
-    RuntimeFunction *init_method = find_method("init");
+    RuntimeCallable *init_method = find_initializer();
     if (init_method != nullptr)
       return init_method->arity();
     return 0;
   }
 
   std::string name;
-  std::unordered_map<std::string, RuntimeFunction *> methods;
+  SymbolMap<RuntimeCallable *> methods;
 };
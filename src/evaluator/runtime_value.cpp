@@ -1,50 +1,271 @@
 #include "runtime_value.h"
 
-bool RuntimeValue::is_callable() { return false; }
-bool RuntimeValue::is_truthy() {
-  if (is_nil())
-    return false;
-
+std::string Value::as_string() const {
+  if (is_number())
+    return std::to_string(as_number());
   if (is_bool())
-    return as_bool();
-
-  return true;
-}
-bool RuntimeValue::is_string() { return literal_value.type == STR; }
-bool RuntimeValue::is_number() { return literal_value.type == NUM; }
-bool RuntimeValue::is_bool() { return literal_value.type == BOOL; }
-bool RuntimeValue::is_nil() { return literal_value.type == NIL_; }
-
-RuntimeValueType RuntimeValue::get_type() const {
-  if (is_literal_value) {
-    switch (literal_value.type) {
-    case NUM:
-      return RT_NUMBER;
-    case BOOL:
-      return RT_BOOL;
-    case NIL_:
-      return RT_NIL;
-    case STR:
-      return RT_STRING;
+    return as_bool() ? "true" : "false";
+  if (is_object())
+    return as_object()->as_string();
+  return "nil";
+}
+
+void RuntimeString::flatten() const {
+  std::string flat;
+  flat.reserve(length);
+
+  // A string built up in a loop is a join thousands deep, so walk it without
+  // recursing, left to right.
+  std::vector<const RuntimeString *> pending = {this};
+  while (!pending.empty()) {
+    const RuntimeString *string = pending.back();
+    pending.pop_back();
+    if (string->left == nullptr) {
+      flat += string->chars();
+    } else {
+      pending.push_back(string->right);
+      pending.push_back(string->left);
     }
   }
 
-  throw "Unable to implicitly discern type of value.";
+  value = std::move(flat);
+  left = nullptr;
+  right = nullptr;
+
+  // Whoever is reading the characters may be holding values the collector
+  // cannot see, so the buffer is only charged here and the collection it may
+  // call for is left to the next allocation.
+  runtime_heap.grew(const_cast<RuntimeString *>(this), false);
+}
+
+// Joins and slices shorter than this are copied at once: they cost no more
+// to copy than an object sharing their characters would take.
+static const size_t MIN_SHARED_LENGTH = 32;
+
+Value make_string(std::string value) {
+  return Value::object(runtime_heap.allocate<RuntimeString>(std::move(value)));
+}
+
+class InternedStrings : public GcRootSource {
+public:
+  InternedStrings() { runtime_heap.add_root_source(this); }
+  ~InternedStrings() { runtime_heap.remove_root_source(this); }
+
+  void mark_roots(Heap &heap) override {
+    for (auto &string : strings)
+      heap.mark(string.second);
+  }
+
+  SymbolMap<Value> strings;
+};
+
+Value interned_string(const Symbol *symbol) {
+  static InternedStrings interned;
+
+  auto found = interned.strings.find(symbol);
+  if (found != interned.strings.end())
+    return found->second;
+
+  Value string = Value::object(
+      runtime_heap.allocate<RuntimeString>(symbol->name, symbol));
+  interned.strings.emplace(symbol, string);
+  return string;
+}
+
+Value character_string(unsigned char c) {
+  static Value characters[256];
+  if (characters[c].is_nil())
+    characters[c] = interned_string(intern(std::string_view((char *)&c, 1)));
+  return characters[c];
+}
+
+Value make_slice(Value string, size_t start, size_t length) {
+  RuntimeString *source = (RuntimeString *)string.as_object();
+  if (length == source->length)
+    return string;
+
+  std::string_view chars = source->chars();
+  if (length == 1)
+    return character_string(chars[start]);
+  if (length < MIN_SHARED_LENGTH)
+    return make_string(std::string(chars.substr(start, length)));
+
+  RuntimeString *base = source;
+  if (source->base != nullptr) {
+    base = source->base;
+    start += source->offset;
+  }
+  return Value::object(
+      runtime_heap.allocate<RuntimeString>(base, start, length));
+}
+
+Value literal_to_value(const Literal &literal) {
+  switch (literal.type) {
+  case NUM:
+    return Value::number(std::get<double>(literal.value));
+  case BOOL:
+    return Value::boolean(std::get<bool>(literal.value));
+  case STR:
+    return interned_string(intern(std::get<std::string_view>(literal.value)));
+  case NIL_:
+    return Value::nil();
+  }
+  return Value::nil();
+}
+
+enum ArrayMethod {
+  ARR_PUSH,
+  ARR_POP,
+  ARR_INSERT,
+  ARR_REMOVE,
+  ARR_LENGTH,
+  ARR_RESERVE,
+  ARR_SLICE,
+  ARR_CONCAT,
+};
+
+struct ArrayMethodInfo {
+  std::string_view name;
+  ArrayMethod method;
+  int arity;
+};
+
+static const ArrayMethodInfo ARRAY_METHODS[] = {
+    {"push", ARR_PUSH, 1},     {"pop", ARR_POP, 0},
+    {"insert", ARR_INSERT, 2}, {"remove", ARR_REMOVE, 1},
+    {"length", ARR_LENGTH, 0}, {"reserve", ARR_RESERVE, 1},
+    {"slice", ARR_SLICE, 2},   {"concat", ARR_CONCAT, 1},
+};
+
+static int index_argument(Value value, size_t limit) {
+  if (!value.is_number())
+    throw "Index key should be a number.";
+
+  double index = value.as_number();
+  if (index < 0 || index > limit)
+    throw "Index key not in range.";
+  return (int)index;
 }
 
-std::string RuntimeValue::as_string() const {
-  return literal_value.as_string();
+Value RuntimeArrayValue::call_method(std::string_view name, Value *args,
+                                     int argc) {
+  const ArrayMethodInfo *info = nullptr;
+  for (const ArrayMethodInfo &candidate : ARRAY_METHODS)
+    if (candidate.name == name)
+      info = &candidate;
+
+  if (info == nullptr)
+    throw "Undefined property " + std::string(name);
+  if (argc != info->arity)
+    throw "Received incorrect number of args.";
+
+  size_t size = array_values.size();
+
+  switch (info->method) {
+  case ARR_PUSH:
+    array_values.push_back(args[0]);
+    runtime_heap.grew(this);
+    return Value::number(array_values.size());
+
+  case ARR_POP: {
+    if (array_values.empty())
+      throw "Cannot pop from an empty array.";
+    Value popped = array_values.back();
+    array_values.pop_back();
+    return popped;
+  }
+
+  case ARR_INSERT: {
+    int index = index_argument(args[0], size);
+    array_values.insert(array_values.begin() + index, args[1]);
+    runtime_heap.grew(this);
+    return Value::nil();
+  }
+
+  case ARR_REMOVE: {
+    int index = index_argument(args[0], size);
+    if (index == size)
+      throw "Index key not in range.";
+    Value removed = array_values[index];
+    array_values.erase(array_values.begin() + index);
+    return removed;
+  }
+
+  case ARR_LENGTH:
+    return Value::number(size);
+
+  case ARR_RESERVE: {
+    if (!args[0].is_number() || args[0].as_number() < 0)
+      throw "Array capacity should be a non-negative number.";
+    array_values.reserve((size_t)args[0].as_number());
+    runtime_heap.grew(this);
+    return Value::nil();
+  }
+
+  case ARR_SLICE: {
+    int start = index_argument(args[0], size);
+    int end = index_argument(args[1], size);
+    if (end < start)
+      throw "Index key not in range.";
+    return Value::object(runtime_heap.allocate<RuntimeArrayValue>(
+        std::vector<Value>(array_values.begin() + start,
+                           array_values.begin() + end)));
+  }
+
+  case ARR_CONCAT: {
+    if (args[0].get_type() != RT_ARRAY)
+      throw "Can only concat an array with another array.";
+    const std::vector<Value> &other =
+        ((RuntimeArrayValue *)args[0].as_object())->array_values;
+
+    std::vector<Value> values;
+    values.reserve(size + other.size());
+    values.insert(values.end(), array_values.begin(), array_values.end());
+    values.insert(values.end(), other.begin(), other.end());
+    return Value::object(
+        runtime_heap.allocate<RuntimeArrayValue>(std::move(values)));
+  }
+  }
+
+  return Value::nil();
 }
 
-bool RuntimeValue::as_bool() const {
-  if (get_type() != RT_BOOL)
-    throw "Attempted to convert non-bool value into bool.";
-  return std::get<bool>(literal_value.value);
+Value concatenate(Value lhs, Value rhs) {
+  if (lhs.is_string() && rhs.is_string()) {
+    RuntimeString *left = (RuntimeString *)lhs.as_object();
+    RuntimeString *right = (RuntimeString *)rhs.as_object();
+    if (right->length == 0)
+      return lhs;
+    if (left->length == 0)
+      return rhs;
+    if (left->length + right->length < MIN_SHARED_LENGTH) {
+      std::string joined(left->chars());
+      joined += right->chars();
+      return make_string(std::move(joined));
+    }
+    return Value::object(runtime_heap.allocate<RuntimeString>(left, right));
+  }
+
+  throw "Cannot add different types.";
 }
 
-float RuntimeValue::as_number() const {
-  if (get_type() != RT_NUMBER)
-    throw 
-        "Attempted to convert non-numeric value into number.";
-  return std::get<float>(literal_value.value);
+bool equal_values(Value lhs, Value rhs) {
+  if (lhs.is_string() && rhs.is_string()) {
+    if (lhs.bits == rhs.bits)
+      return true;
+    if (((RuntimeString *)lhs.as_object())->symbol != nullptr &&
+        ((RuntimeString *)rhs.as_object())->symbol != nullptr)
+      return false;
+    if (string_length(lhs) != string_length(rhs))
+      return false;
+    return string_value(lhs) == string_value(rhs);
+  }
+
+  if (lhs.is_bool() && rhs.is_bool())
+    return lhs.as_bool() == rhs.as_bool();
+
+  if (lhs.is_nil() && rhs.is_nil())
+    return true;
+
+  throw "Cannot perform division on different types.";
 }
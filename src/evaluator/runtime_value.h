@@ -1,69 +1,226 @@
 #pragma once
 
+#include "../gc/heap.h"
 #include "../lexer.h"
+#include "../symbol.h"
+#include "value.h"
 
 class Environment;
 class Evaluator;
 
-enum RuntimeValueType {
-  RT_NUMBER,
-  RT_BOOL,
-  RT_STRING,
-  RT_NIL,
-  RT_FUNCTION,
-  RT_CALLABLE,
-  RT_ARRAY,
-  RT_INSTANCE
+// Base class of everything a Value can point to on the heap. Instances must be
+// created through runtime_heap.allocate so the collector can see them.
+class RuntimeObject : public HeapObject {
+public:
+  virtual RuntimeValueType get_type() const = 0;
+  virtual std::string as_string() const = 0;
+  virtual bool is_callable() const { return false; }
 };
 
-class RuntimeValue {
+// A string is either its characters, the two strings it joins when built by
+// concatenation, or a slice of the characters of another string. A join is
+// copied out into a flat string the first time its characters are needed, so
+// building a string piece by piece copies each piece once rather than on
+// every concatenation. A slice shares its base's characters, and keeps the
+// whole base alive for as long as the slice is.
+class RuntimeString : public RuntimeObject {
 public:
-  RuntimeValue() : literal_value(), is_literal_value(true){};
-  RuntimeValue(Literal value) : literal_value(value), is_literal_value(true) {}
-  RuntimeValue(std::string value) {
-    literal_value = Literal();
-    literal_value.value = value;
-    literal_value.type = STR;
+  RuntimeString(std::string value, const Symbol *symbol = nullptr)
+      : length(value.size()), symbol(symbol), value(std::move(value)) {}
+  RuntimeString(RuntimeString *left, RuntimeString *right)
+      : length(left->length + right->length), left(left), right(right) {}
+  // `base` has to be flat.
+  RuntimeString(RuntimeString *base, size_t offset, size_t length)
+      : length(length), base(base), offset(offset) {}
+
+  RuntimeValueType get_type() const override { return RT_STRING; }
+  std::string as_string() const override { return std::string(chars()); }
+  size_t owned_bytes() const override { return value.capacity(); }
+
+  void trace(Heap &heap) override {
+    heap.mark(left);
+    heap.mark(right);
+    heap.mark(base);
   }
 
-  virtual bool is_callable();
-  bool is_string();
-  bool is_number();
-  bool is_bool();
-  bool is_nil();
+  std::string_view chars() const {
+    if (left != nullptr)
+      flatten();
+    if (base != nullptr)
+      return std::string_view(base->value).substr(offset, length);
+    return value;
+  }
 
-  virtual RuntimeValueType get_type() const;
+  size_t length;
+  // Set only on the single string interned for a symbol, so two interned
+  // strings are equal exactly when they are the same object.
+  const Symbol *symbol = nullptr;
 
-  float as_number() const;
-  virtual std::string as_string() const;
-  bool as_bool() const;
+private:
+  void flatten() const;
 
-  bool is_truthy();
+  mutable std::string value;
+  // Both set until the join is flattened, which lets them be collected.
+  mutable RuntimeString *left = nullptr;
+  mutable RuntimeString *right = nullptr;
+  RuntimeString *base = nullptr;
+  size_t offset = 0;
 
-  Literal literal_value;
-  bool is_literal_value;
+  friend Value make_slice(Value string, size_t start, size_t length);
 };
 
-class RuntimeArrayValue : public RuntimeValue {
+inline RuntimeValueType Value::get_type() const {
+  if (is_number())
+    return RT_NUMBER;
+  if (is_bool())
+    return RT_BOOL;
+  if (is_object())
+    return as_object()->get_type();
+  return RT_NIL;
+}
+
+inline bool Value::is_string() const {
+  return is_object() && as_object()->get_type() == RT_STRING;
+}
+
+inline bool Value::is_callable() const {
+  return is_object() && as_object()->is_callable();
+}
+
+// Borrows the characters of a string value, flattening it if it is a join.
+inline std::string_view string_value(Value value) {
+  return ((RuntimeString *)value.as_object())->chars();
+}
+
+inline size_t string_length(Value value) {
+  return ((RuntimeString *)value.as_object())->length;
+}
+
+Value make_string(std::string value);
+// The string interned for `symbol`, such as a string literal or a name in a
+// chunk's constants. It is created on first use and never collected.
+Value interned_string(const Symbol *symbol);
+// The one-character string for `c`, which is always interned.
+Value character_string(unsigned char c);
+// The `length` characters of a string value from `start`, which have to be
+// in range. Longer slices share the characters of `string`.
+Value make_slice(Value string, size_t start, size_t length);
+Value literal_to_value(const Literal &literal);
+
+// The operators handle numbers inline: two small integers stay integers
+// unless the result overflows, and any other pair of numbers is worked on as
+// doubles. Strings and type errors are dealt with out of line.
+Value concatenate(Value lhs, Value rhs);
+bool equal_values(Value lhs, Value rhs);
+
+inline Value operator+(Value lhs, Value rhs) {
+  int32_t result;
+  if (lhs.is_int() && rhs.is_int() &&
+      !__builtin_add_overflow(lhs.as_int(), rhs.as_int(), &result))
+    return Value::integer(result);
+  if (lhs.is_number() && rhs.is_number())
+    return Value::number(lhs.as_number() + rhs.as_number());
+  return concatenate(lhs, rhs);
+}
+
+inline Value operator-(Value lhs, Value rhs) {
+  int32_t result;
+  if (lhs.is_int() && rhs.is_int() &&
+      !__builtin_sub_overflow(lhs.as_int(), rhs.as_int(), &result))
+    return Value::integer(result);
+  if (lhs.is_number() && rhs.is_number())
+    return Value::number(lhs.as_number() - rhs.as_number());
+  throw "Cannot add different types.";
+}
+
+inline Value operator*(Value lhs, Value rhs) {
+  int32_t result;
+  // A zero product with a negative factor is -0, which only a double holds.
+  if (lhs.is_int() && rhs.is_int() &&
+      !__builtin_mul_overflow(lhs.as_int(), rhs.as_int(), &result) &&
+      (result != 0 || (lhs.as_int() | rhs.as_int()) >= 0))
+    return Value::integer(result);
+  if (lhs.is_number() && rhs.is_number())
+    return Value::number(lhs.as_number() * rhs.as_number());
+  throw "Cannot perform substraction on different types.";
+}
+
+inline Value operator/(Value lhs, Value rhs) {
+  if (lhs.is_number() && rhs.is_number())
+    return Value::number(lhs.as_number() / rhs.as_number());
+  throw "Cannot perform division on different types.";
+}
+
+inline bool operator==(Value lhs, Value rhs) {
+  if (lhs.is_int() && rhs.is_int())
+    return lhs.bits == rhs.bits;
+  if (lhs.is_number() && rhs.is_number())
+    return lhs.as_number() == rhs.as_number();
+  return equal_values(lhs, rhs);
+}
+
+inline bool operator!=(Value lhs, Value rhs) { return !(lhs == rhs); }
+
+#define ORCA_COMPARISON(op)                                                    \
+  inline bool operator op(Value lhs, Value rhs) {                              \
+    if (lhs.is_int() && rhs.is_int())                                          \
+      return lhs.as_int() op rhs.as_int();                                     \
+    if (lhs.is_number() && rhs.is_number())                                    \
+      return lhs.as_number() op rhs.as_number();                               \
+    throw "Cannot perform division on different types.";                      \
+  }
+ORCA_COMPARISON(<)
+ORCA_COMPARISON(>)
+ORCA_COMPARISON(<=)
+ORCA_COMPARISON(>=)
+#undef ORCA_COMPARISON
+
+// The element of a sequence of `size` that the number `index` refers to, or
+// -1 if there is none. A fractional index is truncated towards zero.
+inline int64_t element_index(Value index, size_t size) {
+  if (index.is_int()) {
+    int32_t integer = index.as_int();
+    return integer >= 0 && (size_t)integer < size ? integer : -1;
+  }
+  double truncated = std::trunc(index.as_number());
+  return truncated >= 0 && truncated < size ? (int64_t)truncated : -1;
+}
+
+class RuntimeArrayValue : public RuntimeObject {
 public:
-  RuntimeArrayValue(std::vector<RuntimeValue *> values)
-      : array_values(values){};
+  RuntimeArrayValue(std::vector<Value> values)
+      : array_values(std::move(values)){};
 
-  std::vector<RuntimeValue *> array_values;
+  std::vector<Value> array_values;
 
-  void set(int index, RuntimeValue *updated_value) {
+  void set(int index, Value updated_value) {
     if (index < 0 || index >= array_values.size())
       throw "Index key out of bounds.";
 
     array_values[index] = updated_value;
   }
 
-  RuntimeValue *get(int index) {
+  Value get(int index) {
     if (index < 0 || index >= array_values.size())
       throw "Index key out of bounds.";
 
     return array_values[index];
   }
 
+  // Built-in methods (push, pop, insert, remove, length, reserve, slice,
+  // concat), called as `array.name(args)` with the arguments in `args`.
+  // Throws for unknown names, so a non-method is an undefined property.
+  Value call_method(std::string_view name, Value *args, int argc);
+
   RuntimeValueType get_type() const override { return RT_ARRAY; }
+  std::string as_string() const override { return "<array>"; }
+
+  void trace(Heap &heap) override {
+    for (Value value : array_values)
+      heap.mark(value);
+  }
+
+  size_t owned_bytes() const override {
+    return array_values.capacity() * sizeof(Value);
+  }
 };
@@ -0,0 +1,24 @@
+#include "shape.h"
+
+Shape::~Shape() {
+  for (auto &transition : transitions)
+    delete transition.second;
+}
+
+Shape *Shape::empty() {
+  static Shape root;
+  return &root;
+}
+
+Shape *Shape::with_field(const Symbol *name) {
+  auto found = transitions.find(name);
+  if (found != transitions.end())
+    return found->second;
+
+  Shape *child = new Shape();
+  child->slots = slots;
+  child->slots.insert_or_assign(name, field_count);
+  child->field_count = field_count + 1;
+  transitions.insert_or_assign(name, child);
+  return child;
+}
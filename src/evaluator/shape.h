@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../symbol.h"
+
+// Describes the field layout shared by every instance that had the same
+// fields added in the same order. Adding a field moves an instance along a
+// transition to a child shape, so instances built by the same initializer end
+// up sharing one shape and can be accessed through a cached slot index.
+//
+// Property names only ever come from identifiers in the source, so the tree
+// stays small; shapes live until the program exits. Names are symbols, so a
+// lookup hashes and compares pointers rather than strings.
+class Shape {
+public:
+  Shape() : field_count(0) {}
+  Shape(const Shape &) = delete;
+  ~Shape();
+
+  static Shape *empty();
+
+  // Returns the slot holding `name`, or -1 if instances of this shape do not
+  // have that field.
+  int slot_of(const Symbol *name) const {
+    auto slot = slots.find(name);
+    return slot == slots.end() ? -1 : slot->second;
+  }
+
+  // The shape reached by appending `name` as a new field.
+  Shape *with_field(const Symbol *name);
+
+  int field_count;
+
+private:
+  SymbolMap<int> slots;
+  SymbolMap<Shape *> transitions;
+};
+
+// A miss on one cached shape adds another entry, up to a handful; after that
+// the site is megamorphic and stops caching.
+struct PropertyCacheEntry {
+  Shape *shape;
+  int slot;
+  // For stores that add a field: the shape the instance moves to.
+  Shape *transition;
+};
+
+class PropertyCache {
+public:
+  static constexpr int MAX_ENTRIES = 4;
+
+  PropertyCache() : count(0) {}
+
+  const PropertyCacheEntry *find(Shape *shape) const {
+    for (int i = 0; i < count; ++i)
+      if (entries[i].shape == shape)
+        return &entries[i];
+    return nullptr;
+  }
+
+  void add(Shape *shape, int slot, Shape *transition = nullptr) {
+    if (count < MAX_ENTRIES)
+      entries[count++] = PropertyCacheEntry{shape, slot, transition};
+  }
+
+  PropertyCacheEntry entries[MAX_ENTRIES];
+  int count;
+};
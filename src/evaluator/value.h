@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+class RuntimeObject;
+
+enum RuntimeValueType {
+  RT_NUMBER,
+  RT_BOOL,
+  RT_STRING,
+  RT_NIL,
+  RT_FUNCTION,
+  RT_CALLABLE,
+  RT_ARRAY,
+  RT_INSTANCE,
+  RT_CLASS,
+  RT_BYTECODE_FUNCTION,
+  RT_CLOSURE,
+  RT_UPVALUE,
+  RT_BOUND_METHOD,
+  RT_NATIVE
+};
+
+// An 8-byte NaN-boxed value. Numbers are stored as plain doubles; everything
+// else lives in the payload of a quiet NaN. Heap objects set the sign bit and
+// keep their 48-bit pointer in the low bits, while nil, booleans and the
+// internal "undefined" marker use small tags.
+//
+// Numbers are doubles at the language level, but one whose value fits in an
+// int32 (other than -0) is always boxed as that integer, with INT_TAG above
+// it. Each number thus has a single encoding, and counters and indices can be
+// used without converting them from floating point.
+class Value {
+public:
+  Value() : bits(QNAN | TAG_NIL) {}
+
+  static Value nil() { return Value(QNAN | TAG_NIL); }
+  static Value undefined() { return Value(QNAN | TAG_UNDEFINED); }
+  static Value boolean(bool b) { return Value(QNAN | (b ? TAG_TRUE : TAG_FALSE)); }
+
+  static Value number(double number) {
+    if (number >= INT32_MIN && number <= INT32_MAX) {
+      int32_t truncated = (int32_t)number;
+      if (truncated == number && (truncated != 0 || !std::signbit(number)))
+        return integer(truncated);
+    }
+    if (number != number)
+      return Value(CANONICAL_NAN);
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(double));
+    return Value(bits);
+  }
+
+  static Value integer(int32_t value) {
+    return Value(INT_TAG | (uint32_t)value);
+  }
+
+  static Value object(RuntimeObject *object) {
+    return Value(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)object);
+  }
+
+  bool is_int() const { return (bits >> 32) == (INT_TAG >> 32); }
+  bool is_number() const { return (bits & QNAN) != QNAN || is_int(); }
+  bool is_nil() const { return bits == (QNAN | TAG_NIL); }
+  bool is_bool() const { return (bits | 1) == (QNAN | TAG_TRUE); }
+  bool is_undefined() const { return bits == (QNAN | TAG_UNDEFINED); }
+  bool is_object() const { return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT); }
+
+  bool is_string() const;
+  bool is_callable() const;
+
+  double as_number() const {
+    if (is_int())
+      return as_int();
+    double number;
+    memcpy(&number, &bits, sizeof(double));
+    return number;
+  }
+
+  int32_t as_int() const { return (int32_t)(uint32_t)bits; }
+
+  bool as_bool() const { return bits == (QNAN | TAG_TRUE); }
+
+  RuntimeObject *as_object() const {
+    return (RuntimeObject *)(uintptr_t)(bits & ~(SIGN_BIT | QNAN));
+  }
+
+  bool is_truthy() const {
+    if (is_bool())
+      return as_bool();
+    return !is_nil();
+  }
+
+  bool is_same(Value other) const { return bits == other.bits; }
+
+  RuntimeValueType get_type() const;
+  std::string as_string() const;
+
+  uint64_t bits;
+
+private:
+  explicit Value(uint64_t bits) : bits(bits) {}
+
+  static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+  static constexpr uint64_t QNAN = 0x7ffc000000000000;
+  static constexpr uint64_t CANONICAL_NAN = 0x7ff8000000000000;
+  static constexpr uint64_t INT_TAG = QNAN | 0x0001000000000000;
+
+  static constexpr uint64_t TAG_NIL = 1;
+  static constexpr uint64_t TAG_FALSE = 2;
+  static constexpr uint64_t TAG_TRUE = 3;
+  static constexpr uint64_t TAG_UNDEFINED = 4;
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay a single machine word.");
@@ -0,0 +1,166 @@
+#include "heap.h"
+#include "../evaluator/runtime_value.h"
+#include "../profiler.h"
+#include <algorithm>
+#include <chrono>
+
+Heap runtime_heap;
+
+Heap::~Heap() {
+  while (objects != nullptr) {
+    HeapObject *next = objects->next_object;
+    delete objects;
+    objects = next;
+  }
+}
+
+void Heap::track(HeapObject *object, size_t size) {
+  object->size = size;
+  object->next_object = objects;
+  objects = object;
+
+  size_t bytes = size + object->owned_bytes();
+  object->accounted_bytes = bytes;
+  bytes_allocated += bytes;
+  stats.objects_allocated += 1;
+  stats.bytes_allocated += bytes;
+  stats.peak_bytes = std::max(stats.peak_bytes, bytes_allocated);
+  if (allocation_profiler != nullptr)
+    allocation_profiler->record(bytes);
+
+  if (stress || bytes_allocated > next_gc) {
+    // The new object is not reachable from anything yet.
+    temp_roots.push_back(object);
+    collect();
+    temp_roots.pop_back();
+  }
+}
+
+// Charges any growth in the object's owned storage since it was last
+// measured, and returns its current footprint.
+size_t Heap::settle(HeapObject *object) {
+  size_t bytes = object->size + object->owned_bytes();
+  if (bytes > object->accounted_bytes)
+    stats.bytes_allocated += bytes - object->accounted_bytes;
+  object->accounted_bytes = bytes;
+  return bytes;
+}
+
+void Heap::grew(HeapObject *object, bool may_collect) {
+  size_t before = object->accounted_bytes;
+  size_t after = settle(object);
+  if (after <= before)
+    return;
+
+  bytes_allocated += after - before;
+  stats.peak_bytes = std::max(stats.peak_bytes, bytes_allocated);
+
+  if (may_collect && (stress || bytes_allocated > next_gc)) {
+    temp_roots.push_back(object);
+    collect();
+    temp_roots.pop_back();
+  }
+}
+
+void Heap::mark(Value value) {
+  if (value.is_object())
+    mark(value.as_object());
+}
+
+void Heap::mark(HeapObject *object) {
+  if (object == nullptr || object->marked)
+    return;
+
+  object->marked = true;
+  gray.push_back(object);
+}
+
+void Heap::collect() {
+  auto started = std::chrono::steady_clock::now();
+
+  for (GcRootSource *source : root_sources)
+    source->mark_roots(*this);
+  for (HeapObject *object : temp_roots)
+    mark(object);
+
+  trace_references();
+  sweep();
+
+  next_gc = std::max((size_t)(bytes_allocated * growth_factor), min_heap_bytes);
+
+  uint64_t pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+  stats.collections += 1;
+  stats.total_pause_ns += pause;
+  stats.max_pause_ns = std::max(stats.max_pause_ns, pause);
+}
+
+void Heap::trace_references() {
+  while (!gray.empty()) {
+    HeapObject *object = gray.back();
+    gray.pop_back();
+    object->trace(*this);
+  }
+}
+
+void Heap::sweep() {
+  size_t live_bytes = 0;
+  HeapObject **link = &objects;
+
+  while (*link != nullptr) {
+    HeapObject *object = *link;
+    size_t bytes = settle(object);
+
+    if (object->marked) {
+      object->marked = false;
+      live_bytes += bytes;
+      link = &object->next_object;
+      continue;
+    }
+
+    *link = object->next_object;
+    stats.objects_freed += 1;
+    stats.bytes_freed += bytes;
+    delete object;
+  }
+
+  bytes_allocated = live_bytes;
+  stats.peak_bytes = std::max(stats.peak_bytes, live_bytes);
+}
+
+void Heap::configure(double growth_factor, size_t min_heap_bytes,
+                     bool stress) {
+  this->growth_factor = std::max(growth_factor, 1.0);
+  this->min_heap_bytes = min_heap_bytes;
+  this->next_gc = std::max(bytes_allocated, min_heap_bytes);
+  this->stress = stress;
+}
+
+void Heap::print_stats(FILE *out) const {
+  fprintf(out, "-- gc stats --\n");
+  fprintf(out, "collections:       %zu\n", stats.collections);
+  fprintf(out, "objects allocated: %zu\n", stats.objects_allocated);
+  fprintf(out, "bytes allocated:   %zu\n", stats.bytes_allocated);
+  fprintf(out, "objects freed:     %zu\n", stats.objects_freed);
+  fprintf(out, "bytes freed:       %zu\n", stats.bytes_freed);
+  fprintf(out, "live bytes:        %zu\n", bytes_allocated);
+  fprintf(out, "peak bytes:        %zu\n", stats.peak_bytes);
+  fprintf(out, "total pause:       %.3f ms\n", stats.total_pause_ns / 1e6);
+  fprintf(out, "max pause:         %.3f ms\n", stats.max_pause_ns / 1e6);
+}
+
+void Heap::add_root_source(GcRootSource *source) {
+  root_sources.push_back(source);
+}
+
+void Heap::remove_root_source(GcRootSource *source) {
+  root_sources.erase(
+      std::remove(root_sources.begin(), root_sources.end(), source),
+      root_sources.end());
+}
+
+void GcRootScope::add(Value value) {
+  if (value.is_object())
+    add(value.as_object());
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "../evaluator/value.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+class AllocationProfiler;
+class Heap;
+
+// Header shared by every garbage-collected allocation. Objects are threaded
+// onto the heap's intrusive list when allocated and unlinked when swept.
+class HeapObject {
+public:
+  virtual ~HeapObject() = default;
+
+  // Marks every object directly reachable from this one.
+  virtual void trace(Heap &heap) {}
+  // Bytes owned outside the object itself (vector storage, map nodes...).
+  virtual size_t owned_bytes() const { return 0; }
+
+  HeapObject *next_object = nullptr;
+  uint32_t size = 0;
+  // Bytes last charged to the heap for this object; owned storage may have
+  // grown since then.
+  uint32_t accounted_bytes = 0;
+  bool marked = false;
+};
+
+// Anything that holds references the collector cannot discover by tracing
+// from other objects: the evaluator's environments, the VM stack, a compiler
+// midway through building functions.
+class GcRootSource {
+public:
+  virtual ~GcRootSource() = default;
+  virtual void mark_roots(Heap &heap) = 0;
+};
+
+struct GcStats {
+  size_t collections = 0;
+  size_t objects_allocated = 0;
+  size_t bytes_allocated = 0;
+  size_t objects_freed = 0;
+  size_t bytes_freed = 0;
+  size_t peak_bytes = 0;
+  uint64_t total_pause_ns = 0;
+  uint64_t max_pause_ns = 0;
+};
+
+// A precise mark-and-sweep collector. A collection runs whenever the live
+// byte count crosses `next_gc`, after which the threshold is reset to the
+// surviving size times `growth_factor` (but never below `min_heap_bytes`).
+class Heap {
+public:
+  ~Heap();
+
+  template <typename T, typename... Args> T *allocate(Args &&...args) {
+    T *object = new T(std::forward<Args>(args)...);
+    track(object, sizeof(T));
+    return object;
+  }
+
+  void mark(Value value);
+  void mark(HeapObject *object);
+
+  // Charges growth in `object`'s owned storage as it happens instead of at
+  // the next sweep, so that filling a container counts towards the next
+  // collection like allocating does. Collects, keeping `object` alive, if
+  // that takes the heap past its threshold and `may_collect` is set; callers
+  // that may hold unrooted values leave it to the next allocation.
+  void grew(HeapObject *object, bool may_collect = true);
+
+  void collect();
+  void configure(double growth_factor, size_t min_heap_bytes, bool stress);
+  void print_stats(FILE *out) const;
+
+  void add_root_source(GcRootSource *source);
+  void remove_root_source(GcRootSource *source);
+
+  std::vector<HeapObject *> temp_roots;
+  GcStats stats;
+  // Told of every allocation while set.
+  AllocationProfiler *allocation_profiler = nullptr;
+
+private:
+  void track(HeapObject *object, size_t size);
+  size_t settle(HeapObject *object);
+  void trace_references();
+  void sweep();
+
+  HeapObject *objects = nullptr;
+  std::vector<HeapObject *> gray;
+  std::vector<GcRootSource *> root_sources;
+
+  size_t bytes_allocated = 0;
+  size_t next_gc = 1024 * 1024;
+  size_t min_heap_bytes = 1024 * 1024;
+  double growth_factor = 2.0;
+  bool stress = false;
+};
+
+extern Heap runtime_heap;
+
+// Keeps values held only in C++ locals alive across allocations. Everything
+// added is released when the scope ends, including during unwinding.
+class GcRootScope {
+public:
+  GcRootScope() : depth(runtime_heap.temp_roots.size()) {}
+  ~GcRootScope() { runtime_heap.temp_roots.resize(depth); }
+
+  void add(HeapObject *object) { runtime_heap.temp_roots.push_back(object); }
+  void add(Value value);
+
+private:
+  size_t depth;
+};
@@ -3,23 +3,111 @@
 #include "evaluator/evaluator.h"
 #include "lexer.h"
 #include "parser/ast_printer.h"
+#include "parser/flat_ast.h"
+#include "parser/optimizer.h"
 #include "parser/parser.h"
+#include "parser/program.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "source_file.h"
 #include "variable/resolver.h"
-#include <fstream>
+#include "vm/compiler.h"
+#include "vm/vm.h"
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <vector>
 
 void Interpreter::run_file(std::string filepath) {
-  std::ifstream file(filepath);
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  std::string source = buffer.str();
+  SourceFile file(filepath);
+  run(file.text());
+}
+
+// Runs `body` under whichever profilers were asked for: sampling `stacks`
+// and counting allocations by `sites`, whose positions `lines` maps to
+// lines. Their reports go to stderr, and the folded stacks to their file.
+template <typename F>
+static void run_profiled(const InterpreterOptions &options,
+                         ProfileSource *stacks, AllocationSiteSource *sites,
+                         const LineMap &lines, F body) {
+  std::unique_ptr<Profiler> profiler;
+  if (!options.profile_path.empty()) {
+    profiler = std::make_unique<Profiler>(stacks);
+    profiler->start(options.profile_frequency);
+  }
+
+  std::unique_ptr<AllocationProfiler> allocations;
+  if (options.alloc_profile) {
+    allocations = std::make_unique<AllocationProfiler>(sites);
+    allocations->lines = lines;
+    if (options.alloc_report_seconds > 0)
+      allocations->report_every(options.alloc_report_seconds,
+                                options.profile_top);
+    runtime_heap.allocation_profiler = allocations.get();
+  }
+
+  try {
+    body();
+  } catch (...) {
+    runtime_heap.allocation_profiler = nullptr;
+    throw;
+  }
+  runtime_heap.allocation_profiler = nullptr;
+
+  if (profiler) {
+    profiler->stop();
+    FILE *out = fopen(options.profile_path.c_str(), "w");
+    if (out == nullptr)
+      throw "Could not open '" + options.profile_path + "' for writing.";
+    profiler->write_folded(out);
+    fclose(out);
+    profiler->print_report(stderr, options.profile_top);
+  }
+  if (allocations)
+    allocations->print_report(stderr, options.profile_top);
+}
+
+// Runs a resolved flat tree on `evaluator`, which holds its globals.
+static void run_flat(const InterpreterOptions &options, FlatAst &ast,
+                     Evaluator &evaluator) {
+  // The flat engine reports source offsets rather than lines.
+  LineMap lines;
+  if (!options.profile_path.empty() || options.alloc_profile)
+    lines = LineMap(ast.source);
+
+  std::unique_ptr<ShadowStack> profile_stack;
+  if (!options.profile_path.empty()) {
+    profile_stack = std::make_unique<ShadowStack>(&evaluator.line);
+    profile_stack->lines = lines;
+    evaluator.profile_stack = profile_stack.get();
+  }
 
-  run(source);
+  run_profiled(options, profile_stack.get(), &evaluator, lines,
+               [&] { evaluator.execute(ast); });
+
+  if (options.gc_stats)
+    runtime_heap.print_stats(stderr);
 }
 
-void Interpreter::run(std::string source) {
+void Interpreter::run(std::string_view source) {
+  runtime_heap.configure(options.gc_growth_factor, options.gc_min_heap_bytes,
+                         options.gc_stress);
+
+  Evaluator evaluator;
+
+  // Only a flat tree can be cached, and a cached one has no syntax tree left
+  // to print.
+  std::unique_ptr<ProgramCache> cache;
+  if (!options.cache_directory.empty() && options.engine == ENGINE_FLAT &&
+      !options.dump_ast) {
+    cache = std::make_unique<ProgramCache>(options.cache_directory,
+                                           options.optimize);
+    FlatAst ast(source);
+    if (cache->load(ast, evaluator.globals)) {
+      run_flat(options, ast, evaluator);
+      return;
+    }
+  }
+
   Lexer lexer = Lexer(source);
   std::vector<Token> tokens = lexer.scan_tokens();
 
@@ -28,21 +116,65 @@ void Interpreter::run(std::string source) {
   //   t.lexeme.c_str());
   // }
 
-  Parser parser = Parser(tokens);
-  std::vector<Expression *> exprs = parser.parse();
+  // The syntax tree is freed in one go when the program is released.
+  std::unique_ptr<Program> program = std::make_unique<Program>();
+  program->statements = Parser(std::move(tokens), program->arena).parse();
+
+  Resolver resolver(&evaluator);
 
-  // AstPrinter printer = AstPrinter();
-  Evaluator *evaluator = new Evaluator();
-  Resolver *resolver = new Resolver(evaluator);
+  // The optimizer works from resolved variable slots. The flat engine
+  // resolves its own copy of the tree again once it has been built.
+  if (options.optimize || options.engine != ENGINE_FLAT)
+    resolver.resolve(program->statements);
+  if (options.optimize)
+    Optimizer(*program).optimize();
 
-  for (Expression *expr : exprs) {
-    // printer.print(expr);
-    resolver->resolve_expr(expr);
+  if (options.dump_ast) {
+    AstPrinter printer;
+    for (Expression *expr : program->statements)
+      printer.print(expr);
   }
 
-  // printf("----------------------------------\n");
+  if (options.engine == ENGINE_FLAT) {
+    // Only the flat tree is kept once it has been built.
+    FlatAst ast = flatten(*program, source);
+    program.reset();
+
+    resolver.resolve(ast);
+    if (cache)
+      cache->save(ast, evaluator.globals);
 
-  for (Expression *expr : exprs) {
-    evaluator->evaluate(expr);
+    run_flat(options, ast, evaluator);
+    return;
   }
+
+  if (options.engine == ENGINE_VM) {
+    VM vm = VM();
+    if (options.jit)
+      vm.enable_jit(options.jit_threshold);
+    Compiler compiler = Compiler(&vm.globals);
+    RuntimeBytecodeFunction *script = compiler.compile(program->statements);
+
+    if (options.dump_bytecode)
+      disassemble_chunk(script->chunk, script->name);
+
+    run_profiled(options, &vm, &vm, LineMap(), [&] { vm.interpret(script); });
+    if (options.jit_stats && vm.jit != nullptr)
+      vm.jit->print_stats(stderr);
+  } else {
+    std::unique_ptr<ShadowStack> profile_stack;
+    if (!options.profile_path.empty()) {
+      profile_stack = std::make_unique<ShadowStack>(&evaluator.line);
+      evaluator.profile_stack = profile_stack.get();
+    }
+
+    run_profiled(options, profile_stack.get(), &evaluator, LineMap(), [&] {
+      for (Expression *expr : program->statements) {
+        evaluator.evaluate(expr);
+      }
+    });
+  }
+
+  if (options.gc_stats)
+    runtime_heap.print_stats(stderr);
 }
@@ -1,11 +1,51 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+
+// ENGINE_FLAT is the tree-walking evaluator running over a FlatAst.
+enum Engine { ENGINE_TREE, ENGINE_FLAT, ENGINE_VM };
+
+struct InterpreterOptions {
+  Engine engine = ENGINE_TREE;
+  bool optimize = true;
+  bool dump_ast = false;
+  bool dump_bytecode = false;
+  // Compile hot functions to machine code under --engine=vm, once they have
+  // been called or have looped `jit_threshold` times.
+  bool jit = true;
+  uint32_t jit_threshold = 1000;
+  bool jit_stats = false;
+  // Where resolved flat programs are cached between runs; empty if they
+  // are not.
+  std::string cache_directory;
+
+  // Where to write folded stacks; empty if not profiling.
+  std::string profile_path;
+  int profile_frequency = 1000;
+  // Rows in the sampling and allocation reports.
+  int profile_top = 10;
+  // Count allocations by source line and node kind.
+  bool alloc_profile = false;
+  // If positive, also report allocations this often while running.
+  double alloc_report_seconds = 0;
+
+  bool gc_stats = false;
+  bool gc_stress = false;
+  double gc_growth_factor = 2.0;
+  size_t gc_min_heap_bytes = 1024 * 1024;
+};
 
 class Interpreter {
 public:
   Interpreter() {}
+  Interpreter(InterpreterOptions options) : options(options) {}
 
   void run_file(std::string filepath);
-  void run(std::string source);
+  // Tokens and the AST point into `source`, which must outlive the run.
+  void run(std::string_view source);
+
+  InterpreterOptions options;
 };
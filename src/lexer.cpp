@@ -1,48 +1,97 @@
 #include "lexer.h"
+#include "utils.h"
+#include <array>
+#include <charconv>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <variant>
 #include <vector>
 
+struct Keyword {
+  std::string_view text;
+  TokenType type = IDENTIFIER;
+};
+
+static constexpr Keyword KEYWORDS[] = {
+    {"and", AND},       {"class", CLASS}, {"else", ELSE},
+    {"false", FALSE},   {"for", FOR},     {"fun", FUN},
+    {"if", IF},         {"nil", NIL},     {"or", OR},
+    {"print", PRINT},   {"return", RETURN}, {"super", SUPER},
+    {"this", THIS},     {"true", TRUE},   {"var", VAR},
+    {"while", WHILE},
+};
+
+constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+// Collision-free over KEYWORDS, which the static_assert below checks, so a
+// lookup is one hash and one comparison.
+static constexpr size_t keyword_hash(std::string_view text) {
+  return ((unsigned char)text.front() + 5 * (unsigned char)text.back() +
+          text.size()) %
+         KEYWORD_TABLE_SIZE;
+}
+
+static constexpr std::array<Keyword, KEYWORD_TABLE_SIZE>
+build_keyword_table() {
+  std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
+  for (const Keyword &keyword : KEYWORDS)
+    table[keyword_hash(keyword.text)] = keyword;
+  return table;
+}
+
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> KEYWORD_TABLE =
+    build_keyword_table();
+
+static constexpr bool keyword_hash_is_perfect() {
+  for (const Keyword &keyword : KEYWORDS)
+    if (KEYWORD_TABLE[keyword_hash(keyword.text)].text != keyword.text)
+      return false;
+  return true;
+}
+
+static_assert(keyword_hash_is_perfect(), "Keywords collide in keyword_hash.");
+
+static TokenType keyword_or_identifier(std::string_view text) {
+  const Keyword &candidate = KEYWORD_TABLE[keyword_hash(text)];
+  return candidate.text == text ? candidate.type : IDENTIFIER;
+}
+
 char Lexer::advance() {
   ++this->current;
   return this->source[this->current - 1];
 }
 
 std::vector<Token> Lexer::scan_tokens() {
+  // Typical code has a token every three or four bytes.
+  tokens.reserve(source.size() / 4);
   while (!is_at_end()) {
     start = current;
     scan_token();
   }
-  tokens.push_back(Token(E_O_F, "", Literal{}, 0));
-  return tokens;
+  tokens.push_back(Token(E_O_F, "", 0));
+  return std::move(tokens);
 }
 
 void Lexer::scan_number() {
-  while (isdigit(get_curr_char()))
+  while (is_digit(get_curr_char()))
     advance();
 
-  if (get_curr_char() == '.' && isdigit(get_next_char())) {
+  if (get_curr_char() == '.' && is_digit(get_next_char())) {
     do {
       advance();
-    } while (isdigit(get_curr_char()));
+    } while (is_digit(get_curr_char()));
   }
 
-  std::string text = source.substr(start, current - start);
-  Literal value = Literal(std::stof(text));
-  add_token(NUMBER, text, value);
+  add_token(NUMBER);
 }
 
 void Lexer::scan_identifier() {
-  while (isalnum(get_curr_char())) {
+  while (is_alphanumeric(get_curr_char())) {
     advance();
   }
 
-  if (KEYWORDS.count(get_token_text()) > 0)
-    return add_token(KEYWORDS.at(get_token_text()));
-
-  add_token(IDENTIFIER);
+  add_token(keyword_or_identifier(get_token_text()));
 }
 
 void Lexer::scan_string() {
@@ -56,12 +105,7 @@ void Lexer::scan_string() {
     throw "Unterminated string.";
 
   advance();
-
-  std::string text = source.substr(start + 1, current - start - 2);
-  Literal value = new Literal();
-  value.value = text;
-  value.type = STR;
-  add_token(STRING, text, value);
+  add_token(STRING);
 }
 
 char Lexer::get_next_char() {
@@ -70,23 +114,23 @@ char Lexer::get_next_char() {
 
 char Lexer::get_curr_char() { return is_at_end() ? '\0' : source[current]; }
 
-std::string Lexer::get_token_text() {
+std::string_view Lexer::get_token_text() {
   return source.substr(start, current - start);
 }
 
 void Lexer::scan_token() {
   char c = advance();
 
-  if (isspace(c)) {
+  if (is_space(c)) {
     if (c == '\n')
       ++line;
     return;
   }
 
-  if (isdigit(c))
+  if (is_digit(c))
     return scan_number();
 
-  if (isalpha(c))
+  if (is_alpha(c))
     return scan_identifier();
 
   switch (c) {
@@ -158,14 +202,8 @@ void Lexer::scan_token() {
   }
 }
 
-void Lexer::add_token(TokenType type, std::string lexeme, Literal literal) {
-  tokens.push_back(
-      Token(type, source.substr(start, current - start), literal, line));
-}
-
 void Lexer::add_token(TokenType type) {
-  tokens.push_back(
-      Token(type, source.substr(start, current - start), Literal{}, line));
+  tokens.push_back(Token(type, get_token_text(), line));
 }
 
 bool Lexer::is_at_end() { return current >= source.length(); }
@@ -179,3 +217,17 @@ bool Lexer::is_current_char(char expected) {
 }
 
 std::string token_type_as_str(TokenType type) { return TOK_STR.at(type); }
+
+Literal Token::literal() const {
+  switch (type) {
+  case NUMBER: {
+    double value = 0;
+    std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+    return Literal(value);
+  }
+  case STRING:
+    return Literal(lexeme.substr(1, lexeme.size() - 2), STR);
+  default:
+    return Literal{};
+  }
+}
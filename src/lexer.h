@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <variant>
@@ -103,27 +104,28 @@ enum LiteralType { NUM, STR, BOOL, NIL_ };
 class Literal {
 public:
   Literal() {}
-  Literal(float i) : value(i), type(NUM) {}
+  Literal(double i) : value(i), type(NUM) {}
   Literal(bool b) : value(b), type(BOOL) {}
 
-  Literal(std::string s, LiteralType t) : value(s), type(STR) {}
+  // A string literal's characters stay in the source text.
+  Literal(std::string_view s, LiteralType t) : value(s), type(STR) {}
 
   LiteralType getType() { return type; };
-  std::variant<std::monostate, float, std::string, bool> getValue() {
+  std::variant<std::monostate, double, std::string_view, bool> getValue() {
     return value;
   }
 
   LiteralType type = NIL_;
-  std::variant<std::monostate, float, std::string, bool> value;
+  std::variant<std::monostate, double, std::string_view, bool> value;
 
   std::string as_string() const {
     switch (type) {
     case NIL_:
       return "nil";
     case NUM:
-      return std::to_string(std::get<float>(value));
+      return std::to_string(std::get<double>(value));
     case STR:
-      return std::get<std::string>(value);
+      return std::string(std::get<std::string_view>(value));
     case BOOL: {
       bool v = std::get<bool>(value);
       return v ? "true" : "false";
@@ -134,31 +136,24 @@ public:
 private:
 };
 
+// A token's lexeme points into the source text, which has to outlive it.
 class Token {
 public:
-  Token(TokenType token, std::string lexeme, Literal literal, int line)
-      : type(token), lexeme(lexeme), literal(literal), line(line){};
+  Token(TokenType token, std::string_view lexeme, int line)
+      : type(token), lexeme(lexeme), line(line){};
+
+  // Decodes the value of a NUMBER or STRING token from its lexeme.
+  Literal literal() const;
 
   TokenType type;
-  std::string lexeme;
-  Literal literal;
+  std::string_view lexeme;
   int line;
 };
 
-static const std::unordered_map<std::string, TokenType> KEYWORDS = {
-    std::make_pair("and", AND),       std::make_pair("class", CLASS),
-    std::make_pair("else", ELSE),     std::make_pair("false", FALSE),
-    std::make_pair("for", FOR),       std::make_pair("fun", FUN),
-    std::make_pair("if", IF),         std::make_pair("nil", NIL),
-    std::make_pair("or", OR),         std::make_pair("print", PRINT),
-    std::make_pair("return", RETURN), std::make_pair("super", SUPER),
-    std::make_pair("this", THIS),     std::make_pair("true", TRUE),
-    std::make_pair("var", VAR),       std::make_pair("while", WHILE),
-};
-
 class Lexer {
 public:
-  Lexer(std::string source) : source(source), start(0), current(0), line(1){};
+  Lexer(std::string_view source)
+      : source(source), start(0), current(0), line(1){};
 
   std::vector<Token> scan_tokens();
   void scan_token();
@@ -169,13 +164,12 @@ public:
   char get_next_char();
   char get_curr_char();
   bool is_current_char(char expected);
-  void add_token(TokenType type, std::string lexeme, Literal literal);
   void add_token(TokenType type);
   bool is_at_end();
-  std::string get_token_text();
+  std::string_view get_token_text();
 
 private:
-  std::string source;
+  std::string_view source;
   int line;
   int start;
   int current;
@@ -1,16 +1,90 @@
 #include "interpreter.h"
+#include "program_cache.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
 
+static void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [--engine=tree|flat|vm] [--no-opt] [--dump-ast]"
+               " [--dump-bytecode] [--no-jit] [--jit-threshold=<n>]"
+               " [--jit-stats] [--cache] [--cache-dir=<dir>]"
+               " [--profile=<file>] [--profile-rate=<hz>]"
+               " [--profile-top=<n>] [--alloc-profile]"
+               " [--alloc-profile-every=<seconds>] [--gc-stats]"
+               " [--gc-growth=<factor>] [--gc-min-heap=<bytes>] [--gc-stress]"
+               " <file_path>"
+            << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <file_path>" << std::endl;
+  InterpreterOptions options;
+  std::string filePath;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+
+    if (arg == "--engine=tree") {
+      options.engine = ENGINE_TREE;
+    } else if (arg == "--engine=flat") {
+      options.engine = ENGINE_FLAT;
+    } else if (arg == "--engine=vm") {
+      options.engine = ENGINE_VM;
+    } else if (arg == "--no-opt") {
+      options.optimize = false;
+    } else if (arg == "--no-jit") {
+      options.jit = false;
+    } else if (arg.rfind("--jit-threshold=", 0) == 0) {
+      options.jit_threshold = std::stoul(arg.substr(16));
+    } else if (arg == "--jit-stats") {
+      options.jit_stats = true;
+    } else if (arg == "--dump-ast") {
+      options.dump_ast = true;
+    } else if (arg == "--dump-bytecode") {
+      options.dump_bytecode = true;
+    } else if (arg == "--cache") {
+      options.cache_directory = ProgramCache::default_directory();
+    } else if (arg.rfind("--cache-dir=", 0) == 0) {
+      options.cache_directory = arg.substr(12);
+    } else if (arg.rfind("--profile=", 0) == 0) {
+      options.profile_path = arg.substr(10);
+    } else if (arg.rfind("--profile-rate=", 0) == 0) {
+      options.profile_frequency = std::max(1, std::stoi(arg.substr(15)));
+    } else if (arg.rfind("--profile-top=", 0) == 0) {
+      options.profile_top = std::stoi(arg.substr(14));
+    } else if (arg == "--alloc-profile") {
+      options.alloc_profile = true;
+    } else if (arg.rfind("--alloc-profile-every=", 0) == 0) {
+      options.alloc_profile = true;
+      options.alloc_report_seconds = std::stod(arg.substr(22));
+    } else if (arg == "--gc-stats") {
+      options.gc_stats = true;
+    } else if (arg == "--gc-stress") {
+      options.gc_stress = true;
+    } else if (arg.rfind("--gc-growth=", 0) == 0) {
+      options.gc_growth_factor = std::stod(arg.substr(12));
+    } else if (arg.rfind("--gc-min-heap=", 0) == 0) {
+      options.gc_min_heap_bytes = std::stoull(arg.substr(14));
+    } else if (arg.rfind("--", 0) == 0 || !filePath.empty()) {
+      print_usage(argv[0]);
+      return 1;
+    } else {
+      filePath = arg;
+    }
+  }
+
+  if (filePath.empty()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (!options.cache_directory.empty() && options.engine != ENGINE_FLAT) {
+    std::cerr << "Only --engine=flat programs can be cached." << std::endl;
     return 1;
   }
 
-  std::string filePath = argv[1];
-  Interpreter terp = Interpreter();
+  Interpreter terp = Interpreter(options);
   terp.run_file(filePath);
 
   return 0;
-}
\ No newline at end of file
+}
@@ -17,7 +17,7 @@ void AstPrinter::print_indent() {
 void AstPrinter::visit(BinaryExpr *expr) {
   printf("\n");
   print_indent();
-  printf("Binary %s", expr->op.lexeme.c_str());
+  printf("Binary %.*s", (int)expr->op.lexeme.size(), expr->op.lexeme.data());
   ++indent;
   expr->left.accept<void>(*this);
   expr->right.accept<void>(*this);
@@ -42,7 +42,7 @@ void AstPrinter::visit(GroupingExpr *expr) {
 void AstPrinter::visit(UnaryExpr *expr) {
   printf("\n");
   print_indent();
-  printf("Unary %s ", expr->op.lexeme.c_str());
+  printf("Unary %.*s ", (int)expr->op.lexeme.size(), expr->op.lexeme.data());
   ++indent;
   expr->right.accept(*this);
   --indent;
@@ -64,13 +64,13 @@ void AstPrinter::visit(CallExpr *expr) {
 void AstPrinter::visit(VariableReferenceExpr *expr) {
   printf("\n");
   print_indent();
-  printf("VarRef %s", expr->op.lexeme.c_str());
+  printf("VarRef %.*s", (int)expr->op.lexeme.size(), expr->op.lexeme.data());
 };
 
 void AstPrinter::visit(GetExpr *expr) {
   printf("\n");
   print_indent();
-  printf("Get %s", expr->name.lexeme.c_str());
+  printf("Get %.*s", (int)expr->name.lexeme.size(), expr->name.lexeme.data());
   ++indent;
   expr->obj->accept(*this);
   --indent;
@@ -79,7 +79,7 @@ void AstPrinter::visit(GetExpr *expr) {
 void AstPrinter::visit(SetExpr *expr) {
   printf("\n");
   print_indent();
-  printf("Set %s", expr->name.lexeme.c_str());
+  printf("Set %.*s", (int)expr->name.lexeme.size(), expr->name.lexeme.data());
   ++indent;
   expr->obj->accept(*this);
   expr->value->accept(*this);
@@ -151,7 +151,8 @@ void AstPrinter::visit(PrintStmt *stmt) {
 void AstPrinter::visit(VariableDeclarationStmt *stmt) {
   printf("\n");
   print_indent();
-  printf("VarDecl %s", stmt->name.lexeme.c_str());
+  printf("VarDecl %.*s",
+         (int)stmt->name.lexeme.size(), stmt->name.lexeme.data());
   ++indent;
   stmt->initializer->accept(*this);
   --indent;
@@ -160,7 +161,8 @@ void AstPrinter::visit(VariableDeclarationStmt *stmt) {
 void AstPrinter::visit(AssignmentStmt *stmt) {
   printf("\n");
   print_indent();
-  printf("Assign %s ", stmt->name.lexeme.c_str());
+  printf("Assign %.*s ",
+         (int)stmt->name.lexeme.size(), stmt->name.lexeme.data());
   ++indent;
   stmt->value->accept(*this);
   --indent;
@@ -184,7 +186,8 @@ void AstPrinter::visit(IfStmt *stmt) {
   ++indent;
   stmt->condition->accept(*this);
   stmt->then_branch->accept(*this);
-  stmt->else_branch->accept(*this);
+  if (stmt->else_branch != nullptr)
+    stmt->else_branch->accept(*this);
   --indent;
 };
 
@@ -198,6 +201,20 @@ void AstPrinter::visit(WhileStmt *stmt) {
   --indent;
 };
 
+void AstPrinter::visit(ForStmt *stmt) {
+  printf("\n");
+  print_indent();
+  printf("For");
+  ++indent;
+  if (stmt->initializer != nullptr)
+    stmt->initializer->accept(*this);
+  stmt->condition->accept(*this);
+  if (stmt->increment != nullptr)
+    stmt->increment->accept(*this);
+  stmt->body->accept(*this);
+  --indent;
+};
+
 void AstPrinter::visit(ReturnStmt *stmt) {
   printf("\n");
   print_indent();
@@ -210,10 +227,10 @@ void AstPrinter::visit(ReturnStmt *stmt) {
 void AstPrinter::visit(ClassStmt *stmt) {
   printf("\n");
   print_indent();
-  printf("Class %s", stmt->name.lexeme.c_str());
+  printf("Class %.*s", (int)stmt->name.lexeme.size(), stmt->name.lexeme.data());
   ++indent;
-  for (auto method : stmt->methods) {
-    method.accept(*this);
+  for (FunctionDeclarationStmt *method : stmt->methods) {
+    method->accept(*this);
     printf("\n");
   }
   --indent;
@@ -222,9 +239,10 @@ void AstPrinter::visit(ClassStmt *stmt) {
 void AstPrinter::visit(FunctionDeclarationStmt *stmt) {
   printf("\n");
   print_indent();
-  printf("FunDecl %s: ", stmt->name.lexeme.c_str());
+  printf("FunDecl %.*s: ",
+         (int)stmt->name.lexeme.size(), stmt->name.lexeme.data());
   for (auto param : stmt->params) {
-    printf("%s ", param.lexeme.c_str());
+    printf("%.*s ", (int)param.lexeme.size(), param.lexeme.data());
   }
   ++indent;
   BlockStmt(stmt->body).accept(*this);
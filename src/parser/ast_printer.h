@@ -27,6 +27,7 @@ public:
   void visit(BlockStmt *stmt) override;
   void visit(IfStmt *stmt) override;
   void visit(WhileStmt *stmt) override;
+  void visit(ForStmt *stmt) override;
   void visit(ReturnStmt *stmt) override;
   void visit(ClassStmt *stmt) override;
   void visit(FunctionDeclarationStmt *stmt) override;
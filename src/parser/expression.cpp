@@ -1,7 +1,6 @@
 #include "expression.h"
 
-template <>
-RuntimeValue *Expression::accept(ExpressionVisitor<RuntimeValue *> &visitor) {
+template <> Value Expression::accept(ExpressionVisitor<Value> &visitor) {
   return do_accept(visitor);
 }
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "../evaluator/runtime_value.h"
+#include "../evaluator/shape.h"
 #include "../lexer.h"
+#include <span>
 
 template <typename T> class ExpressionVisitor;
 
@@ -17,6 +19,7 @@ enum ExpressionType {
   THIS_EXPR,
   ARRAY_EXPR,
   INDEX_EXPR,
+  SET_INDEX_EXPR,
 
   EXPRESSION_STMT,
   PRINT_STMT,
@@ -25,21 +28,36 @@ enum ExpressionType {
   BLOCK_STMT,
   IF_STMT,
   WHILE_STMT,
+  FOR_STMT,
   RETURN_STMT,
   CLASS_STMT,
   FUNCTION_DECLARATION_STMT,
 };
 
+// Where the resolver found a variable: `depth` environments up the chain from
+// the current one, at index `slot`. Globals have no depth and their slot is an
+// index into the evaluator's global table instead.
+struct VariableSlot {
+  static constexpr int GLOBAL = -1;
+
+  bool is_global() const { return depth == GLOBAL; }
+
+  int depth = GLOBAL;
+  int slot = -1;
+};
+
+// Nodes live in their Program's arena and are never destroyed one by one, so
+// every node type has to stay trivially destructible: child lists are spans
+// into the arena and tokens point into the source text.
 class Expression {
 public:
   template <typename T> T accept(ExpressionVisitor<T> &visitor);
 
-  virtual ~Expression() = default;
   virtual ExpressionType getType() const = 0;
 
 protected:
-  virtual RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) {
-    return new RuntimeValue();
+  virtual Value do_accept(ExpressionVisitor<Value> &visitor) {
+    return Value::nil();
   };
   virtual void do_accept(ExpressionVisitor<void> &visitor){};
 };
@@ -66,6 +84,7 @@ class AssignmentStmt;
 class BlockStmt;
 class IfStmt;
 class WhileStmt;
+class ForStmt;
 class ReturnStmt;
 class ClassStmt;
 class FunctionDeclarationStmt;
@@ -92,6 +111,7 @@ public:
   virtual T visit(BlockStmt *stmt) = 0;
   virtual T visit(IfStmt *stmt) = 0;
   virtual T visit(WhileStmt *stmt) = 0;
+  virtual T visit(ForStmt *stmt) = 0;
   virtual T visit(ReturnStmt *stmt) = 0;
   virtual T visit(ClassStmt *stmt) = 0;
   virtual T visit(FunctionDeclarationStmt *stmt) = 0;
@@ -99,31 +119,32 @@ public:
   virtual ~ExpressionVisitor() = default;
 };
 
-template <> class ExpressionVisitor<RuntimeValue *> {
+template <> class ExpressionVisitor<Value> {
 public:
-  virtual RuntimeValue *visit(BinaryExpr *expr) = 0;
-  virtual RuntimeValue *visit(GroupingExpr *expr) = 0;
-  virtual RuntimeValue *visit(LiteralExpr *expr) = 0;
-  virtual RuntimeValue *visit(UnaryExpr *expr) = 0;
-  virtual RuntimeValue *visit(CallExpr *expr) = 0;
-  virtual RuntimeValue *visit(VariableReferenceExpr *expr) = 0;
-  virtual RuntimeValue *visit(GetExpr *expr) = 0;
-  virtual RuntimeValue *visit(SetExpr *expr) = 0;
-  virtual RuntimeValue *visit(ThisExpr *expr) = 0;
-  virtual RuntimeValue *visit(ArrayExpr *expr) = 0;
-  virtual RuntimeValue *visit(IndexExpr *expr) = 0;
-  virtual RuntimeValue *visit(SetIndexExpr *expr) = 0;
-
-  virtual RuntimeValue *visit(ExpressionStmt *stmt) = 0;
-  virtual RuntimeValue *visit(PrintStmt *stmt) = 0;
-  virtual RuntimeValue *visit(VariableDeclarationStmt *stmt) = 0;
-  virtual RuntimeValue *visit(AssignmentStmt *stmt) = 0;
-  virtual RuntimeValue *visit(BlockStmt *stmt) = 0;
-  virtual RuntimeValue *visit(IfStmt *stmt) = 0;
-  virtual RuntimeValue *visit(WhileStmt *stmt) = 0;
-  virtual RuntimeValue *visit(ReturnStmt *stmt) = 0;
-  virtual RuntimeValue *visit(ClassStmt *stmt) = 0;
-  virtual RuntimeValue *visit(FunctionDeclarationStmt *stmt) = 0;
+  virtual Value visit(BinaryExpr *expr) = 0;
+  virtual Value visit(GroupingExpr *expr) = 0;
+  virtual Value visit(LiteralExpr *expr) = 0;
+  virtual Value visit(UnaryExpr *expr) = 0;
+  virtual Value visit(CallExpr *expr) = 0;
+  virtual Value visit(VariableReferenceExpr *expr) = 0;
+  virtual Value visit(GetExpr *expr) = 0;
+  virtual Value visit(SetExpr *expr) = 0;
+  virtual Value visit(ThisExpr *expr) = 0;
+  virtual Value visit(ArrayExpr *expr) = 0;
+  virtual Value visit(IndexExpr *expr) = 0;
+  virtual Value visit(SetIndexExpr *expr) = 0;
+
+  virtual Value visit(ExpressionStmt *stmt) = 0;
+  virtual Value visit(PrintStmt *stmt) = 0;
+  virtual Value visit(VariableDeclarationStmt *stmt) = 0;
+  virtual Value visit(AssignmentStmt *stmt) = 0;
+  virtual Value visit(BlockStmt *stmt) = 0;
+  virtual Value visit(IfStmt *stmt) = 0;
+  virtual Value visit(WhileStmt *stmt) = 0;
+  virtual Value visit(ForStmt *stmt) = 0;
+  virtual Value visit(ReturnStmt *stmt) = 0;
+  virtual Value visit(ClassStmt *stmt) = 0;
+  virtual Value visit(FunctionDeclarationStmt *stmt) = 0;
 };
 
 template <> class ExpressionVisitor<void> {
@@ -148,6 +169,7 @@ public:
   virtual void visit(BlockStmt *stmt) = 0;
   virtual void visit(IfStmt *stmt) = 0;
   virtual void visit(WhileStmt *stmt) = 0;
+  virtual void visit(ForStmt *stmt) = 0;
   virtual void visit(ReturnStmt *stmt) = 0;
   virtual void visit(ClassStmt *stmt) = 0;
   virtual void visit(FunctionDeclarationStmt *stmt) = 0;
@@ -164,7 +186,7 @@ public:
   Expression &right;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -181,7 +203,7 @@ public:
   Expression &expr;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -198,8 +220,12 @@ public:
 
   Literal value;
 
+  // The runtime value of a string literal, created on first evaluation and
+  // shared by every later one.
+  Value cached_string = Value::undefined();
+
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -217,7 +243,7 @@ public:
   Expression &right;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -228,16 +254,16 @@ protected:
 
 class CallExpr : public Expression {
 public:
-  CallExpr(Expression *callee, Token paren, std::vector<Expression *> arguments)
+  CallExpr(Expression *callee, Token paren, std::span<Expression *> arguments)
       : callee(callee), paren(paren), arguments(arguments){};
   ExpressionType getType() const override { return CALL_EXPR; };
 
   Expression *callee;
   Token paren;
-  std::vector<Expression *> arguments;
+  std::span<Expression *> arguments;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -252,9 +278,10 @@ public:
   ExpressionType getType() const override { return VARIABLE_REFERENCE_EXPR; };
 
   Token op;
+  VariableSlot resolved;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -265,14 +292,16 @@ protected:
 
 class IndexExpr : public Expression {
 public:
-  IndexExpr(Expression *obj, Expression *index) : obj(obj), index(index){};
+  IndexExpr(Expression *obj, Expression *index, Token bracket)
+      : obj(obj), index(index), bracket(bracket){};
   ExpressionType getType() const override { return INDEX_EXPR; };
 
   Expression *obj;
   Expression *index;
+  Token bracket;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -285,14 +314,14 @@ class SetIndexExpr : public Expression {
 public:
   SetIndexExpr(Expression *obj, Expression *index, Expression *value)
       : obj(obj), index(index), value(value){};
-  ExpressionType getType() const override { return INDEX_EXPR; };
+  ExpressionType getType() const override { return SET_INDEX_EXPR; };
 
   Expression *obj;
   Expression *index;
   Expression *value;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -303,14 +332,17 @@ protected:
 
 class GetExpr : public Expression {
 public:
-  GetExpr(Expression *obj, Token name) : obj(obj), name(name){};
+  GetExpr(Expression *obj, Token name)
+      : obj(obj), name(name), symbol(intern(name.lexeme)){};
   ExpressionType getType() const override { return GET_EXPR; };
 
   Expression *obj;
   Token name;
+  const Symbol *symbol;
+  PropertyCache cache;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -322,15 +354,17 @@ protected:
 class SetExpr : public Expression {
 public:
   SetExpr(Expression *obj, Token name, Expression *value)
-      : obj(obj), name(name), value(value){};
+      : obj(obj), value(value), name(name), symbol(intern(name.lexeme)){};
   ExpressionType getType() const override { return SET_EXPR; };
 
   Expression *obj;
   Expression *value;
   Token name;
+  const Symbol *symbol;
+  PropertyCache cache;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -345,9 +379,10 @@ public:
   ExpressionType getType() const override { return THIS_EXPR; };
 
   Token keyword;
+  VariableSlot resolved;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -358,16 +393,16 @@ protected:
 
 class ArrayExpr : public Expression {
 public:
-  ArrayExpr(std::vector<Expression *> values)
-      : values(values), length(new LiteralExpr((float)(values.size()))) {}
-  ArrayExpr(Expression *length) : length(length) {}
+  ArrayExpr(std::span<Expression *> values, Expression *length, Token bracket)
+      : values(values), length(length), bracket(bracket) {}
   ExpressionType getType() const override { return ARRAY_EXPR; }
 
-  std::vector<Expression *> values;
+  std::span<Expression *> values;
   Expression *length;
+  Token bracket;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -390,7 +425,7 @@ public:
   Expression *expression;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -407,7 +442,7 @@ public:
   Expression *expression;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -424,9 +459,10 @@ public:
 
   Token name;
   Expression *initializer;
+  VariableSlot resolved;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -442,9 +478,10 @@ public:
 
   Token name;
   Expression *value;
+  VariableSlot resolved;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -455,13 +492,17 @@ protected:
 
 class BlockStmt : public Statement {
 public:
-  BlockStmt(std::vector<Statement *> statements) : statements(statements){};
+  BlockStmt(std::span<Statement *> statements) : statements(statements){};
   ExpressionType getType() const override { return BLOCK_STMT; };
 
-  std::vector<Statement *> statements;
+  std::span<Statement *> statements;
+  // Number of variables declared directly in this block. A block that
+  // declares none has no scope of its own and runs in the enclosing
+  // environment.
+  int scope_size = 0;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -479,10 +520,11 @@ public:
 
   Expression *condition;
   Statement *then_branch;
+  // Null once the optimizer has dropped an empty else branch.
   Statement *else_branch;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -501,7 +543,38 @@ public:
   Statement *body;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
+    return visitor.visit(this);
+  };
+
+  void do_accept(ExpressionVisitor<void> &visitor) override {
+    return visitor.visit(this);
+  };
+};
+
+// `for (initializer; condition; increment) body`. The initializer and the
+// increment are optional; a missing condition is a nil literal, so the loop
+// never runs.
+class ForStmt : public Statement {
+public:
+  ForStmt(Token keyword, Statement *initializer, Expression *condition,
+          Expression *increment, Statement *body)
+      : keyword(keyword), initializer(initializer), condition(condition),
+        increment(increment), body(body){};
+  ExpressionType getType() const override { return FOR_STMT; };
+
+  Token keyword;
+  Statement *initializer;
+  Expression *condition;
+  Expression *increment;
+  Statement *body;
+  // Like a block's: the loop only gets an environment, shared by every
+  // iteration, if its initializer or a bare declaration as its body declares
+  // something.
+  int scope_size = 0;
+
+protected:
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -512,17 +585,20 @@ protected:
 
 class FunctionDeclarationStmt : public Statement {
 public:
-  FunctionDeclarationStmt(Token name, std::vector<Token> params,
-                          std::vector<Statement *> body)
+  FunctionDeclarationStmt(Token name, std::span<Token> params,
+                          std::span<Statement *> body)
       : name(name), params(params), body(body){};
   ExpressionType getType() const override { return FUNCTION_DECLARATION_STMT; };
 
   Token name;
-  std::vector<Token> params;
-  std::vector<Statement *> body;
+  std::span<Token> params;
+  std::span<Statement *> body;
+  VariableSlot resolved;
+  // Parameters plus the variables declared directly in the body.
+  int scope_size = 0;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -541,7 +617,7 @@ public:
   Expression *value;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -552,15 +628,16 @@ protected:
 
 class ClassStmt : public Statement {
 public:
-  ClassStmt(Token name, std::vector<FunctionDeclarationStmt> methods)
+  ClassStmt(Token name, std::span<FunctionDeclarationStmt *> methods)
       : name(name), methods(methods){};
   ExpressionType getType() const override { return CLASS_STMT; };
 
   Token name;
-  std::vector<FunctionDeclarationStmt> methods;
+  std::span<FunctionDeclarationStmt *> methods;
+  VariableSlot resolved;
 
 protected:
-  RuntimeValue *do_accept(ExpressionVisitor<RuntimeValue *> &visitor) override {
+  Value do_accept(ExpressionVisitor<Value> &visitor) override {
     return visitor.visit(this);
   };
 
@@ -0,0 +1,216 @@
+#include "flat_ast.h"
+
+NodeIndex FlatAst::begin(ExpressionType kind, SourceSpan span,
+                         uint32_t node_data) {
+  NodeIndex node = kinds.size();
+  kinds.push_back(kind);
+  data.push_back(node_data);
+  spans.push_back(span);
+  subtree_end.push_back(node + 1);
+  return node;
+}
+
+template <typename T> static size_t vector_bytes(const std::vector<T> &items) {
+  return items.capacity() * sizeof(T);
+}
+
+size_t FlatAst::bytes_used() const {
+  return vector_bytes(kinds) + vector_bytes(data) + vector_bytes(spans) +
+         vector_bytes(subtree_end) + vector_bytes(statements) +
+         vector_bytes(literal_values) + vector_bytes(caches) +
+         vector_bytes(property_names) + vector_bytes(resolved) +
+         vector_bytes(functions) + vector_bytes(params);
+}
+
+// Lowers the pointer-based tree in evaluation order: each visit numbers its
+// node and then lowers the operands right behind it.
+class FlatAstBuilder : public ExpressionVisitor<void> {
+public:
+  FlatAstBuilder(FlatAst &ast) : ast(ast) {}
+
+  NodeIndex lower(Expression *expression) {
+    NodeIndex node = ast.kinds.size();
+    expression->accept(*this);
+    ast.finish(node);
+    return node;
+  }
+
+  void visit(BinaryExpr *expr) override {
+    ast.begin(BINARY_EXPR, span(expr->op), expr->op.type);
+    lower(&expr->left);
+    lower(&expr->right);
+  }
+
+  void visit(GroupingExpr *expr) override {
+    ast.begin(GROUPING_EXPR, {}, 0);
+    lower(&expr->expr);
+  }
+
+  void visit(LiteralExpr *expr) override {
+    SourceSpan text = {};
+    Value value = Value::undefined();
+    if (expr->value.type == STR)
+      text = ast.span_of(std::get<std::string_view>(expr->value.value));
+    else
+      value = literal_to_value(expr->value);
+
+    ast.begin(LITERAL_EXPR, text, ast.literal_values.size());
+    ast.literal_values.push_back(value);
+  }
+
+  void visit(UnaryExpr *expr) override {
+    ast.begin(UNARY_EXPR, span(expr->op), expr->op.type);
+    lower(&expr->right);
+  }
+
+  void visit(CallExpr *expr) override {
+    ast.begin(CALL_EXPR, span(expr->paren), 0);
+    lower(expr->callee);
+    for (Expression *argument : expr->arguments)
+      lower(argument);
+  }
+
+  void visit(VariableReferenceExpr *expr) override {
+    ast.begin(VARIABLE_REFERENCE_EXPR, span(expr->op), add_resolved());
+  }
+
+  void visit(GetExpr *expr) override {
+    ast.begin(GET_EXPR, span(expr->name), add_cache(expr->symbol));
+    lower(expr->obj);
+  }
+
+  void visit(SetExpr *expr) override {
+    ast.begin(SET_EXPR, span(expr->name), add_cache(expr->symbol));
+    lower(expr->obj);
+    lower(expr->value);
+  }
+
+  void visit(ThisExpr *expr) override {
+    ast.begin(THIS_EXPR, span(expr->keyword), add_resolved());
+  }
+
+  void visit(ArrayExpr *expr) override {
+    ast.begin(ARRAY_EXPR, span(expr->bracket), 0);
+    lower(expr->length);
+    for (Expression *value : expr->values)
+      lower(value);
+  }
+
+  void visit(IndexExpr *expr) override {
+    ast.begin(INDEX_EXPR, span(expr->bracket), 0);
+    lower(expr->obj);
+    lower(expr->index);
+  }
+
+  void visit(SetIndexExpr *expr) override {
+    ast.begin(SET_INDEX_EXPR, {}, 0);
+    lower(expr->obj);
+    lower(expr->index);
+    lower(expr->value);
+  }
+
+  void visit(ExpressionStmt *stmt) override {
+    ast.begin(EXPRESSION_STMT, {}, 0);
+    lower(stmt->expression);
+  }
+
+  void visit(PrintStmt *stmt) override {
+    ast.begin(PRINT_STMT, {}, 0);
+    lower(stmt->expression);
+  }
+
+  void visit(VariableDeclarationStmt *stmt) override {
+    ast.begin(VARIABLE_DECLARATION_STMT, span(stmt->name), add_resolved());
+    lower(stmt->initializer);
+  }
+
+  void visit(AssignmentStmt *stmt) override {
+    ast.begin(ASSIGNMENT_STMT, span(stmt->name), add_resolved());
+    lower(stmt->value);
+  }
+
+  void visit(BlockStmt *stmt) override {
+    ast.begin(BLOCK_STMT, {}, 0);
+    for (Statement *statement : stmt->statements)
+      lower(statement);
+  }
+
+  void visit(IfStmt *stmt) override {
+    ast.begin(IF_STMT, {}, 0);
+    lower(stmt->condition);
+    lower(stmt->then_branch);
+    if (stmt->else_branch != nullptr)
+      lower(stmt->else_branch);
+  }
+
+  void visit(WhileStmt *stmt) override {
+    ast.begin(WHILE_STMT, {}, 0);
+    lower(stmt->condition);
+    lower(stmt->body);
+  }
+
+  void visit(ForStmt *stmt) override {
+    ast.begin(FOR_STMT, span(stmt->keyword), 0);
+    if (stmt->initializer != nullptr)
+      lower(stmt->initializer);
+    else
+      ast.finish(ast.begin(BLOCK_STMT, {}, 0));
+    lower(stmt->condition);
+    lower(stmt->body);
+    if (stmt->increment != nullptr)
+      lower(stmt->increment);
+  }
+
+  void visit(ReturnStmt *stmt) override {
+    ast.begin(RETURN_STMT, span(stmt->keyword), 0);
+    lower(stmt->value);
+  }
+
+  void visit(ClassStmt *stmt) override {
+    ast.begin(CLASS_STMT, span(stmt->name), add_resolved());
+    for (FunctionDeclarationStmt *method : stmt->methods)
+      lower(method);
+  }
+
+  void visit(FunctionDeclarationStmt *stmt) override {
+    ast.begin(FUNCTION_DECLARATION_STMT, span(stmt->name),
+              ast.functions.size());
+    ast.functions.push_back(FlatFunction{(uint32_t)ast.params.size(),
+                                         (uint32_t)stmt->params.size(), 0,
+                                         VariableSlot()});
+    for (const Token &param : stmt->params)
+      ast.params.push_back(span(param));
+
+    for (Statement *statement : stmt->body)
+      lower(statement);
+  }
+
+private:
+  SourceSpan span(const Token &token) { return ast.span_of(token.lexeme); }
+
+  uint32_t add_resolved() {
+    ast.resolved.push_back(VariableSlot());
+    return ast.resolved.size() - 1;
+  }
+
+  uint32_t add_cache(const Symbol *name) {
+    ast.caches.push_back(PropertyCache());
+    ast.property_names.push_back(name);
+    return ast.caches.size() - 1;
+  }
+
+  FlatAst &ast;
+};
+
+FlatAst flatten(const Program &program, std::string_view source) {
+  FlatAst ast(source);
+  FlatAstBuilder builder(ast);
+  for (Expression *statement : program.statements)
+    ast.statements.push_back(builder.lower(statement));
+
+  ast.kinds.shrink_to_fit();
+  ast.data.shrink_to_fit();
+  ast.spans.shrink_to_fit();
+  ast.subtree_end.shrink_to_fit();
+  return ast;
+}
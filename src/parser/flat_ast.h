@@ -0,0 +1,158 @@
+#pragma once
+
+#include "../evaluator/shape.h"
+#include "expression.h"
+#include "program.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+typedef uint32_t NodeIndex;
+
+// Where a token sits in the source text.
+struct SourceSpan {
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct FlatFunction {
+  // Parameter names, in FlatAst::params.
+  uint32_t first_param;
+  uint32_t param_count;
+  // Parameters plus the variables declared directly in the body.
+  int scope_size;
+  VariableSlot resolved;
+};
+
+// A compact alternative to the pointer-based syntax tree. Nodes are numbered
+// in source order, as a pre-order walk: a node comes first, immediately
+// followed by its operands in the order listed below, each with its own
+// operands after it. Every property of a node lives in its own array indexed
+// by that number, and no node stores a pointer. The first operand of a node
+// is the next node; each later operand starts at `subtree_end` of the one
+// before it.
+//
+// Evaluation mostly follows the numbering, but INDEX_EXPR and SET_INDEX_EXPR
+// evaluate their operands in reverse: the index before `obj`, and a stored
+// value before both.
+//
+// `data` holds:
+//   BINARY_EXPR, UNARY_EXPR            the operator's TokenType
+//   LITERAL_EXPR                       an index into `literal_values`
+//   GET_EXPR, SET_EXPR                 an index into `caches`
+//   VARIABLE_REFERENCE_EXPR, THIS_EXPR,
+//   VARIABLE_DECLARATION_STMT,
+//   ASSIGNMENT_STMT, CLASS_STMT        an index into `resolved`
+//   BLOCK_STMT, FOR_STMT               the statement's scope size
+//   FUNCTION_DECLARATION_STMT          an index into `functions`
+//
+// Operands, in order:
+//   BINARY_EXPR left, right     CALL_EXPR callee, arguments...
+//   GET_EXPR obj                SET_EXPR obj, value
+//   ARRAY_EXPR length, values   INDEX_EXPR obj, index
+//   SET_INDEX_EXPR obj, index, value
+//   IF_STMT condition, then[, else]
+//   WHILE_STMT condition, body  BLOCK_STMT statements...
+//   CLASS_STMT methods...       FUNCTION_DECLARATION_STMT body...
+//   FOR_STMT initializer, condition, body[, increment]
+// and the single child of every other kind that has one. A `for` without an
+// initializer gets an empty block in its place.
+class FlatAst {
+public:
+  FlatAst(std::string_view source) : source(source) {}
+  FlatAst(const FlatAst &) = delete;
+  FlatAst &operator=(const FlatAst &) = delete;
+  FlatAst(FlatAst &&) = default;
+
+  // Numbers a new node. Its operands have to be added next, before finish().
+  NodeIndex begin(ExpressionType kind, SourceSpan span, uint32_t node_data);
+  void finish(NodeIndex node) { subtree_end[node] = kinds.size(); }
+
+  SourceSpan span_of(std::string_view token) const {
+    return SourceSpan{(uint32_t)(token.data() - source.data()),
+                      (uint32_t)token.size()};
+  }
+
+  ExpressionType kind(NodeIndex node) const {
+    return (ExpressionType)kinds[node];
+  }
+
+  NodeIndex first_operand(NodeIndex node) const { return node + 1; }
+  NodeIndex next_operand(NodeIndex operand) const {
+    return subtree_end[operand];
+  }
+  bool is_operand_of(NodeIndex operand, NodeIndex node) const {
+    return operand < subtree_end[node];
+  }
+
+  NodeIndex operand(NodeIndex node, int i) const {
+    NodeIndex operand = first_operand(node);
+    while (i--)
+      operand = next_operand(operand);
+    return operand;
+  }
+
+  std::string_view text(SourceSpan span) const {
+    return source.substr(span.offset, span.length);
+  }
+  std::string_view text(NodeIndex node) const { return text(spans[node]); }
+
+  // Memory held by the tree, for comparison with the pointer-based one.
+  size_t bytes_used() const;
+
+  std::string_view source;
+
+  std::vector<uint8_t> kinds;
+  std::vector<uint32_t> data;
+  std::vector<SourceSpan> spans;
+  std::vector<NodeIndex> subtree_end;
+
+  // Top-level statements, in program order.
+  std::vector<NodeIndex> statements;
+
+  // Literals, boxed up front. A string literal is undefined until it is first
+  // evaluated; its characters are the span of its node.
+  std::vector<Value> literal_values;
+  std::vector<PropertyCache> caches;
+  // The property each cache's node reads or writes, indexed alike.
+  std::vector<const Symbol *> property_names;
+  std::vector<VariableSlot> resolved;
+  std::vector<FlatFunction> functions;
+  std::vector<SourceSpan> params;
+};
+
+// Iterates over the operands of `node`, e.g. the statements of a block:
+//   for (NodeIndex statement : FlatOperands(ast, node))
+class FlatOperands {
+public:
+  class iterator {
+  public:
+    iterator(const FlatAst &ast, NodeIndex node) : ast(ast), node(node) {}
+    NodeIndex operator*() const { return node; }
+    iterator &operator++() {
+      node = ast.next_operand(node);
+      return *this;
+    }
+    bool operator!=(const iterator &other) const { return node != other.node; }
+
+  private:
+    const FlatAst &ast;
+    NodeIndex node;
+  };
+
+  FlatOperands(const FlatAst &ast, NodeIndex node, int skip = 0)
+      : ast(ast), first(ast.operand(node, skip)),
+        limit(ast.subtree_end[node]) {}
+
+  iterator begin() const { return iterator(ast, first); }
+  iterator end() const { return iterator(ast, limit); }
+
+private:
+  const FlatAst &ast;
+  NodeIndex first;
+  NodeIndex limit;
+};
+
+// Packs `program`, which was parsed from `source`, into a FlatAst. The result
+// does not refer to the program, which may be released afterwards.
+FlatAst flatten(const Program &program, std::string_view source);
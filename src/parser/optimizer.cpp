@@ -0,0 +1,474 @@
+#include "optimizer.h"
+
+static bool is_literal(Expression *expr) {
+  return expr->getType() == LITERAL_EXPR;
+}
+
+static bool is_truthy(const Literal &literal) {
+  if (literal.type == BOOL)
+    return std::get<bool>(literal.value);
+  return literal.type != NIL_;
+}
+
+// A declaration used directly as a branch keeps its `if`, so the VM still
+// gives it a scope of its own.
+static bool is_declaration(Statement *stmt) {
+  return stmt->getType() == FUNCTION_DECLARATION_STMT ||
+         stmt->getType() == CLASS_STMT;
+}
+
+void Optimizer::optimize() {
+  for (Expression *expr : program.statements)
+    find_assignments(expr);
+
+  size_t kept = 0;
+  for (Expression *expr : program.statements) {
+    Statement *stmt = optimize_statement((Statement *)expr);
+    if (stmt != nullptr)
+      program.statements[kept++] = stmt;
+  }
+  program.statements.resize(kept);
+}
+
+void Optimizer::find_assignments(FunctionDeclarationStmt *function) {
+  declarations.emplace_back(function->scope_size, nullptr);
+  for (Statement *stmt : function->body)
+    find_assignments(stmt);
+  declarations.pop_back();
+}
+
+void Optimizer::find_assignments(Expression *expr) {
+  switch (expr->getType()) {
+  case BINARY_EXPR: {
+    BinaryExpr *binary = (BinaryExpr *)expr;
+    find_assignments(&binary->left);
+    return find_assignments(&binary->right);
+  }
+  case GROUPING_EXPR:
+    return find_assignments(&((GroupingExpr *)expr)->expr);
+  case UNARY_EXPR:
+    return find_assignments(&((UnaryExpr *)expr)->right);
+  case CALL_EXPR: {
+    CallExpr *call = (CallExpr *)expr;
+    find_assignments(call->callee);
+    for (Expression *argument : call->arguments)
+      find_assignments(argument);
+    return;
+  }
+  case GET_EXPR:
+    return find_assignments(((GetExpr *)expr)->obj);
+  case SET_EXPR: {
+    SetExpr *set = (SetExpr *)expr;
+    find_assignments(set->obj);
+    return find_assignments(set->value);
+  }
+  case ARRAY_EXPR: {
+    ArrayExpr *array = (ArrayExpr *)expr;
+    find_assignments(array->length);
+    for (Expression *value : array->values)
+      find_assignments(value);
+    return;
+  }
+  case INDEX_EXPR: {
+    IndexExpr *index = (IndexExpr *)expr;
+    find_assignments(index->obj);
+    return find_assignments(index->index);
+  }
+  case SET_INDEX_EXPR: {
+    SetIndexExpr *set = (SetIndexExpr *)expr;
+    find_assignments(set->obj);
+    find_assignments(set->index);
+    return find_assignments(set->value);
+  }
+
+  case EXPRESSION_STMT:
+    return find_assignments(((ExpressionStmt *)expr)->expression);
+  case PRINT_STMT:
+    return find_assignments(((PrintStmt *)expr)->expression);
+  case VARIABLE_DECLARATION_STMT: {
+    VariableDeclarationStmt *stmt = (VariableDeclarationStmt *)expr;
+    find_assignments(stmt->initializer);
+    if (stmt->resolved.is_global())
+      ++global_declarations[stmt->resolved.slot];
+    else
+      declarations.back()[stmt->resolved.slot] = stmt;
+    return;
+  }
+  case ASSIGNMENT_STMT: {
+    AssignmentStmt *stmt = (AssignmentStmt *)expr;
+    find_assignments(stmt->value);
+    if (stmt->resolved.is_global()) {
+      assigned_globals.insert(stmt->resolved.slot);
+      return;
+    }
+    VariableDeclarationStmt *declaration =
+        declarations[declarations.size() - 1 - stmt->resolved.depth]
+                    [stmt->resolved.slot];
+    if (declaration != nullptr)
+      assigned.insert(declaration);
+    return;
+  }
+  case BLOCK_STMT: {
+    BlockStmt *stmt = (BlockStmt *)expr;
+    if (stmt->scope_size > 0)
+      declarations.emplace_back(stmt->scope_size, nullptr);
+    for (Statement *statement : stmt->statements)
+      find_assignments(statement);
+    if (stmt->scope_size > 0)
+      declarations.pop_back();
+    return;
+  }
+  case IF_STMT: {
+    IfStmt *stmt = (IfStmt *)expr;
+    find_assignments(stmt->condition);
+    find_assignments(stmt->then_branch);
+    if (stmt->else_branch != nullptr)
+      find_assignments(stmt->else_branch);
+    return;
+  }
+  case WHILE_STMT: {
+    WhileStmt *stmt = (WhileStmt *)expr;
+    find_assignments(stmt->condition);
+    return find_assignments(stmt->body);
+  }
+  case FOR_STMT: {
+    ForStmt *stmt = (ForStmt *)expr;
+    if (stmt->scope_size > 0)
+      declarations.emplace_back(stmt->scope_size, nullptr);
+    if (stmt->initializer != nullptr)
+      find_assignments(stmt->initializer);
+    find_assignments(stmt->condition);
+    find_assignments(stmt->body);
+    if (stmt->increment != nullptr)
+      find_assignments(stmt->increment);
+    if (stmt->scope_size > 0)
+      declarations.pop_back();
+    return;
+  }
+  case RETURN_STMT:
+    return find_assignments(((ReturnStmt *)expr)->value);
+  case CLASS_STMT: {
+    ClassStmt *stmt = (ClassStmt *)expr;
+    if (stmt->resolved.is_global())
+      ++global_declarations[stmt->resolved.slot];
+    for (FunctionDeclarationStmt *method : stmt->methods)
+      find_assignments(method);
+    return;
+  }
+  case FUNCTION_DECLARATION_STMT: {
+    FunctionDeclarationStmt *stmt = (FunctionDeclarationStmt *)expr;
+    if (stmt->resolved.is_global())
+      ++global_declarations[stmt->resolved.slot];
+    return find_assignments(stmt);
+  }
+
+  default:
+    return;
+  }
+}
+
+LiteralExpr *Optimizer::constant_of(const VariableSlot &resolved) {
+  if (resolved.is_global()) {
+    auto constant = global_constants.find(resolved.slot);
+    return constant != global_constants.end() ? constant->second : nullptr;
+  }
+  return constants[constants.size() - 1 - resolved.depth][resolved.slot];
+}
+
+// Mirrors the number and equality operators on Value, which compute in
+// double precision, and gives up wherever those would throw.
+LiteralExpr *Optimizer::fold_binary(TokenType op, const Literal &left,
+                                    const Literal &right) {
+  Arena &arena = program.arena;
+
+  if (left.type == NUM && right.type == NUM) {
+    double l = std::get<double>(left.value);
+    double r = std::get<double>(right.value);
+
+    switch (op) {
+    case MINUS:
+      return arena.make<LiteralExpr>(Literal(l - r));
+    case SLASH:
+      return arena.make<LiteralExpr>(Literal(l / r));
+    case STAR:
+      return arena.make<LiteralExpr>(Literal(l * r));
+    case PLUS:
+      return arena.make<LiteralExpr>(Literal(l + r));
+    case GREATER:
+      return arena.make<LiteralExpr>(Literal(l > r));
+    case GREATER_EQUAL:
+      return arena.make<LiteralExpr>(Literal(l >= r));
+    case LESS:
+      return arena.make<LiteralExpr>(Literal(l < r));
+    case LESS_EQUAL:
+      return arena.make<LiteralExpr>(Literal(l <= r));
+    case EQUAL_EQUAL:
+      return arena.make<LiteralExpr>(Literal(l == r));
+    case BANG_EQUAL:
+      return arena.make<LiteralExpr>(Literal(l != r));
+    default:
+      return nullptr;
+    }
+  }
+
+  if ((op != EQUAL_EQUAL && op != BANG_EQUAL) || left.type != right.type ||
+      left.type == NUM)
+    return nullptr;
+
+  bool equal = true;
+  if (left.type == STR)
+    equal = std::get<std::string_view>(left.value) ==
+            std::get<std::string_view>(right.value);
+  else if (left.type == BOOL)
+    equal = std::get<bool>(left.value) == std::get<bool>(right.value);
+
+  return arena.make<LiteralExpr>(Literal(op == EQUAL_EQUAL ? equal : !equal));
+}
+
+LiteralExpr *Optimizer::fold_unary(TokenType op, const Literal &right) {
+  if (op == BANG)
+    return program.arena.make<LiteralExpr>(Literal(!is_truthy(right)));
+
+  // Negation is subtraction from zero at run time, which keeps -0 from
+  // appearing where the evaluator would produce 0.
+  if (op == MINUS && right.type == NUM)
+    return program.arena.make<LiteralExpr>(
+        Literal(0.0 - std::get<double>(right.value)));
+
+  return nullptr;
+}
+
+std::span<Statement *>
+Optimizer::optimize_statements(std::span<Statement *> statements) {
+  size_t kept = 0;
+  for (Statement *stmt : statements) {
+    Statement *optimized = optimize_statement(stmt);
+    if (optimized != nullptr)
+      statements[kept++] = optimized;
+  }
+  return statements.first(kept);
+}
+
+void Optimizer::optimize_function(FunctionDeclarationStmt *function) {
+  constants.emplace_back(function->scope_size, nullptr);
+  function->body = optimize_statements(function->body);
+  constants.pop_back();
+}
+
+// Returns the replacement for `stmt`, or null if it can be dropped.
+Statement *Optimizer::optimize_statement(Statement *stmt) {
+  Arena &arena = program.arena;
+
+  switch (stmt->getType()) {
+  case EXPRESSION_STMT: {
+    ExpressionStmt *expression = (ExpressionStmt *)stmt;
+    expression->expression = optimize(expression->expression);
+    return is_literal(expression->expression) ? nullptr : stmt;
+  }
+  case PRINT_STMT: {
+    PrintStmt *print = (PrintStmt *)stmt;
+    print->expression = optimize(print->expression);
+    return stmt;
+  }
+  case VARIABLE_DECLARATION_STMT: {
+    VariableDeclarationStmt *declaration = (VariableDeclarationStmt *)stmt;
+    declaration->initializer = optimize(declaration->initializer);
+    if (!is_literal(declaration->initializer))
+      return stmt;
+
+    LiteralExpr *value = (LiteralExpr *)declaration->initializer;
+    int slot = declaration->resolved.slot;
+    if (!declaration->resolved.is_global()) {
+      if (!assigned.count(declaration))
+        constants.back()[slot] = value;
+    } else if (global_declarations[slot] == 1 &&
+               !assigned_globals.count(slot)) {
+      // Only code after the declaration sees the constant, which is all the
+      // code that can run after it.
+      global_constants[slot] = value;
+    }
+    return stmt;
+  }
+  case ASSIGNMENT_STMT: {
+    AssignmentStmt *assignment = (AssignmentStmt *)stmt;
+    assignment->value = optimize(assignment->value);
+    return stmt;
+  }
+  case BLOCK_STMT: {
+    BlockStmt *block = (BlockStmt *)stmt;
+    if (block->scope_size > 0)
+      constants.emplace_back(block->scope_size, nullptr);
+    block->statements = optimize_statements(block->statements);
+    if (block->scope_size > 0)
+      constants.pop_back();
+    return block->statements.empty() ? nullptr : stmt;
+  }
+  case IF_STMT: {
+    IfStmt *branch = (IfStmt *)stmt;
+    Expression *condition = optimize(branch->condition);
+    Statement *then_branch = optimize_statement(branch->then_branch);
+    Statement *else_branch = branch->else_branch == nullptr
+                                 ? nullptr
+                                 : optimize_statement(branch->else_branch);
+
+    if (is_literal(condition)) {
+      Statement *taken = is_truthy(((LiteralExpr *)condition)->value)
+                             ? then_branch
+                             : else_branch;
+      if (taken == nullptr || !is_declaration(taken))
+        return taken;
+    }
+
+    if (then_branch == nullptr && else_branch == nullptr)
+      return arena.make<ExpressionStmt>(condition);
+    if (then_branch == nullptr)
+      then_branch = arena.make<BlockStmt>(std::span<Statement *>());
+
+    branch->condition = condition;
+    branch->then_branch = then_branch;
+    branch->else_branch = else_branch;
+    return stmt;
+  }
+  case WHILE_STMT: {
+    WhileStmt *loop = (WhileStmt *)stmt;
+    loop->condition = optimize(loop->condition);
+    if (is_literal(loop->condition) &&
+        !is_truthy(((LiteralExpr *)loop->condition)->value))
+      return nullptr;
+
+    Statement *body = optimize_statement(loop->body);
+    loop->body =
+        body != nullptr ? body : arena.make<BlockStmt>(std::span<Statement *>());
+    return stmt;
+  }
+  case FOR_STMT: {
+    ForStmt *loop = (ForStmt *)stmt;
+    if (loop->scope_size > 0)
+      constants.emplace_back(loop->scope_size, nullptr);
+
+    if (loop->initializer != nullptr)
+      loop->initializer = optimize_statement(loop->initializer);
+    loop->condition = optimize(loop->condition);
+    Statement *body = optimize_statement(loop->body);
+    loop->body =
+        body != nullptr ? body : arena.make<BlockStmt>(std::span<Statement *>());
+    if (loop->increment != nullptr)
+      loop->increment = optimize(loop->increment);
+
+    if (loop->scope_size > 0)
+      constants.pop_back();
+
+    bool never_runs = is_literal(loop->condition) &&
+                      !is_truthy(((LiteralExpr *)loop->condition)->value);
+    if (never_runs && loop->initializer == nullptr)
+      return nullptr;
+    return stmt;
+  }
+  case RETURN_STMT: {
+    ReturnStmt *return_ = (ReturnStmt *)stmt;
+    return_->value = optimize(return_->value);
+    return stmt;
+  }
+  case CLASS_STMT: {
+    for (FunctionDeclarationStmt *method : ((ClassStmt *)stmt)->methods)
+      optimize_function(method);
+    return stmt;
+  }
+  case FUNCTION_DECLARATION_STMT:
+    optimize_function((FunctionDeclarationStmt *)stmt);
+    return stmt;
+
+  default:
+    // A bare expression at the top level of the program.
+    return (Statement *)optimize(stmt);
+  }
+}
+
+// Returns the replacement for `expr`, which may be `expr` itself.
+Expression *Optimizer::optimize(Expression *expr) {
+  Arena &arena = program.arena;
+
+  switch (expr->getType()) {
+  case BINARY_EXPR: {
+    BinaryExpr *binary = (BinaryExpr *)expr;
+    Expression *left = optimize(&binary->left);
+    Expression *right = optimize(&binary->right);
+
+    if (is_literal(left) && is_literal(right)) {
+      LiteralExpr *folded = fold_binary(binary->op.type,
+                                        ((LiteralExpr *)left)->value,
+                                        ((LiteralExpr *)right)->value);
+      if (folded != nullptr)
+        return folded;
+    }
+
+    if (left == &binary->left && right == &binary->right)
+      return expr;
+    return arena.make<BinaryExpr>(*left, binary->op, *right);
+  }
+  case GROUPING_EXPR:
+    // Parentheses only matter to the parser.
+    return optimize(&((GroupingExpr *)expr)->expr);
+  case UNARY_EXPR: {
+    UnaryExpr *unary = (UnaryExpr *)expr;
+    Expression *right = optimize(&unary->right);
+
+    if (is_literal(right)) {
+      LiteralExpr *folded =
+          fold_unary(unary->op.type, ((LiteralExpr *)right)->value);
+      if (folded != nullptr)
+        return folded;
+    }
+
+    if (right == &unary->right)
+      return expr;
+    return arena.make<UnaryExpr>(unary->op, *right);
+  }
+  case CALL_EXPR: {
+    CallExpr *call = (CallExpr *)expr;
+    call->callee = optimize(call->callee);
+    for (Expression *&argument : call->arguments)
+      argument = optimize(argument);
+    return expr;
+  }
+  case VARIABLE_REFERENCE_EXPR: {
+    LiteralExpr *constant =
+        constant_of(((VariableReferenceExpr *)expr)->resolved);
+    return constant != nullptr ? constant : expr;
+  }
+  case GET_EXPR: {
+    GetExpr *get = (GetExpr *)expr;
+    get->obj = optimize(get->obj);
+    return expr;
+  }
+  case SET_EXPR: {
+    SetExpr *set = (SetExpr *)expr;
+    set->obj = optimize(set->obj);
+    set->value = optimize(set->value);
+    return expr;
+  }
+  case ARRAY_EXPR: {
+    ArrayExpr *array = (ArrayExpr *)expr;
+    array->length = optimize(array->length);
+    for (Expression *&value : array->values)
+      value = optimize(value);
+    return expr;
+  }
+  case INDEX_EXPR: {
+    IndexExpr *index = (IndexExpr *)expr;
+    index->obj = optimize(index->obj);
+    index->index = optimize(index->index);
+    return expr;
+  }
+  case SET_INDEX_EXPR: {
+    SetIndexExpr *set = (SetIndexExpr *)expr;
+    set->obj = optimize(set->obj);
+    set->index = optimize(set->index);
+    set->value = optimize(set->value);
+    return expr;
+  }
+
+  default:
+    return expr;
+  }
+}
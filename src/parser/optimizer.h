@@ -0,0 +1,54 @@
+#pragma once
+
+#include "expression.h"
+#include "program.h"
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Simplifies a resolved program in place before it runs:
+//   - arithmetic, comparisons and `!` over literals are folded,
+//   - variables initialized with a literal and never assigned afterwards are
+//     replaced by that literal wherever they are read,
+//   - `if` and `while` statements whose condition is a literal lose the code
+//     that can never run, and empty blocks and statements without effect are
+//     dropped; an `if` without an else branch is left with a null one.
+// Nothing that could throw is folded, so a program still fails at the same
+// point it would have without optimizing. Replacement nodes are allocated in
+// the program's arena.
+class Optimizer {
+public:
+  Optimizer(Program &program) : program(program) {}
+
+  void optimize();
+
+private:
+  void find_assignments(Expression *expr);
+  void find_assignments(FunctionDeclarationStmt *function);
+
+  Expression *optimize(Expression *expr);
+  Statement *optimize_statement(Statement *stmt);
+  std::span<Statement *> optimize_statements(std::span<Statement *> statements);
+  void optimize_function(FunctionDeclarationStmt *function);
+  LiteralExpr *constant_of(const VariableSlot &resolved);
+
+  LiteralExpr *fold_binary(TokenType op, const Literal &left,
+                           const Literal &right);
+  LiteralExpr *fold_unary(TokenType op, const Literal &right);
+
+  Program &program;
+
+  // Local scopes, mirroring the resolver's: the declaration behind each slot
+  // while looking for assignments, then each slot's known constant. Blocks
+  // and loops with a scope size of zero have none.
+  std::vector<std::vector<VariableDeclarationStmt *>> declarations;
+  std::vector<std::vector<LiteralExpr *>> constants;
+
+  std::unordered_set<VariableDeclarationStmt *> assigned;
+  // Globals are keyed by their slot in the global table. One may be declared
+  // more than once, so it only counts as constant if it is declared once.
+  std::unordered_map<int, int> global_declarations;
+  std::unordered_set<int> assigned_globals;
+  std::unordered_map<int, LiteralExpr *> global_constants;
+};
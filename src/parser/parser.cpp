@@ -21,7 +21,7 @@ Expression *Parser::block() {
   while (!check(RIGHT_BRACE) && !is_at_end())
     statements.push_back((Statement *)declaration());
   consume(RIGHT_BRACE, "Expect '}' after block.");
-  return new BlockStmt(statements);
+  return arena.make<BlockStmt>(arena.copy(statements));
 }
 
 Expression *Parser::if_statement() {
@@ -30,14 +30,11 @@ Expression *Parser::if_statement() {
   consume(RIGHT_PAREN, "Expect ')' after if condition.");
 
   Expression *then_branch = statement();
-  Expression *else_branch = new BlockStmt({});
+  Expression *else_branch = match(ELSE)
+                                ? statement()
+                                : arena.make<BlockStmt>(std::span<Statement *>());
 
-  if (match(ELSE)) {
-    delete else_branch;
-    else_branch = statement();
-  }
-
-  return new IfStmt(condition, (Statement *)then_branch,
+  return arena.make<IfStmt>(condition, (Statement *)then_branch,
                     (Statement *)else_branch);
 }
 
@@ -48,7 +45,7 @@ Expression *Parser::while_statement() {
 
   Expression *body = statement();
 
-  return new WhileStmt(condition, (Statement *)body);
+  return arena.make<WhileStmt>(condition, (Statement *)body);
 }
 
 Expression *Parser::function(std::string type) {
@@ -66,28 +63,26 @@ Expression *Parser::function(std::string type) {
   consume(LEFT_BRACE, "Expect '{' before function body.");
 
   BlockStmt *body = (BlockStmt *)block();
-  return new FunctionDeclarationStmt(name, parameters, body->statements);
+  return arena.make<FunctionDeclarationStmt>(name, arena.copy(parameters),
+                                             body->statements);
 }
 
 Expression *Parser::class_statement() {
   Token name = consume(IDENTIFIER, "Expect class name.");
   consume(LEFT_BRACE, "Expect '{' after class name.");
-  std::vector<FunctionDeclarationStmt> methods;
+  std::vector<FunctionDeclarationStmt *> methods;
   while (!check(RIGHT_BRACE) && !is_at_end())
-    methods.push_back(*(FunctionDeclarationStmt *)function("method"));
+    methods.push_back((FunctionDeclarationStmt *)function("method"));
   consume(RIGHT_BRACE, "Expect '}' after methods.");
-  return new ClassStmt(name, methods);
+  return arena.make<ClassStmt>(name, arena.copy(methods));
 }
 
 Expression *Parser::return_statement() {
   Token keyword = previous_token();
-  Expression *value = new LiteralExpr();
-  if (!check(SEMICOLON)) {
-    delete value;
-    value = expression();
-  }
+  Expression *value =
+      check(SEMICOLON) ? arena.make<LiteralExpr>() : expression();
   consume(SEMICOLON, "Expect ';' after return value.");
-  return new ReturnStmt(keyword, value);
+  return arena.make<ReturnStmt>(keyword, value);
 }
 
 Expression *Parser::statement() {
@@ -112,74 +107,46 @@ Expression *Parser::statement() {
 }
 
 Expression *Parser::for_statement() {
+  Token keyword = previous_token();
   consume(LEFT_PAREN, "Expect '(' after 'for'.");
 
-  bool set_increment, set_initializer, set_condition = false;
-
-  Expression *initializer = new LiteralExpr();
-  if (match(VAR)) {
-    delete initializer;
+  Expression *initializer = nullptr;
+  if (match(VAR))
     initializer = variable_declaration();
-    set_initializer = true;
-  } else {
-    delete initializer;
+  else if (!match(SEMICOLON))
     initializer = expression_statement();
-    set_initializer = true;
-  }
-
-  Expression *condition = new LiteralExpr();
-  if (!check(SEMICOLON)) {
-    delete condition;
-    condition = expression();
-    set_condition = true;
-  }
 
+  // A missing condition is nil, so the loop never runs.
+  Expression *condition =
+      check(SEMICOLON) ? arena.make<LiteralExpr>() : expression();
   consume(SEMICOLON, "Expect ';' after for loop condition.");
 
-  Expression *increment = new LiteralExpr();
-  if (!check(RIGHT_PAREN)) {
-    delete increment;
-    increment = expression();
-    set_increment = true;
-  }
-
+  Expression *increment = check(RIGHT_PAREN) ? nullptr : expression();
   consume(RIGHT_PAREN, "Expect ')' after for clauses.");
 
   Statement *body = (Statement *)statement();
 
-  if (set_increment)
-    body = new BlockStmt({(Statement *)body, new ExpressionStmt(increment)});
-
-  if (!set_condition) {
-    delete condition;
-    condition = new LiteralExpr();
-  }
-
-  body = new WhileStmt(condition, body);
-
-  if (set_initializer)
-    body = new BlockStmt({(Statement *)initializer, body});
-
-  return body;
+  return arena.make<ForStmt>(keyword, (Statement *)initializer, condition,
+                             increment, body);
 }
 
 Expression *Parser::expression_statement() {
   Expression *expr = expression();
   consume(SEMICOLON, "Expect ';' after expression.");
-  return new ExpressionStmt(expr);
+  return arena.make<ExpressionStmt>(expr);
 }
 
 Expression *Parser::print_statement() {
   Expression *expr = expression();
   consume(SEMICOLON, "Expect ';' after expression.");
-  return new PrintStmt(expr);
+  return arena.make<PrintStmt>(expr);
 }
 
 Expression *Parser::variable_declaration() {
   Token name = consume(IDENTIFIER, "Expected variable name.");
 
   bool initializer_set = false;
-  Expression *initializer = new LiteralExpr();
+  Expression *initializer = nullptr;
 
   if (match(LEFT_BRACK)) {
     ArrayExpr *arrLenSpecifier = (ArrayExpr *)array();
@@ -189,7 +156,8 @@ Expression *Parser::variable_declaration() {
 
     auto arrLen = arrLenSpecifier->values[0];
     consume(RIGHT_BRACK, "Expect ']' after array length specifier.");
-    initializer = new ArrayExpr(arrLen);
+    initializer = arena.make<ArrayExpr>(std::span<Expression *>(), arrLen,
+                                        arrLenSpecifier->bracket);
 
     initializer_set = true;
   }
@@ -207,8 +175,11 @@ Expression *Parser::variable_declaration() {
     }
   }
 
+  if (initializer == nullptr)
+    initializer = arena.make<LiteralExpr>();
+
   consume(SEMICOLON, "Expect ';' after variable declaration.");
-  return new VariableDeclarationStmt(name, initializer);
+  return arena.make<VariableDeclarationStmt>(name, initializer);
 }
 
 Expression *Parser::expression() { return assignment(); }
@@ -223,13 +194,13 @@ Expression *Parser::assignment() {
     if (expr->getType() == VARIABLE_REFERENCE_EXPR) {
       VariableReferenceExpr *v = (VariableReferenceExpr *)expr;
       Token name = v->op;
-      return new AssignmentStmt(name, value);
+      return arena.make<AssignmentStmt>(name, value);
     } else if (expr->getType() == GET_EXPR) {
       GetExpr *v = (GetExpr *)expr;
-      return new SetExpr(v->obj, v->name, value);
+      return arena.make<SetExpr>(v->obj, v->name, value);
     } else if (expr->getType() == INDEX_EXPR) {
       IndexExpr *v = (IndexExpr *)expr;
-      return new SetIndexExpr(v->obj, v->index, value);
+      return arena.make<SetIndexExpr>(v->obj, v->index, value);
     }
 
     throw "Invalid assignment target";
@@ -239,32 +210,35 @@ Expression *Parser::assignment() {
 }
 
 Expression *Parser::array() {
+  Token bracket = previous_token();
   std::vector<Expression *> values;
-  if (!check(RIGHT_PAREN)) {
+  if (!check(RIGHT_BRACK)) {
     do {
       values.push_back(expression());
     } while (match(COMMA));
   }
-  return new ArrayExpr(values);
+  return arena.make<ArrayExpr>(arena.copy(values),
+                               arena.make<LiteralExpr>((double)values.size()),
+                               bracket);
 }
 
 Expression *Parser::primary() {
   if (match(FALSE))
-    return new LiteralExpr(false);
+    return arena.make<LiteralExpr>(false);
 
   if (match(TRUE))
-    return new LiteralExpr(true);
+    return arena.make<LiteralExpr>(true);
 
   if (match(NIL))
-    return new LiteralExpr(Literal{});
+    return arena.make<LiteralExpr>(Literal{});
 
   if (match({NUMBER, STRING}))
-    return new LiteralExpr(previous_token().literal);
+    return arena.make<LiteralExpr>(previous_token().literal());
 
   if (match(LEFT_PAREN)) {
     Expression *expr = expression();
     consume(RIGHT_PAREN, "Expect ')' after expression.");
-    return new GroupingExpr(*expr);
+    return arena.make<GroupingExpr>(*expr);
   }
 
   if (match(LEFT_BRACK)) {
@@ -274,19 +248,19 @@ Expression *Parser::primary() {
   }
 
   if (match(IDENTIFIER))
-    return new VariableReferenceExpr(previous_token());
+    return arena.make<VariableReferenceExpr>(previous_token());
 
   if (match(THIS))
-    return new ThisExpr(previous_token());
+    return arena.make<ThisExpr>(previous_token());
 
-  return new LiteralExpr();
+  return arena.make<LiteralExpr>();
 }
 
 Expression *Parser::unary() {
   if (match({BANG, MINUS})) {
     Token op = previous_token();
     Expression *right = unary();
-    return new UnaryExpr(op, *right);
+    return arena.make<UnaryExpr>(op, *right);
   }
   return call();
 }
@@ -299,10 +273,11 @@ Expression *Parser::call() {
       expr = finish_call(expr);
     } else if (match(DOT)) {
       Token name = consume(IDENTIFIER, "Expect property name after '.'.");
-      expr = new GetExpr(expr, name);
+      expr = arena.make<GetExpr>(expr, name);
     } else if (match(LEFT_BRACK)) {
+      Token bracket = previous_token();
       Expression *index = expression();
-      expr = new IndexExpr(expr, index);
+      expr = arena.make<IndexExpr>(expr, index, bracket);
       consume(RIGHT_BRACK, "Expect ']' after index.");
     } else {
       break;
@@ -320,7 +295,7 @@ Expression *Parser::finish_call(Expression *callee) {
     } while (match(COMMA));
   }
   Token paren = consume(RIGHT_PAREN, "Expect ')' after arguments.");
-  return new CallExpr(callee, paren, arguments);
+  return arena.make<CallExpr>(callee, paren, arena.copy(arguments));
 }
 
 Expression *Parser::factor() {
@@ -328,7 +303,7 @@ Expression *Parser::factor() {
   while (match({SLASH, STAR})) {
     Token op = previous_token();
     Expression *right = unary();
-    expr = new BinaryExpr(*expr, op, *right);
+    expr = arena.make<BinaryExpr>(*expr, op, *right);
   }
   return expr;
 }
@@ -338,7 +313,7 @@ Expression *Parser::comparison() {
   while (match({GREATER, GREATER_EQUAL, LESS, LESS_EQUAL})) {
     Token op = previous_token();
     Expression *right = term();
-    expr = new BinaryExpr(*expr, op, *right);
+    expr = arena.make<BinaryExpr>(*expr, op, *right);
   }
   return expr;
 }
@@ -348,7 +323,7 @@ Expression *Parser::term() {
   while (match({PLUS, MINUS})) {
     Token op = previous_token();
     Expression *right = factor();
-    expr = new BinaryExpr(*expr, op, *right);
+    expr = arena.make<BinaryExpr>(*expr, op, *right);
   }
   return expr;
 }
@@ -358,7 +333,7 @@ Expression *Parser::equality() {
   while (match({BANG_EQUAL, EQUAL_EQUAL})) {
     Token op = previous_token();
     Expression *right = comparison();
-    expr = new BinaryExpr(*expr, op, *right);
+    expr = arena.make<BinaryExpr>(*expr, op, *right);
   }
   return expr;
 }
@@ -1,14 +1,18 @@
 #pragma once
 
+#include "../arena.h"
 #include "../lexer.h"
 #include "expression.h"
 #include <vector>
 
+// Builds the syntax tree in `arena`, which is usually a Program's.
 class Parser {
 public:
-  Parser(std::vector<Token> tokens) : tokens(tokens), current(0) {}
+  Parser(std::vector<Token> tokens, Arena &arena)
+      : tokens(std::move(tokens)), arena(arena), current(0) {}
 
   std::vector<Token> tokens;
+  Arena &arena;
   int current;
 
   std::vector<Expression *> parse();
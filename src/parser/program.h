@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../arena.h"
+#include "expression.h"
+#include <vector>
+
+// A parsed program. Every node of its syntax tree lives in `arena` and is
+// freed along with the program. Tokens, and so the nodes, point into the
+// source text, which has to outlive the program.
+class Program {
+public:
+  Program() = default;
+  Program(const Program &) = delete;
+  Program &operator=(const Program &) = delete;
+
+  Arena arena;
+  std::vector<Expression *> statements;
+};
@@ -0,0 +1,333 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <sys/time.h>
+#include <unordered_map>
+#include <unordered_set>
+
+static const uint32_t INDEX_SIZE = Profiler::MAX_NODES * 2;
+
+static Profiler *volatile active_profiler = nullptr;
+static struct sigaction previous_action;
+
+static void handle_sigprof(int) {
+  int saved_errno = errno;
+  if (active_profiler != nullptr)
+    active_profiler->sample();
+  errno = saved_errno;
+}
+
+// ===============
+// === LineMap ===
+// ===============
+
+LineMap::LineMap(std::string_view source) {
+  starts.push_back(0);
+  for (size_t i = 0; i < source.size(); ++i)
+    if (source[i] == '\n')
+      starts.push_back(i + 1);
+}
+
+int LineMap::line_of(int position) const {
+  if (starts.empty())
+    return position;
+  return std::upper_bound(starts.begin(), starts.end(), (uint32_t)position) -
+         starts.begin();
+}
+
+// ===================
+// === ShadowStack ===
+// ===================
+
+int ShadowStack::capture_stack(ProfileFrame *out, int capacity) {
+  int count = std::min((int)depth, MAX_DEPTH);
+  int first = std::max(0, count - capacity);
+
+  for (int i = first; i < count; ++i)
+    out[i - first] = frames[i];
+  if (count == depth)
+    out[count - 1 - first].line = *position;
+
+  for (int i = 0; i < count - first; ++i)
+    out[i].line = lines.line_of(out[i].line);
+  return count - first;
+}
+
+// ================
+// === Profiler ===
+// ================
+
+Profiler::Profiler(ProfileSource *source)
+    : source(source), nodes(new Node[MAX_NODES]),
+      index(new uint32_t[INDEX_SIZE]()), names(new char[NAME_BYTES]) {
+  nodes[0] = Node{0, 0, 0, 0, 0};
+}
+
+Profiler::~Profiler() { stop(); }
+
+void Profiler::start(int frequency) {
+  if (active_profiler != nullptr)
+    throw "A profiler is already running.";
+
+  struct sigaction action = {};
+  action.sa_handler = handle_sigprof;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, &previous_action) != 0)
+    throw "Could not install the profiler's signal handler.";
+
+  this->frequency = frequency;
+  active_profiler = this;
+  running = true;
+
+  // tv_usec must stay below a second, so slow rates need tv_sec as well.
+  long interval = std::max(1, 1000000 / frequency);
+  struct itimerval timer = {};
+  timer.it_interval.tv_sec = interval / 1000000;
+  timer.it_interval.tv_usec = interval % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    stop();
+    throw "Could not start the profiler's timer.";
+  }
+}
+
+void Profiler::stop() {
+  if (!running)
+    return;
+
+  struct itimerval timer = {};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  sigaction(SIGPROF, &previous_action, nullptr);
+  active_profiler = nullptr;
+  running = false;
+}
+
+void Profiler::sample() {
+  ProfileFrame frames[MAX_SAMPLE_DEPTH];
+  int depth = source->capture_stack(frames, MAX_SAMPLE_DEPTH);
+  if (depth == 0)
+    return;
+
+  uint32_t node = 0;
+  for (int i = 0; i < depth; ++i) {
+    node = child_of(node, frames[i]);
+    if (node == 0) {
+      ++dropped;
+      return;
+    }
+  }
+
+  ++nodes[node].samples;
+  ++samples;
+}
+
+// Finds or adds the node for `frame` under `parent`, or returns 0 if there
+// is no room left for it.
+uint32_t Profiler::child_of(uint32_t parent, const ProfileFrame &frame) {
+  uint32_t hash = 2166136261u;
+  for (char c : frame.name)
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  hash = (hash ^ parent) * 16777619u;
+  hash = (hash ^ (uint32_t)frame.line) * 16777619u;
+
+  for (uint32_t slot = hash & (INDEX_SIZE - 1);;
+       slot = (slot + 1) & (INDEX_SIZE - 1)) {
+    uint32_t candidate = index[slot];
+    if (candidate == 0)
+      break;
+
+    const Node &node = nodes[candidate];
+    if (node.parent == parent && node.line == frame.line &&
+        name_of(node) == frame.name)
+      return candidate;
+  }
+
+  if (node_count == MAX_NODES ||
+      names_used + frame.name.size() > NAME_BYTES)
+    return 0;
+
+  uint32_t created = node_count++;
+  memcpy(&names[names_used], frame.name.data(), frame.name.size());
+  nodes[created] = Node{parent, names_used, (uint32_t)frame.name.size(),
+                        frame.line, 0};
+  names_used += frame.name.size();
+
+  // At most half the index is ever in use, so probing always ends.
+  uint32_t slot = hash & (INDEX_SIZE - 1);
+  while (index[slot] != 0)
+    slot = (slot + 1) & (INDEX_SIZE - 1);
+  index[slot] = created;
+  return created;
+}
+
+std::string_view Profiler::name_of(const Node &node) const {
+  return std::string_view(&names[node.name_offset], node.name_length);
+}
+
+std::string Profiler::label_of(const Node &node) const {
+  return std::string(name_of(node)) + ":" + std::to_string(node.line);
+}
+
+void Profiler::write_folded(FILE *out) const {
+  std::vector<uint32_t> path;
+  for (uint32_t i = 1; i < node_count; ++i) {
+    if (nodes[i].samples == 0)
+      continue;
+
+    path.clear();
+    for (uint32_t node = i; node != 0; node = nodes[node].parent)
+      path.push_back(node);
+
+    for (size_t j = path.size(); j-- > 0;)
+      fprintf(out, "%s%s", label_of(nodes[path[j]]).c_str(),
+              j == 0 ? "" : ";");
+    fprintf(out, " %llu\n", (unsigned long long)nodes[i].samples);
+  }
+}
+
+struct ProfileRow {
+  std::string label;
+  uint64_t self = 0;
+  uint64_t total = 0;
+};
+
+static void print_rows(FILE *out, std::vector<ProfileRow> rows, int top,
+                       uint64_t samples, const char *heading,
+                       bool with_total) {
+  std::sort(rows.begin(), rows.end(),
+            [](const ProfileRow &a, const ProfileRow &b) {
+              if (a.self != b.self)
+                return a.self > b.self;
+              return a.total > b.total;
+            });
+
+  fprintf(out, "%10s %7s", "self", "self%");
+  if (with_total)
+    fprintf(out, " %10s %7s", "total", "total%");
+  fprintf(out, "  %s\n", heading);
+
+  for (int i = 0; i < top && i < (int)rows.size(); ++i) {
+    const ProfileRow &row = rows[i];
+    fprintf(out, "%10llu %6.1f%%", (unsigned long long)row.self,
+            100.0 * row.self / samples);
+    if (with_total)
+      fprintf(out, " %10llu %6.1f%%", (unsigned long long)row.total,
+              100.0 * row.total / samples);
+    fprintf(out, "  %s\n", row.label.c_str());
+  }
+}
+
+void Profiler::print_report(FILE *out, int top) const {
+  fprintf(out, "-- profile --\n");
+  fprintf(out, "samples:           %llu at %d Hz\n",
+          (unsigned long long)samples, frequency);
+  if (dropped > 0)
+    fprintf(out, "dropped:           %llu\n", (unsigned long long)dropped);
+  if (samples == 0)
+    return;
+
+  std::unordered_map<std::string, ProfileRow> functions;
+  std::unordered_map<std::string, ProfileRow> lines;
+  std::unordered_set<std::string_view> on_stack;
+
+  for (uint32_t i = 1; i < node_count; ++i) {
+    uint64_t count = nodes[i].samples;
+    if (count == 0)
+      continue;
+
+    std::string name(name_of(nodes[i]));
+    functions[name].self += count;
+    lines[label_of(nodes[i])].self += count;
+
+    // A recursive function is only charged once per sample.
+    on_stack.clear();
+    for (uint32_t node = i; node != 0; node = nodes[node].parent)
+      if (on_stack.insert(name_of(nodes[node])).second)
+        functions[std::string(name_of(nodes[node]))].total += count;
+  }
+
+  std::vector<ProfileRow> function_rows;
+  for (auto &function : functions) {
+    function.second.label = function.first;
+    function_rows.push_back(function.second);
+  }
+  std::vector<ProfileRow> line_rows;
+  for (auto &line : lines) {
+    line.second.label = line.first;
+    line_rows.push_back(line.second);
+  }
+
+  print_rows(out, function_rows, top, samples, "function", true);
+  print_rows(out, line_rows, top, samples, "line", false);
+}
+
+// ==========================
+// === AllocationProfiler ===
+// ==========================
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void AllocationProfiler::record(size_t bytes) {
+  AllocationSite site = source->allocation_site();
+  Count &count = sites[{site.kind, site.position}];
+  count.objects += 1;
+  count.bytes += bytes;
+  total.objects += 1;
+  total.bytes += bytes;
+
+  // Reading the clock costs more than counting, so only check it now and
+  // then.
+  if (report_interval_ns > 0 && total.objects % 1024 == 0 &&
+      now_ns() >= next_report_ns) {
+    print_report(stderr, report_top);
+    next_report_ns = now_ns() + report_interval_ns;
+  }
+}
+
+void AllocationProfiler::report_every(double seconds, int top) {
+  report_interval_ns = (int64_t)(seconds * 1e9);
+  next_report_ns = now_ns() + report_interval_ns;
+  report_top = top;
+}
+
+void AllocationProfiler::print_report(FILE *out, int top) const {
+  fprintf(out, "-- allocations --\n");
+  fprintf(out, "objects:           %llu\n", (unsigned long long)total.objects);
+  fprintf(out, "bytes:             %llu\n", (unsigned long long)total.bytes);
+  if (total.objects == 0)
+    return;
+
+  // Positions over a FlatAst may differ within a line, and the same kind may
+  // be spelled by more than one string literal.
+  std::unordered_map<std::string, Count> merged;
+  for (const auto &site : sites) {
+    std::string label = std::string(site.first.first) + ":" +
+                        std::to_string(lines.line_of(site.first.second));
+    Count &count = merged[label];
+    count.objects += site.second.objects;
+    count.bytes += site.second.bytes;
+  }
+
+  std::vector<std::pair<std::string, Count>> rows(merged.begin(),
+                                                  merged.end());
+  std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+    if (a.second.bytes != b.second.bytes)
+      return a.second.bytes > b.second.bytes;
+    return a.first < b.first;
+  });
+
+  fprintf(out, "%10s %12s %7s  %s\n", "objects", "bytes", "bytes%", "site");
+  for (int i = 0; i < top && i < (int)rows.size(); ++i)
+    fprintf(out, "%10llu %12llu %6.1f%%  %s\n",
+            (unsigned long long)rows[i].second.objects,
+            (unsigned long long)rows[i].second.bytes,
+            100.0 * rows[i].second.bytes / total.bytes, rows[i].first.c_str());
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Maps the positions an engine reports to source lines. The tree engine and
+// the VM report lines already; over a FlatAst they are byte offsets, and the
+// map holds the offset at which each line starts.
+class LineMap {
+public:
+  LineMap() {}
+  LineMap(std::string_view source);
+
+  int line_of(int position) const;
+
+private:
+  std::vector<uint32_t> starts;
+};
+
+// One Orca stack frame: the function and the line it is running. The name
+// only has to stay valid while the function is on the stack.
+struct ProfileFrame {
+  std::string_view name;
+  int line;
+};
+
+// An engine whose Orca call stack can be read from a signal handler, which
+// means without allocating, locking or throwing.
+class ProfileSource {
+public:
+  virtual ~ProfileSource() = default;
+
+  // Writes the innermost `capacity` frames of the current stack to `frames`,
+  // outermost first, and returns how many were written.
+  virtual int capture_stack(ProfileFrame *frames, int capacity) = 0;
+};
+
+// The call stack of the tree-walking engines, which have none of their own
+// that a signal handler could inspect. Functions push a frame with a
+// ProfileScope; the top frame's line is read from `position` when sampled,
+// and each push and pop moves `position` to the callee's declaration and
+// back to the caller's call. Frames deeper than MAX_DEPTH are counted but
+// not recorded.
+class ShadowStack : public ProfileSource {
+public:
+  static constexpr int MAX_DEPTH = 4096;
+
+  ShadowStack(int *position)
+      : position(position), frames(new ProfileFrame[MAX_DEPTH]), depth(1) {
+    frames[0] = ProfileFrame{"<script>", 0};
+  }
+
+  void push(std::string_view name, int start) {
+    if (depth < MAX_DEPTH) {
+      frames[depth - 1].line = *position;
+      frames[depth] = ProfileFrame{name, start};
+    }
+    *position = start;
+    // The handler runs on this thread, so it only has to see the frame
+    // written before the depth that makes it visible.
+    std::atomic_signal_fence(std::memory_order_release);
+    depth = depth + 1;
+  }
+
+  void pop() {
+    depth = depth - 1;
+    if (depth < MAX_DEPTH)
+      *position = frames[depth - 1].line;
+  }
+
+  int capture_stack(ProfileFrame *frames, int capacity) override;
+
+  LineMap lines;
+
+private:
+  int *position;
+  std::unique_ptr<ProfileFrame[]> frames;
+  volatile int depth;
+};
+
+// Pushes a frame onto a shadow stack, if there is one, for as long as it is
+// in scope.
+class ProfileScope {
+public:
+  ProfileScope(ShadowStack *stack, std::string_view name, int start)
+      : stack(stack) {
+    if (stack != nullptr)
+      stack->push(name, start);
+  }
+  ~ProfileScope() {
+    if (stack != nullptr)
+      stack->pop();
+  }
+
+private:
+  ShadowStack *stack;
+};
+
+// A sampling profiler. While running, SIGPROF fires `frequency` times per
+// second of CPU time and the handler adds the source's current stack to a
+// call tree. The tree, its node index and the copies of function names are
+// all allocated up front, so sampling never allocates; samples that would
+// need more room are counted as dropped. Only one profiler runs at a time.
+class Profiler {
+public:
+  static constexpr int MAX_SAMPLE_DEPTH = 128;
+  static constexpr uint32_t MAX_NODES = 1 << 16;
+  static constexpr uint32_t NAME_BYTES = 1 << 20;
+
+  Profiler(ProfileSource *source);
+  ~Profiler();
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  void start(int frequency);
+  void stop();
+
+  // Brendan Gregg's folded stack format, one line per distinct stack:
+  // `<script>:12;fib:3;fib:4 57`.
+  void write_folded(FILE *out) const;
+  // The `top` functions by samples spent in them and the `top` lines by
+  // samples spent on them.
+  void print_report(FILE *out, int top) const;
+
+  void sample();
+
+private:
+  // A distinct frame under a distinct parent; node 0 is the root.
+  struct Node {
+    uint32_t parent;
+    uint32_t name_offset;
+    uint32_t name_length;
+    int line;
+    // Samples taken with this as the innermost frame.
+    uint64_t samples;
+  };
+
+  uint32_t child_of(uint32_t parent, const ProfileFrame &frame);
+  std::string_view name_of(const Node &node) const;
+  std::string label_of(const Node &node) const;
+
+  ProfileSource *source;
+  int frequency = 0;
+  bool running = false;
+
+  std::unique_ptr<Node[]> nodes;
+  uint32_t node_count = 1;
+  // Open-addressed index of the nodes by (parent, name, line); zero marks
+  // an empty entry.
+  std::unique_ptr<uint32_t[]> index;
+  std::unique_ptr<char[]> names;
+  uint32_t names_used = 0;
+
+  uint64_t samples = 0;
+  uint64_t dropped = 0;
+};
+
+// What caused an allocation: the kind of node or instruction being run and
+// its position, which a LineMap turns into a line.
+struct AllocationSite {
+  const char *kind;
+  int position;
+};
+
+// An engine that can say which of its nodes or instructions is allocating.
+class AllocationSiteSource {
+public:
+  virtual ~AllocationSiteSource() = default;
+  virtual AllocationSite allocation_site() const = 0;
+};
+
+// Counts the objects and bytes allocated on the runtime heap at each site
+// while it is attached to the heap. Unlike the sampling profiler it sees
+// every allocation, so it runs in the allocating thread and may allocate.
+class AllocationProfiler {
+public:
+  AllocationProfiler(const AllocationSiteSource *source) : source(source) {}
+
+  void record(size_t bytes);
+  // The `top` sites by bytes allocated.
+  void print_report(FILE *out, int top) const;
+  // Also print a report to stderr every `seconds` while allocations happen.
+  void report_every(double seconds, int top);
+
+  LineMap lines;
+
+private:
+  struct Count {
+    uint64_t objects = 0;
+    uint64_t bytes = 0;
+  };
+  struct SiteHash {
+    size_t operator()(const std::pair<const char *, int> &site) const {
+      return std::hash<const char *>()(site.first) * 31 + site.second;
+    }
+  };
+
+  const AllocationSiteSource *source;
+  std::unordered_map<std::pair<const char *, int>, Count, SiteHash> sites;
+  Count total;
+
+  int64_t report_interval_ns = 0;
+  int64_t next_report_ns = 0;
+  int report_top = 0;
+};
@@ -0,0 +1,353 @@
+#include "program_cache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+// Bump whenever the layout of a cache file or of a FlatAst changes.
+static const uint32_t FORMAT_VERSION = 2;
+static const char MAGIC[8] = {'O', 'R', 'C', 'A', 'P', 'R', 'G', '\0'};
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t optimized;
+  uint64_t interpreter_id;
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint64_t payload_hash;
+  uint64_t payload_size;
+};
+
+static_assert(std::is_trivially_copyable_v<SourceSpan>);
+static_assert(std::is_trivially_copyable_v<VariableSlot>);
+static_assert(std::is_trivially_copyable_v<FlatFunction>);
+static_assert(std::is_trivially_copyable_v<Value>);
+
+// FNV-1a over eight bytes at a time, with a fold to mix the high bits back
+// in, so that hashing a source file or cache entry costs a small fraction of
+// parsing it.
+static uint64_t fnv1a(const void *data, size_t size,
+                      uint64_t hash = 14695981039346656037ull) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * 1099511628211ull;
+    hash ^= hash >> 32;
+  }
+  for (; i < size; ++i)
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  return hash;
+}
+
+// Identifies the running interpreter binary, so that rebuilding it discards
+// every cached program.
+static uint64_t interpreter_id() {
+  static uint64_t id = [] {
+    uint64_t hash = fnv1a(&FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    struct stat info;
+    if (stat("/proc/self/exe", &info) == 0) {
+      hash = fnv1a(&info.st_size, sizeof(info.st_size), hash);
+      hash = fnv1a(&info.st_mtim, sizeof(info.st_mtim), hash);
+    }
+    return hash;
+  }();
+  return id;
+}
+
+// ===============
+// === Writing ===
+// ===============
+
+// Arrays are stored as a 64-bit element count followed by their elements,
+// padded to a multiple of 8 bytes.
+static void write_bytes(std::string &out, const void *data, size_t size) {
+  out.append((const char *)data, size);
+  out.append((8 - size % 8) % 8, '\0');
+}
+
+template <typename T>
+static void write_array(std::string &out, const std::vector<T> &values) {
+  uint64_t count = values.size();
+  write_bytes(out, &count, sizeof(count));
+  write_bytes(out, values.data(), values.size() * sizeof(T));
+}
+
+void ProgramCache::save(const FlatAst &ast, const GlobalTable &globals) const {
+  std::string payload;
+  write_array(payload, ast.kinds);
+  write_array(payload, ast.data);
+  write_array(payload, ast.spans);
+  write_array(payload, ast.subtree_end);
+  write_array(payload, ast.statements);
+  write_array(payload, ast.literal_values);
+  write_array(payload, ast.resolved);
+  write_array(payload, ast.functions);
+  write_array(payload, ast.params);
+
+  // Property caches start out empty, so only their number is kept. Their
+  // names are interned again from the source when loading.
+  uint64_t cache_count = ast.caches.size();
+  write_bytes(payload, &cache_count, sizeof(cache_count));
+
+  uint64_t name_count = globals.names.size();
+  write_bytes(payload, &name_count, sizeof(name_count));
+  for (const std::string &name : globals.names) {
+    uint64_t length = name.size();
+    write_bytes(payload, &length, sizeof(length));
+    write_bytes(payload, name.data(), name.size());
+  }
+
+  CacheHeader header = {};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.format_version = FORMAT_VERSION;
+  header.optimized = optimized;
+  header.interpreter_id = interpreter_id();
+  header.source_hash = key_of(ast.source);
+  header.source_size = ast.source.size();
+  header.payload_hash = fnv1a(payload.data(), payload.size());
+  header.payload_size = payload.size();
+
+  // Create every missing directory on the way down.
+  for (size_t slash = directory.find('/', 1); slash != std::string::npos;
+       slash = directory.find('/', slash + 1))
+    mkdir(directory.substr(0, slash).c_str(), 0755);
+  mkdir(directory.c_str(), 0755);
+
+  // Written under a temporary name and renamed into place, so a concurrent
+  // run never sees half a file.
+  std::string path = path_of(ast.source);
+  std::string temporary = path + ".tmp." + std::to_string(getpid());
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
+
+  bool written =
+      write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+      write(fd, payload.data(), payload.size()) == (ssize_t)payload.size();
+  close(fd);
+
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0)
+    unlink(temporary.c_str());
+}
+
+// ===============
+// === Reading ===
+// ===============
+
+class CacheReader {
+public:
+  CacheReader(const char *data, size_t size) : data(data), size(size) {}
+
+  bool read_bytes(void *out, size_t length) {
+    size_t padded = length + (8 - length % 8) % 8;
+    if (padded > size - at)
+      return false;
+    memcpy(out, data + at, length);
+    at += padded;
+    return true;
+  }
+
+  bool read_count(uint64_t &count) { return read_bytes(&count, sizeof(count)); }
+
+  template <typename T> bool read_array(std::vector<T> &values) {
+    uint64_t count;
+    if (!read_count(count) || count > (size - at) / sizeof(T))
+      return false;
+    values.resize(count);
+    return read_bytes(values.data(), count * sizeof(T));
+  }
+
+  bool read_string(std::string &value) {
+    uint64_t length;
+    if (!read_count(length) || length > size - at)
+      return false;
+    value.resize(length);
+    return read_bytes(value.data(), length);
+  }
+
+  bool at_end() const { return at == size; }
+
+private:
+  const char *data;
+  size_t size;
+  size_t at = 0;
+};
+
+// Checks that every subtree, span and table index is in range. The checksum
+// already rules out damage and the header a different layout, so this only
+// guards against a file that was written wrongly in the first place.
+static bool is_consistent(const FlatAst &ast) {
+  size_t count = ast.kinds.size();
+  if (ast.data.size() != count || ast.spans.size() != count ||
+      ast.subtree_end.size() != count)
+    return false;
+
+  for (size_t node = 0; node < count; ++node) {
+    if (ast.subtree_end[node] <= node || ast.subtree_end[node] > count)
+      return false;
+    if (ast.spans[node].offset > ast.source.size() ||
+        ast.spans[node].length > ast.source.size() - ast.spans[node].offset)
+      return false;
+
+    uint32_t data = ast.data[node];
+    switch (ast.kind(node)) {
+    case LITERAL_EXPR:
+      if (data >= ast.literal_values.size())
+        return false;
+      break;
+    case GET_EXPR:
+    case SET_EXPR:
+      if (data >= ast.caches.size())
+        return false;
+      break;
+    case VARIABLE_REFERENCE_EXPR:
+    case THIS_EXPR:
+    case VARIABLE_DECLARATION_STMT:
+    case ASSIGNMENT_STMT:
+    case CLASS_STMT:
+      if (data >= ast.resolved.size())
+        return false;
+      break;
+    case FUNCTION_DECLARATION_STMT:
+      if (data >= ast.functions.size())
+        return false;
+      break;
+    default:
+      break;
+    }
+  }
+
+  for (NodeIndex statement : ast.statements)
+    if (statement >= count)
+      return false;
+  for (const FlatFunction &function : ast.functions)
+    if (function.first_param > ast.params.size() ||
+        function.param_count > ast.params.size() - function.first_param)
+      return false;
+  for (const Value &value : ast.literal_values)
+    if (value.is_object())
+      return false;
+  return true;
+}
+
+bool ProgramCache::load(FlatAst &ast, GlobalTable &globals) const {
+  int fd = open(path_of(ast.source).c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = info.st_size;
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+
+  const char *bytes = (const char *)mapped;
+  CacheHeader header;
+  memcpy(&header, bytes, sizeof(header));
+  const char *payload = bytes + sizeof(header);
+
+  FlatAst loaded(ast.source);
+  std::vector<std::string> names;
+  bool ok =
+      memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+      header.format_version == FORMAT_VERSION &&
+      header.optimized == (uint32_t)optimized &&
+      header.interpreter_id == interpreter_id() &&
+      header.source_size == ast.source.size() &&
+      header.source_hash == key_of(ast.source) &&
+      header.payload_size == size - sizeof(header) &&
+      header.payload_hash == fnv1a(payload, header.payload_size);
+
+  if (ok) {
+    CacheReader reader(payload, header.payload_size);
+    uint64_t cache_count = 0;
+    uint64_t name_count = 0;
+    ok = reader.read_array(loaded.kinds) && reader.read_array(loaded.data) &&
+         reader.read_array(loaded.spans) &&
+         reader.read_array(loaded.subtree_end) &&
+         reader.read_array(loaded.statements) &&
+         reader.read_array(loaded.literal_values) &&
+         reader.read_array(loaded.resolved) &&
+         reader.read_array(loaded.functions) &&
+         reader.read_array(loaded.params) && reader.read_count(cache_count) &&
+         cache_count <= loaded.kinds.size() && reader.read_count(name_count) &&
+         name_count <= header.payload_size;
+
+    for (uint64_t i = 0; ok && i < name_count; ++i) {
+      names.emplace_back();
+      ok = reader.read_string(names.back());
+    }
+    ok = ok && reader.at_end();
+
+    if (ok) {
+      loaded.caches.resize(cache_count);
+      loaded.property_names.resize(cache_count);
+      ok = is_consistent(loaded);
+    }
+  }
+  munmap(mapped, size);
+
+  // The globals known before resolving, the standard library, have to sit in
+  // the same slots they did when the program was resolved.
+  ok = ok && names.size() >= globals.names.size();
+  for (size_t i = 0; ok && i < globals.names.size(); ++i)
+    ok = globals.names[i] == names[i];
+  if (!ok)
+    return false;
+
+  for (const std::string &name : names)
+    globals.index_of(name);
+  for (size_t node = 0; node < loaded.kinds.size(); ++node)
+    if (loaded.kind(node) == GET_EXPR || loaded.kind(node) == SET_EXPR)
+      loaded.property_names[loaded.data[node]] = intern(loaded.text(node));
+
+  ast.kinds = std::move(loaded.kinds);
+  ast.data = std::move(loaded.data);
+  ast.spans = std::move(loaded.spans);
+  ast.subtree_end = std::move(loaded.subtree_end);
+  ast.statements = std::move(loaded.statements);
+  ast.literal_values = std::move(loaded.literal_values);
+  ast.caches = std::move(loaded.caches);
+  ast.property_names = std::move(loaded.property_names);
+  ast.resolved = std::move(loaded.resolved);
+  ast.functions = std::move(loaded.functions);
+  ast.params = std::move(loaded.params);
+  return true;
+}
+
+// =============
+// === Paths ===
+// =============
+
+uint64_t ProgramCache::key_of(std::string_view source) const {
+  return fnv1a(source.data(), source.size());
+}
+
+std::string ProgramCache::path_of(std::string_view source) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx%s.orcc",
+           (unsigned long long)key_of(source), optimized ? "" : "-noopt");
+  return directory + "/" + name;
+}
+
+std::string ProgramCache::default_directory() {
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  if (cache_home != nullptr && cache_home[0] != '\0')
+    return std::string(cache_home) + "/orca";
+
+  const char *home = getenv("HOME");
+  return std::string(home != nullptr ? home : ".") + "/.cache/orca";
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "parser/flat_ast.h"
+#include "variable/global_table.h"
+#include <string>
+#include <string_view>
+
+// Resolved flat programs saved between runs, so that running an unchanged
+// file again skips lexing, parsing, resolving and optimizing. Each program is
+// stored in `directory` under the hash of its source text; a file written by
+// a different build of the interpreter, for a different optimization setting
+// or for other source text is ignored and replaced. Nothing in a cache file
+// is trusted until its header and checksum have been checked.
+class ProgramCache {
+public:
+  ProgramCache(std::string directory, bool optimized)
+      : directory(std::move(directory)), optimized(optimized) {}
+
+  // Fills `ast` with the program cached for its source and gives `globals`
+  // the slots it was resolved against. Returns false, leaving both as they
+  // were, if there is no usable entry.
+  bool load(FlatAst &ast, GlobalTable &globals) const;
+  // Stores a resolved `ast`. A cache that cannot be written is skipped.
+  void save(const FlatAst &ast, const GlobalTable &globals) const;
+
+  // $XDG_CACHE_HOME/orca, or ~/.cache/orca.
+  static std::string default_directory();
+
+private:
+  std::string path_of(std::string_view source) const;
+  uint64_t key_of(std::string_view source) const;
+
+  std::string directory;
+  bool optimized;
+};
@@ -0,0 +1,35 @@
+#include "source_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::SourceFile(const std::string &path) : data(""), size(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw "Could not open file '" + path + "'.";
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    throw "Could not read file '" + path + "'.";
+  }
+
+  // mmap rejects empty mappings; an empty file is just an empty program.
+  if (info.st_size > 0) {
+    void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      throw "Could not read file '" + path + "'.";
+    }
+    data = (const char *)mapped;
+    size = info.st_size;
+  }
+
+  close(fd);
+}
+
+SourceFile::~SourceFile() {
+  if (size > 0)
+    munmap((void *)data, size);
+}
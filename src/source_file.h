@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A source file mapped read-only into memory. Tokens and the AST refer
+// straight into these bytes, so the file must stay open for as long as the
+// program built from it is running.
+class SourceFile {
+public:
+  SourceFile(const std::string &path);
+  SourceFile(const SourceFile &) = delete;
+  ~SourceFile();
+
+  std::string_view text() const { return std::string_view(data, size); }
+
+private:
+  const char *data;
+  size_t size;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Hashes std::string keys so that they can be looked up by std::string_view,
+// such as a token's lexeme, without building a temporary std::string.
+struct StringKeyHash {
+  using is_transparent = void;
+
+  size_t operator()(std::string_view key) const {
+    return std::hash<std::string_view>{}(key);
+  }
+};
+
+template <typename T>
+using StringMap =
+    std::unordered_map<std::string, T, StringKeyHash, std::equal_to<>>;
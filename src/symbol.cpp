@@ -0,0 +1,16 @@
+#include "symbol.h"
+#include <memory>
+
+const Symbol *intern(std::string_view name) {
+  // Keyed by views of the symbols' own names, which never move.
+  static std::unordered_map<std::string_view, std::unique_ptr<Symbol>> table;
+
+  auto found = table.find(name);
+  if (found != table.end())
+    return found->second.get();
+
+  Symbol *symbol =
+      new Symbol{std::string(name), std::hash<std::string_view>{}(name)};
+  table.emplace(symbol->name, symbol);
+  return symbol;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// An interned name. There is one Symbol per distinct string for the life of
+// the process, so two symbols are equal exactly when their pointers are, and
+// the hash is computed once when the name is first interned.
+struct Symbol {
+  std::string name;
+  size_t hash;
+};
+
+// The symbol for `name`, created the first time it is asked for.
+const Symbol *intern(std::string_view name);
+
+struct SymbolHash {
+  size_t operator()(const Symbol *symbol) const { return symbol->hash; }
+};
+
+template <typename T>
+using SymbolMap = std::unordered_map<const Symbol *, T, SymbolHash>;
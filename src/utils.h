@@ -1,8 +1,43 @@
+#pragma once
 
-bool isspace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+#include <array>
+#include <cstdint>
 
-bool isdigit(char c) { return c >= '0' && c <= '9'; }
+// Character classes for the lexer, looked up in a 256-entry table instead of
+// <cctype>, which consults the locale and is undefined for negative chars.
+enum CharClass : uint8_t {
+  CHAR_SPACE = 1 << 0,
+  CHAR_DIGIT = 1 << 1,
+  CHAR_ALPHA = 1 << 2,
+};
 
-bool isalpha(char c) { return c >= 'a' && c <= 'Z'; }
+constexpr std::array<uint8_t, 256> build_char_classes() {
+  std::array<uint8_t, 256> classes{};
 
-bool isalphanumeric(char c) { return isalpha(c) || isdigit(c); }
+  for (char c : {' ', '\t', '\n', '\r', '\v', '\f'})
+    classes[(unsigned char)c] |= CHAR_SPACE;
+  for (int c = '0'; c <= '9'; ++c)
+    classes[c] |= CHAR_DIGIT;
+  for (int c = 'a'; c <= 'z'; ++c)
+    classes[c] |= CHAR_ALPHA;
+  for (int c = 'A'; c <= 'Z'; ++c)
+    classes[c] |= CHAR_ALPHA;
+
+  return classes;
+}
+
+inline constexpr std::array<uint8_t, 256> CHAR_CLASSES = build_char_classes();
+
+inline bool is_char_class(char c, uint8_t mask) {
+  return CHAR_CLASSES[(unsigned char)c] & mask;
+}
+
+inline bool is_space(char c) { return is_char_class(c, CHAR_SPACE); }
+
+inline bool is_digit(char c) { return is_char_class(c, CHAR_DIGIT); }
+
+inline bool is_alpha(char c) { return is_char_class(c, CHAR_ALPHA); }
+
+inline bool is_alphanumeric(char c) {
+  return is_char_class(c, CHAR_ALPHA | CHAR_DIGIT);
+}
@@ -1,23 +1,33 @@
 #pragma once
 
 #include "../evaluator/runtime_value.h"
-#include <string>
-#include <unordered_map>
+#include <vector>
 
-class Environment {
+// A single lexical scope. Variables live in a flat array indexed by the slot
+// the resolver assigned them, so a lookup never touches the variable's name.
+class Environment : public HeapObject {
 public:
-  Environment() : enclosing(nullptr){};
-  Environment(Environment *enclosing) : enclosing(enclosing){};
+  Environment(Environment *enclosing, int scope_size)
+      : slots(scope_size, Value::nil()), enclosing(enclosing){};
 
-  void define(std::string name, RuntimeValue *value);
+  Value get_at(int distance, int slot) {
+    return ancestor(distance)->slots[slot];
+  }
 
-  RuntimeValue *assign(std::string name, RuntimeValue *value);
-  RuntimeValue *get(Token name);
-  RuntimeValue *assign_at(int distance, std::string name, RuntimeValue *value);
-  RuntimeValue *get_at(int distance, Token name);
+  void assign_at(int distance, int slot, Value value) {
+    ancestor(distance)->slots[slot] = value;
+  }
 
-  Environment *ancestor(int distance);
+  Environment *ancestor(int distance) {
+    Environment *env = this;
+    for (int i = 0; i < distance; ++i)
+      env = env->enclosing;
+    return env;
+  }
 
-  std::unordered_map<std::string, RuntimeValue *> final;
+  void trace(Heap &heap) override;
+  size_t owned_bytes() const override;
+
+  std::vector<Value> slots;
   Environment *enclosing;
 };
@@ -0,0 +1,153 @@
+#include "resolver.h"
+
+// Mirrors the visitor in resolver.cpp, node kind by node kind.
+
+void Resolver::resolve(FlatAst &ast) {
+  for (NodeIndex statement : ast.statements)
+    resolve_node(ast, statement);
+}
+
+static bool declares_variable(const FlatAst &ast, NodeIndex node) {
+  switch (ast.kind(node)) {
+  case VARIABLE_DECLARATION_STMT:
+  case FUNCTION_DECLARATION_STMT:
+  case CLASS_STMT:
+    return true;
+  case IF_STMT:
+    for (NodeIndex branch : FlatOperands(ast, node, 1))
+      if (declares_variable(ast, branch))
+        return true;
+    return false;
+  case WHILE_STMT:
+    return declares_variable(ast, ast.operand(node, 1));
+  default:
+    return false;
+  }
+}
+
+void Resolver::resolve_function(FlatAst &ast, NodeIndex node,
+                                ResolverFunctionType type) {
+  FlatFunction &function = ast.functions[ast.data[node]];
+  ResolverFunctionType enclosing_type = current_function;
+  current_function = type;
+  begin_scope();
+
+  if (type == RES_FN_METHOD)
+    scopes.back().insert_or_assign("this", ResolverLocal{true, 0});
+
+  for (uint32_t i = 0; i < function.param_count; ++i) {
+    std::string_view param = ast.text(ast.params[function.first_param + i]);
+    declare(param);
+    define(param);
+  }
+
+  for (NodeIndex statement : FlatOperands(ast, node))
+    resolve_node(ast, statement);
+
+  function.scope_size = scopes.back().size();
+  end_scope();
+  current_function = enclosing_type;
+}
+
+void Resolver::resolve_node(FlatAst &ast, NodeIndex node) {
+  switch (ast.kind(node)) {
+  case LITERAL_EXPR:
+    return;
+
+  case VARIABLE_REFERENCE_EXPR: {
+    std::string_view name = ast.text(node);
+    if (!scopes.empty()) {
+      auto local = scopes.back().find(name);
+      if (local != scopes.back().end() && !local->second.defined)
+        throw "Cannot read local variable in it's own initializer";
+    }
+    return resolve_local(ast.resolved[ast.data[node]], name);
+  }
+
+  case THIS_EXPR:
+    if (current_class == RES_CL_NONE)
+      throw "Invalid use of 'this' outside of a class.";
+    return resolve_local(ast.resolved[ast.data[node]], ast.text(node));
+
+  // The tree resolver visits assigned values before their targets.
+  case SET_EXPR:
+    resolve_node(ast, ast.operand(node, 1));
+    return resolve_node(ast, ast.first_operand(node));
+
+  case INDEX_EXPR:
+    resolve_node(ast, ast.operand(node, 1));
+    return resolve_node(ast, ast.first_operand(node));
+
+  case SET_INDEX_EXPR:
+    resolve_node(ast, ast.operand(node, 2));
+    resolve_node(ast, ast.operand(node, 1));
+    return resolve_node(ast, ast.first_operand(node));
+
+  case VARIABLE_DECLARATION_STMT: {
+    std::string_view name = ast.text(node);
+    declare(name);
+    resolve_node(ast, ast.first_operand(node));
+    define(name);
+    return resolve_local(ast.resolved[ast.data[node]], name);
+  }
+
+  case ASSIGNMENT_STMT:
+    resolve_node(ast, ast.first_operand(node));
+    return resolve_local(ast.resolved[ast.data[node]], ast.text(node));
+
+  case BLOCK_STMT:
+  case FOR_STMT: {
+    bool scoped = false;
+    if (ast.kind(node) == FOR_STMT) {
+      scoped = declares_variable(ast, ast.first_operand(node)) ||
+               declares_variable(ast, ast.operand(node, 2));
+    } else {
+      for (NodeIndex statement : FlatOperands(ast, node))
+        scoped = scoped || declares_variable(ast, statement);
+    }
+
+    if (scoped)
+      begin_scope();
+    for (NodeIndex operand : FlatOperands(ast, node))
+      resolve_node(ast, operand);
+    if (!scoped)
+      return;
+    ast.data[node] = scopes.back().size();
+    return end_scope();
+  }
+
+  case RETURN_STMT:
+    if (current_function == RES_FN_NONE)
+      throw "Invalid use of return outside of a function";
+    return resolve_node(ast, ast.first_operand(node));
+
+  case CLASS_STMT: {
+    ResolverClassType enclosing_class = current_class;
+    current_class = RES_CL_CLASS;
+
+    std::string_view name = ast.text(node);
+    declare(name);
+    define(name);
+    resolve_local(ast.resolved[ast.data[node]], name);
+
+    for (NodeIndex method : FlatOperands(ast, node))
+      resolve_function(ast, method, RES_FN_METHOD);
+    current_class = enclosing_class;
+    return;
+  }
+
+  case FUNCTION_DECLARATION_STMT: {
+    std::string_view name = ast.text(node);
+    declare(name);
+    define(name);
+    resolve_local(ast.functions[ast.data[node]].resolved, name);
+    return resolve_function(ast, node, RES_FN_FUNCTION);
+  }
+
+  default:
+    // Everything else only needs its operands resolved, in order.
+    for (NodeIndex operand : FlatOperands(ast, node))
+      resolve_node(ast, operand);
+    return;
+  }
+}
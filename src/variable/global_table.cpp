@@ -0,0 +1,28 @@
+#include "global_table.h"
+
+int GlobalTable::index_of(std::string_view name) {
+  auto found = indices.find(name);
+  if (found != indices.end())
+    return found->second;
+
+  int index = values.size();
+  names.push_back(std::string(name));
+  indices.insert_or_assign(names.back(), index);
+  values.push_back(Value::undefined());
+  return index;
+}
+
+void GlobalTable::define(int index, Value value) { values[index] = value; }
+
+Value GlobalTable::get(int index) {
+  if (values[index].is_undefined())
+    throw "Undefined variable '" + names[index] + "'.";
+  return values[index];
+}
+
+Value GlobalTable::assign(int index, Value value) {
+  if (values[index].is_undefined())
+    throw "Undefined variable '" + names[index] + "'.";
+  values[index] = value;
+  return value;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../evaluator/runtime_value.h"
+#include "../string_map.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Globals addressed by a dense index that is assigned the first time a name is
+// mentioned, so that compiled code never has to hash a name at runtime. A slot
+// holding the undefined marker has been mentioned but not yet defined.
+class GlobalTable {
+public:
+  int index_of(std::string_view name);
+
+  void define(int index, Value value);
+  Value get(int index);
+  Value assign(int index, Value value);
+
+  std::vector<Value> values;
+  std::vector<std::string> names;
+  StringMap<int> indices;
+};
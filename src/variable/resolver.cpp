@@ -1,58 +1,93 @@
 #include "resolver.h"
 #include "../parser/ast_printer.h"
 
-void Resolver::resolve_function(FunctionDeclarationStmt declaration,
+// Whether running `stmt` declares a variable in the current scope. Besides
+// declarations themselves, that covers a declaration used directly as the
+// branch of an `if` or the body of a `while`.
+static bool declares_variable(Statement *stmt) {
+  switch (stmt->getType()) {
+  case VARIABLE_DECLARATION_STMT:
+  case FUNCTION_DECLARATION_STMT:
+  case CLASS_STMT:
+    return true;
+  case IF_STMT: {
+    IfStmt *branch = (IfStmt *)stmt;
+    return declares_variable(branch->then_branch) ||
+           (branch->else_branch != nullptr &&
+            declares_variable(branch->else_branch));
+  }
+  case WHILE_STMT:
+    return declares_variable(((WhileStmt *)stmt)->body);
+  default:
+    return false;
+  }
+}
+
+void Resolver::resolve_function(FunctionDeclarationStmt &declaration,
                                 ResolverFunctionType type) {
   ResolverFunctionType enclosing_type = current_function;
   current_function = type;
   begin_scope();
 
+  if (type == RES_FN_METHOD)
+    scopes.back().insert_or_assign("this", ResolverLocal{true, 0});
+
   for (Token param : declaration.params) {
-    declare(param);
-    define(param);
+    declare(param.lexeme);
+    define(param.lexeme);
   }
 
   for (Expression *stmt : declaration.body)
     resolve_expr(stmt);
 
+  declaration.scope_size = scopes.back().size();
   end_scope();
   current_function = enclosing_type;
 }
 
-void Resolver::resolve_local(Expression *expression, Token name) {
+// Anything not found in an enclosing local scope is assumed to be a global,
+// which may be defined later on.
+void Resolver::resolve_local(VariableSlot &resolved, std::string_view name) {
   int i = scopes.size();
 
   while (i--) {
-    if (scopes[i].count(name.lexeme) > 0) {
-      evaluator->resolve(expression, scopes.size() - 1 - i);
+    auto local = scopes[i].find(name);
+    if (local != scopes[i].end()) {
+      resolved.depth = scopes.size() - 1 - i;
+      resolved.slot = local->second.slot;
       return;
     }
   }
+
+  resolved.depth = VariableSlot::GLOBAL;
+  resolved.slot = evaluator->globals.index_of(name);
 }
 
-void Resolver::declare(Token name) {
+void Resolver::declare(std::string_view name) {
   if (scopes.empty())
     return;
 
-  if (scopes.back().count(name.lexeme)) {
+  if (scopes.back().count(name)) {
     throw 
-        "Attempted to declare variable '" + name.lexeme +
+        "Attempted to declare variable '" + std::string(name) +
         "Attempted to declare variable '{name.lexeme}' when another variable "
         "was already declared with the same name within the scope.";
   }
 
-  scopes.back().insert_or_assign(name.lexeme, false);
+  int slot = scopes.back().size();
+  scopes.back().insert_or_assign(std::string(name),
+                                 ResolverLocal{false, slot});
 }
 
-void Resolver::define(Token name) {
+void Resolver::define(std::string_view name) {
   if (scopes.empty())
     return;
 
-  scopes.back().insert_or_assign(name.lexeme, true);
+  scopes.back().find(name)->second.defined = true;
 }
 
 void Resolver::begin_scope() {
-  scopes.push_back(std::unordered_map<std::string, bool>({}));
+  scopes.push_back(StringMap<ResolverLocal>({}));
 }
 
 void Resolver::end_scope() { scopes.pop_back(); }
@@ -84,13 +119,13 @@ void Resolver::visit(CallExpr *expr) {
 };
 
 void Resolver::visit(VariableReferenceExpr *expr) {
-  if (!scopes.empty() && (scopes.back().count(expr->op.lexeme) > 0
-                              ? scopes.back().at(expr->op.lexeme)
-                              : true) == false)
-    throw 
-        "Cannot read local variable in it's own initializer";
+  if (!scopes.empty()) {
+    auto local = scopes.back().find(expr->op.lexeme);
+    if (local != scopes.back().end() && !local->second.defined)
+      throw "Cannot read local variable in it's own initializer";
+  }
 
-  resolve_local(expr, expr->op);
+  resolve_local(expr->resolved, expr->op.lexeme);
 };
 
 void Resolver::visit(GetExpr *expr) { resolve_expr(expr->obj); };
@@ -103,7 +138,7 @@ void Resolver::visit(SetExpr *expr) {
 void Resolver::visit(ThisExpr *expr) {
   if (current_class == RES_CL_NONE)
     throw "Invalid use of 'this' outside of a class.";
-  resolve_local(expr, expr->keyword);
+  resolve_local(expr->resolved, expr->keyword.lexeme);
 };
 
 void Resolver::visit(ArrayExpr *expr) {
@@ -128,28 +163,40 @@ void Resolver::visit(ExpressionStmt *stmt) { resolve_expr(stmt->expression); };
 void Resolver::visit(PrintStmt *stmt) { resolve_expr(stmt->expression); };
 
 void Resolver::visit(VariableDeclarationStmt *stmt) {
-  declare(stmt->name);
+  declare(stmt->name.lexeme);
   if (stmt->initializer != nullptr)
     resolve_expr(stmt->initializer);
-  define(stmt->name);
+  define(stmt->name.lexeme);
+  resolve_local(stmt->resolved, stmt->name.lexeme);
 };
 
 void Resolver::visit(AssignmentStmt *stmt) {
   resolve_expr(stmt->value);
-  resolve_local(stmt, stmt->name);
+  resolve_local(stmt->resolved, stmt->name.lexeme);
 };
 
+// Blocks and loops that declare nothing get no scope, which the evaluator
+// sees as a scope size of zero.
 void Resolver::visit(BlockStmt *stmt) {
-  begin_scope();
-  for (Statement *stmt : stmt->statements)
-    stmt->accept(*this);
-  end_scope();
+  bool scoped = false;
+  for (Statement *statement : stmt->statements)
+    scoped = scoped || declares_variable(statement);
+
+  if (scoped)
+    begin_scope();
+  for (Statement *statement : stmt->statements)
+    statement->accept(*this);
+  if (scoped) {
+    stmt->scope_size = scopes.back().size();
+    end_scope();
+  }
 };
 
 void Resolver::visit(IfStmt *stmt) {
   resolve_expr(stmt->condition);
   resolve_expr(stmt->then_branch);
-  resolve_expr(stmt->else_branch);
+  if (stmt->else_branch != nullptr)
+    resolve_expr(stmt->else_branch);
 };
 
 void Resolver::visit(WhileStmt *stmt) {
@@ -157,6 +204,25 @@ void Resolver::visit(WhileStmt *stmt) {
   resolve_expr(stmt->body);
 };
 
+void Resolver::visit(ForStmt *stmt) {
+  bool scoped =
+      (stmt->initializer != nullptr && declares_variable(stmt->initializer)) ||
+      declares_variable(stmt->body);
+
+  if (scoped)
+    begin_scope();
+  if (stmt->initializer != nullptr)
+    resolve_expr(stmt->initializer);
+  resolve_expr(stmt->condition);
+  resolve_expr(stmt->body);
+  if (stmt->increment != nullptr)
+    resolve_expr(stmt->increment);
+  if (scoped) {
+    stmt->scope_size = scopes.back().size();
+    end_scope();
+  }
+};
+
 void Resolver::visit(ReturnStmt *stmt) {
   if (current_function == RES_FN_NONE)
     throw "Invalid use of return outside of a function";
@@ -167,19 +233,18 @@ void Resolver::visit(ClassStmt *stmt) {
   ResolverClassType enclosing_class = current_class;
   current_class = RES_CL_CLASS;
 
-  declare(stmt->name);
-  define(stmt->name);
+  declare(stmt->name.lexeme);
+  define(stmt->name.lexeme);
+  resolve_local(stmt->resolved, stmt->name.lexeme);
 
-  begin_scope();
-  scopes.back().insert_or_assign("this", true);
-  for (auto method : stmt->methods)
-    resolve_function(method, RES_FN_METHOD);
-  end_scope();
+  for (FunctionDeclarationStmt *method : stmt->methods)
+    resolve_function(*method, RES_FN_METHOD);
   current_class = enclosing_class;
 };
 
 void Resolver::visit(FunctionDeclarationStmt *stmt) {
-  declare(stmt->name);
-  define(stmt->name);
+  declare(stmt->name.lexeme);
+  define(stmt->name.lexeme);
+  resolve_local(stmt->resolved, stmt->name.lexeme);
   resolve_function(*stmt, RES_FN_FUNCTION);
 };
@@ -1,9 +1,15 @@
 #include "../evaluator/evaluator.h"
 #include "../parser/expression.h"
+#include "../parser/flat_ast.h"
 
 enum ResolverFunctionType { RES_FN_NONE, RES_FN_FUNCTION, RES_FN_METHOD };
 enum ResolverClassType { RES_CL_NONE, RES_CL_CLASS };
 
+struct ResolverLocal {
+  bool defined;
+  int slot;
+};
+
 class Resolver : ExpressionVisitor<void> {
 public:
   Resolver(Evaluator *evaluator)
@@ -33,20 +39,28 @@ public:
   void visit(BlockStmt *stmt) override;
   void visit(IfStmt *stmt) override;
   void visit(WhileStmt *stmt) override;
+  void visit(ForStmt *stmt) override;
   void visit(ReturnStmt *stmt) override;
   void visit(ClassStmt *stmt) override;
   void visit(FunctionDeclarationStmt *stmt) override;
 
-  void resolve_function(FunctionDeclarationStmt declaration,
+  void resolve_function(FunctionDeclarationStmt &declaration,
                         ResolverFunctionType type);
-  void resolve_local(Expression *expression, Token name);
-  void declare(Token name);
-  void define(Token name);
+
+  // The same analysis over a flat tree, recording results in its side tables.
+  void resolve(FlatAst &ast);
+  void resolve_node(FlatAst &ast, NodeIndex node);
+  void resolve_function(FlatAst &ast, NodeIndex node,
+                        ResolverFunctionType type);
+
+  void resolve_local(VariableSlot &resolved, std::string_view name);
+  void declare(std::string_view name);
+  void define(std::string_view name);
   void begin_scope();
   void end_scope();
 
   Evaluator *evaluator;
-  std::vector<std::unordered_map<std::string, bool>> scopes;
+  std::vector<StringMap<ResolverLocal>> scopes;
   ResolverFunctionType current_function;
   ResolverClassType current_class;
 };
@@ -0,0 +1,244 @@
+#include "chunk.h"
+#include "vm_objects.h"
+#include <algorithm>
+#include <cstdio>
+
+void Chunk::write(uint8_t byte, int line) {
+  if (lines.empty() || lines.back().line != line)
+    lines.push_back(LineStart{(int)code.size(), line});
+  code.push_back(byte);
+}
+
+void Chunk::write_u16(uint16_t value, int line) {
+  write((value >> 8) & 0xff, line);
+  write(value & 0xff, line);
+}
+
+void Chunk::patch_u16(int offset, uint16_t value) {
+  code[offset] = (value >> 8) & 0xff;
+  code[offset + 1] = value & 0xff;
+}
+
+int Chunk::add_constant(Value value) {
+  constants.push_back(value);
+  return constants.size() - 1;
+}
+
+int Chunk::add_property_cache() {
+  property_caches.push_back(PropertyCache());
+  return property_caches.size() - 1;
+}
+
+int Chunk::line_at(int offset) const {
+  auto after = std::upper_bound(
+      lines.begin(), lines.end(), offset,
+      [](int offset, const LineStart &start) { return offset < start.offset; });
+  if (after == lines.begin())
+    return 0;
+  return (after - 1)->line;
+}
+
+const char *op_code_as_str(OpCode op) {
+  switch (op) {
+  case OP_CONSTANT:
+    return "OP_CONSTANT";
+  case OP_NIL:
+    return "OP_NIL";
+  case OP_TRUE:
+    return "OP_TRUE";
+  case OP_FALSE:
+    return "OP_FALSE";
+  case OP_POP:
+    return "OP_POP";
+  case OP_GET_LOCAL:
+    return "OP_GET_LOCAL";
+  case OP_SET_LOCAL:
+    return "OP_SET_LOCAL";
+  case OP_GET_UPVALUE:
+    return "OP_GET_UPVALUE";
+  case OP_SET_UPVALUE:
+    return "OP_SET_UPVALUE";
+  case OP_GET_GLOBAL:
+    return "OP_GET_GLOBAL";
+  case OP_DEFINE_GLOBAL:
+    return "OP_DEFINE_GLOBAL";
+  case OP_SET_GLOBAL:
+    return "OP_SET_GLOBAL";
+  case OP_CLOSE_UPVALUE:
+    return "OP_CLOSE_UPVALUE";
+  case OP_GET_PROPERTY:
+    return "OP_GET_PROPERTY";
+  case OP_SET_PROPERTY:
+    return "OP_SET_PROPERTY";
+  case OP_GET_INDEX:
+    return "OP_GET_INDEX";
+  case OP_SET_INDEX:
+    return "OP_SET_INDEX";
+  case OP_ARRAY:
+    return "OP_ARRAY";
+  case OP_EQUAL:
+    return "OP_EQUAL";
+  case OP_NOT_EQUAL:
+    return "OP_NOT_EQUAL";
+  case OP_GREATER:
+    return "OP_GREATER";
+  case OP_GREATER_EQUAL:
+    return "OP_GREATER_EQUAL";
+  case OP_LESS:
+    return "OP_LESS";
+  case OP_LESS_EQUAL:
+    return "OP_LESS_EQUAL";
+  case OP_ADD:
+    return "OP_ADD";
+  case OP_SUBTRACT:
+    return "OP_SUBTRACT";
+  case OP_MULTIPLY:
+    return "OP_MULTIPLY";
+  case OP_DIVIDE:
+    return "OP_DIVIDE";
+  case OP_NOT:
+    return "OP_NOT";
+  case OP_NEGATE:
+    return "OP_NEGATE";
+  case OP_PRINT:
+    return "OP_PRINT";
+  case OP_JUMP:
+    return "OP_JUMP";
+  case OP_JUMP_IF_FALSE:
+    return "OP_JUMP_IF_FALSE";
+  case OP_LOOP:
+    return "OP_LOOP";
+  case OP_CALL:
+    return "OP_CALL";
+  case OP_INVOKE:
+    return "OP_INVOKE";
+  case OP_CLOSURE:
+    return "OP_CLOSURE";
+  case OP_RETURN:
+    return "OP_RETURN";
+  case OP_CLASS:
+    return "OP_CLASS";
+  case OP_METHOD:
+    return "OP_METHOD";
+  case OP_ADD_LOCAL_CONSTANT:
+    return "OP_ADD_LOCAL_CONSTANT";
+  case OP_SUBTRACT_LOCAL_CONSTANT:
+    return "OP_SUBTRACT_LOCAL_CONSTANT";
+  case OP_GET_LOCAL_PROPERTY:
+    return "OP_GET_LOCAL_PROPERTY";
+  case OP_JUMP_IF_NOT_LESS:
+    return "OP_JUMP_IF_NOT_LESS";
+  case OP_JUMP_IF_NOT_LESS_EQUAL:
+    return "OP_JUMP_IF_NOT_LESS_EQUAL";
+  case OP_JUMP_IF_NOT_GREATER:
+    return "OP_JUMP_IF_NOT_GREATER";
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+    return "OP_JUMP_IF_NOT_GREATER_EQUAL";
+  case OP_COUNT:
+    break;
+  }
+  return "OP_UNKNOWN";
+}
+
+void disassemble_chunk(const Chunk &chunk, const std::string &name) {
+  printf("== %s ==\n", name.c_str());
+  for (int offset = 0; offset < chunk.code.size();)
+    offset = disassemble_instruction(chunk, offset);
+
+  for (Value constant : chunk.constants) {
+    if (constant.get_type() != RT_BYTECODE_FUNCTION)
+      continue;
+    RuntimeBytecodeFunction *function =
+        (RuntimeBytecodeFunction *)constant.as_object();
+    disassemble_chunk(function->chunk, function->name);
+  }
+}
+
+int disassemble_instruction(const Chunk &chunk, int offset) {
+  OpCode op = (OpCode)chunk.code[offset];
+  int line = chunk.line_at(offset);
+  printf("%04d %4d %-28s", offset, line, op_code_as_str(op));
+
+  switch (op) {
+  case OP_GET_PROPERTY:
+  case OP_SET_PROPERTY: {
+    int index = chunk.read_u16(offset + 1);
+    printf("%4d '%s' cache %d\n", index,
+           chunk.constants[index].as_string().c_str(),
+           chunk.read_u16(offset + 3));
+    return offset + 5;
+  }
+  case OP_INVOKE: {
+    int index = chunk.read_u16(offset + 1);
+    printf("%4d '%s' cache %d (%d args)\n", index,
+           chunk.constants[index].as_string().c_str(),
+           chunk.read_u16(offset + 3), chunk.code[offset + 5]);
+    return offset + 6;
+  }
+  case OP_GET_LOCAL_PROPERTY: {
+    int index = chunk.read_u16(offset + 2);
+    printf("%4d '%s' local %d cache %d\n", index,
+           chunk.constants[index].as_string().c_str(), chunk.code[offset + 1],
+           chunk.read_u16(offset + 4));
+    return offset + 6;
+  }
+  case OP_ADD_LOCAL_CONSTANT:
+  case OP_SUBTRACT_LOCAL_CONSTANT: {
+    int index = chunk.read_u16(offset + 2);
+    printf("%4d '%s' local %d\n", index,
+           chunk.constants[index].as_string().c_str(), chunk.code[offset + 1]);
+    return offset + 4;
+  }
+  case OP_CONSTANT:
+  case OP_CLASS:
+  case OP_METHOD: {
+    int index = chunk.read_u16(offset + 1);
+    printf("%4d '%s'\n", index, chunk.constants[index].as_string().c_str());
+    return offset + 3;
+  }
+  case OP_GET_GLOBAL:
+  case OP_DEFINE_GLOBAL:
+  case OP_SET_GLOBAL:
+  case OP_ARRAY:
+    printf("%4d\n", chunk.read_u16(offset + 1));
+    return offset + 3;
+  case OP_GET_LOCAL:
+  case OP_SET_LOCAL:
+  case OP_GET_UPVALUE:
+  case OP_SET_UPVALUE:
+  case OP_CALL:
+    printf("%4d\n", chunk.code[offset + 1]);
+    return offset + 2;
+  case OP_JUMP:
+  case OP_JUMP_IF_FALSE:
+  case OP_JUMP_IF_NOT_LESS:
+  case OP_JUMP_IF_NOT_LESS_EQUAL:
+  case OP_JUMP_IF_NOT_GREATER:
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+    printf("%4d -> %d\n", chunk.read_u16(offset + 1),
+           offset + 3 + chunk.read_u16(offset + 1));
+    return offset + 3;
+  case OP_LOOP:
+    printf("%4d -> %d\n", chunk.read_u16(offset + 1),
+           offset + 3 - chunk.read_u16(offset + 1));
+    return offset + 3;
+  case OP_CLOSURE: {
+    int index = chunk.read_u16(offset + 1);
+    RuntimeBytecodeFunction *function =
+        (RuntimeBytecodeFunction *)chunk.constants[index].as_object();
+    printf("%4d %s\n", index, function->as_string().c_str());
+    offset += 3;
+    for (int i = 0; i < function->upvalue_count; ++i) {
+      int is_local = chunk.code[offset];
+      int upvalue = chunk.code[offset + 1];
+      printf("%04d    |                               %s %d\n", offset,
+             is_local ? "local" : "upvalue", upvalue);
+      offset += 2;
+    }
+    return offset;
+  }
+  default:
+    printf("\n");
+    return offset + 1;
+  }
+}
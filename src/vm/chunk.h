@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../evaluator/runtime_value.h"
+#include "../evaluator/shape.h"
+#include <cstdint>
+#include <vector>
+
+// Stack effects are noted as [before] -> [after], top of stack on the right.
+enum OpCode : uint8_t {
+  OP_CONSTANT,      // u16 constant        [] -> [value]
+  OP_NIL,           //                     [] -> [nil]
+  OP_TRUE,          //                     [] -> [true]
+  OP_FALSE,         //                     [] -> [false]
+  OP_POP,           //                     [a] -> []
+
+  OP_GET_LOCAL,     // u8 slot             [] -> [value]
+  OP_SET_LOCAL,     // u8 slot             [value] -> [value]
+  OP_GET_UPVALUE,   // u8 upvalue          [] -> [value]
+  OP_SET_UPVALUE,   // u8 upvalue          [value] -> [value]
+  OP_GET_GLOBAL,    // u16 global          [] -> [value]
+  OP_DEFINE_GLOBAL, // u16 global          [value] -> []
+  OP_SET_GLOBAL,    // u16 global          [value] -> [value]
+  OP_CLOSE_UPVALUE, //                     [local] -> []
+
+  OP_GET_PROPERTY,  // u16 name, u16 cache [obj] -> [value]
+  OP_SET_PROPERTY,  // u16 name, u16 cache [obj value] -> [value]
+  OP_GET_INDEX,     //                     [index obj] -> [value]
+  OP_SET_INDEX,     //                     [value index obj] -> [nil]
+  OP_ARRAY,         // u16 count           [length v0..vn] -> [array]
+
+  OP_EQUAL,         //                     [a b] -> [a == b]
+  OP_NOT_EQUAL,     //                     [a b] -> [a != b]
+  OP_GREATER,       //                     [a b] -> [a > b]
+  OP_GREATER_EQUAL, //                     [a b] -> [a >= b]
+  OP_LESS,          //                     [a b] -> [a < b]
+  OP_LESS_EQUAL,    //                     [a b] -> [a <= b]
+  OP_ADD,           //                     [a b] -> [a + b]
+  OP_SUBTRACT,      //                     [a b] -> [a - b]
+  OP_MULTIPLY,      //                     [a b] -> [a * b]
+  OP_DIVIDE,        //                     [a b] -> [a / b]
+  OP_NOT,           //                     [a] -> [!a]
+  OP_NEGATE,        //                     [a] -> [-a]
+
+  OP_PRINT,         //                     [a] -> []
+  OP_JUMP,          // u16 offset          [] -> []
+  OP_JUMP_IF_FALSE, // u16 offset          [cond] -> []
+  OP_LOOP,          // u16 offset          [] -> []
+
+  OP_CALL,          // u8 argc             [callee args..] -> [result]
+  OP_INVOKE,        // u16 name, u16 cache, u8 argc
+                    //                     [obj args..] -> [result]
+  OP_CLOSURE,       // u16 function, then (u8 is_local, u8 index) per upvalue
+  OP_RETURN,        //                     [result] -> (caller)
+  OP_CLASS,         // u16 name constant   [] -> [class]
+  OP_METHOD,        // u16 name constant   [class closure] -> [class]
+
+  // Superinstructions, which the compiler emits in place of the common
+  // sequences they stand for.
+  OP_ADD_LOCAL_CONSTANT,        // u8 slot, u16 constant
+                                //         [] -> [local + constant]
+  OP_SUBTRACT_LOCAL_CONSTANT,   // u8 slot, u16 constant
+                                //         [] -> [local - constant]
+  OP_GET_LOCAL_PROPERTY,        // u8 slot, u16 name, u16 cache
+                                //         [] -> [local.name]
+  OP_JUMP_IF_NOT_LESS,          // u16 offset  [a b] -> []
+  OP_JUMP_IF_NOT_LESS_EQUAL,    // u16 offset  [a b] -> []
+  OP_JUMP_IF_NOT_GREATER,       // u16 offset  [a b] -> []
+  OP_JUMP_IF_NOT_GREATER_EQUAL, // u16 offset  [a b] -> []
+
+  OP_COUNT, // Not an instruction: the number of opcodes.
+};
+
+const char *op_code_as_str(OpCode op);
+
+// A line table entry marks the first instruction offset belonging to a line;
+// consecutive instructions on the same line share a single entry.
+struct LineStart {
+  int offset;
+  int line;
+};
+
+class Chunk {
+public:
+  void write(uint8_t byte, int line);
+  void write_u16(uint16_t value, int line);
+  void patch_u16(int offset, uint16_t value);
+  int add_constant(Value value);
+  int add_property_cache();
+  int line_at(int offset) const;
+
+  uint16_t read_u16(int offset) const {
+    return (uint16_t)((code[offset] << 8) | code[offset + 1]);
+  }
+
+  std::vector<uint8_t> code;
+  std::vector<Value> constants;
+  std::vector<LineStart> lines;
+  // One inline cache per property access instruction.
+  std::vector<PropertyCache> property_caches;
+};
+
+void disassemble_chunk(const Chunk &chunk, const std::string &name);
+int disassemble_instruction(const Chunk &chunk, int offset);
@@ -0,0 +1,568 @@
+#include "compiler.h"
+
+RuntimeBytecodeFunction *Compiler::compile(std::vector<Expression *> exprs) {
+  CompilerFunctionState state;
+  begin_function(&state, "script", 0, CMP_FN_SCRIPT);
+
+  for (Expression *expr : exprs)
+    compile_expr(expr);
+
+  emit(OP_NIL);
+  emit(OP_RETURN);
+  return end_function();
+}
+
+void Compiler::mark_roots(Heap &heap) {
+  for (CompilerFunctionState *state = current; state != nullptr;
+       state = state->enclosing)
+    heap.mark(state->function);
+}
+
+void Compiler::compile_expr(Expression *expr) { expr->accept(*this); }
+
+void Compiler::compile_branch(Statement *stmt) {
+  // A declaration used directly as a branch body must not leave a new local
+  // behind on the stack, so it gets a scope of its own.
+  if (current->scope_depth == 0 || stmt->getType() == BLOCK_STMT)
+    return compile_expr(stmt);
+
+  begin_scope();
+  compile_expr(stmt);
+  end_scope();
+}
+
+void Compiler::compile_function(FunctionDeclarationStmt *declaration,
+                                CompilerFunctionType type) {
+  CompilerFunctionState state;
+  begin_function(&state, std::string(declaration->name.lexeme),
+                 declaration->params.size(), type);
+  begin_scope();
+
+  for (Token param : declaration->params) {
+    declare_variable(param.lexeme);
+    define_variable(param.lexeme);
+  }
+
+  for (Statement *stmt : declaration->body)
+    compile_expr(stmt);
+
+  emit(OP_NIL);
+  emit(OP_RETURN);
+
+  RuntimeBytecodeFunction *function = end_function();
+  line = declaration->name.line;
+  emit(OP_CLOSURE, make_constant(Value::object(function)));
+  for (CompilerUpvalue upvalue : state.upvalues) {
+    emit(upvalue.is_local ? 1 : 0);
+    emit(upvalue.index);
+  }
+}
+
+void Compiler::begin_function(CompilerFunctionState *state, std::string name,
+                              int arity, CompilerFunctionType type) {
+  state->enclosing = current;
+  state->function = runtime_heap.allocate<RuntimeBytecodeFunction>(name, arity);
+  state->type = type;
+  state->scope_depth = 0;
+
+  // Slot 0 holds the receiver for methods and the callee otherwise. The empty
+  // name keeps the latter from ever being resolved by user code.
+  state->locals.push_back(
+      CompilerLocal{type == CMP_FN_METHOD ? "this" : "", 0, false});
+
+  current = state;
+}
+
+RuntimeBytecodeFunction *Compiler::end_function() {
+  RuntimeBytecodeFunction *function = current->function;
+  function->upvalue_count = current->upvalues.size();
+  current = current->enclosing;
+  return function;
+}
+
+void Compiler::begin_scope() { ++current->scope_depth; }
+
+void Compiler::end_scope() {
+  --current->scope_depth;
+
+  while (!current->locals.empty() &&
+         current->locals.back().depth > current->scope_depth) {
+    emit(current->locals.back().is_captured ? OP_CLOSE_UPVALUE : OP_POP);
+    current->locals.pop_back();
+  }
+}
+
+void Compiler::declare_variable(std::string_view name) {
+  if (current->scope_depth == 0)
+    return;
+
+  if (current->locals.size() > UINT8_MAX)
+    throw "Too many local variables in function.";
+
+  current->locals.push_back(CompilerLocal{name, -1, false});
+}
+
+void Compiler::define_variable(std::string_view name) {
+  if (current->scope_depth == 0) {
+    emit(OP_DEFINE_GLOBAL, globals->index_of(name));
+    return;
+  }
+
+  current->locals.back().depth = current->scope_depth;
+}
+
+void Compiler::emit_variable_get(std::string_view name) {
+  int slot = resolve_local(current, name);
+  if (slot != -1) {
+    emit(OP_GET_LOCAL);
+    emit(slot);
+    return;
+  }
+
+  int upvalue = resolve_upvalue(current, name);
+  if (upvalue != -1) {
+    emit(OP_GET_UPVALUE);
+    emit(upvalue);
+    return;
+  }
+
+  emit(OP_GET_GLOBAL, globals->index_of(name));
+}
+
+void Compiler::emit_variable_set(std::string_view name) {
+  int slot = resolve_local(current, name);
+  if (slot != -1) {
+    emit(OP_SET_LOCAL);
+    emit(slot);
+    return;
+  }
+
+  int upvalue = resolve_upvalue(current, name);
+  if (upvalue != -1) {
+    emit(OP_SET_UPVALUE);
+    emit(upvalue);
+    return;
+  }
+
+  emit(OP_SET_GLOBAL, globals->index_of(name));
+}
+
+int Compiler::resolve_local(CompilerFunctionState *state,
+                            std::string_view name) {
+  for (int i = state->locals.size() - 1; i >= 0; --i) {
+    CompilerLocal &local = state->locals[i];
+    if (local.depth != -1 && local.name == name)
+      return i;
+  }
+  return -1;
+}
+
+int Compiler::resolve_upvalue(CompilerFunctionState *state,
+                              std::string_view name) {
+  if (state->enclosing == nullptr)
+    return -1;
+
+  int local = resolve_local(state->enclosing, name);
+  if (local != -1) {
+    state->enclosing->locals[local].is_captured = true;
+    return add_upvalue(state, local, true);
+  }
+
+  int upvalue = resolve_upvalue(state->enclosing, name);
+  if (upvalue != -1)
+    return add_upvalue(state, upvalue, false);
+
+  return -1;
+}
+
+int Compiler::add_upvalue(CompilerFunctionState *state, uint8_t index,
+                          bool is_local) {
+  for (int i = 0; i < state->upvalues.size(); ++i) {
+    CompilerUpvalue &upvalue = state->upvalues[i];
+    if (upvalue.index == index && upvalue.is_local == is_local)
+      return i;
+  }
+
+  if (state->upvalues.size() > UINT8_MAX)
+    throw "Too many closure variables in function.";
+
+  state->upvalues.push_back(CompilerUpvalue{index, is_local});
+  return state->upvalues.size() - 1;
+}
+
+Chunk &Compiler::chunk() { return current->function->chunk; }
+
+void Compiler::emit(uint8_t byte) { chunk().write(byte, line); }
+
+void Compiler::emit(OpCode op, uint16_t operand) {
+  chunk().write(op, line);
+  chunk().write_u16(operand, line);
+}
+
+int Compiler::emit_jump(OpCode op) {
+  emit(op, 0xffff);
+  return chunk().code.size() - 2;
+}
+
+void Compiler::patch_jump(int offset) {
+  int jump = chunk().code.size() - offset - 2;
+  if (jump > UINT16_MAX)
+    throw "Too much code to jump over.";
+  chunk().patch_u16(offset, jump);
+}
+
+void Compiler::emit_loop(int loop_start) {
+  int offset = chunk().code.size() - loop_start + 3;
+  if (offset > UINT16_MAX)
+    throw "Loop body too large.";
+  emit(OP_LOOP, offset);
+}
+
+int Compiler::make_constant(Value value) {
+  int index = chunk().add_constant(value);
+  if (index > UINT16_MAX)
+    throw "Too many constants in one chunk.";
+  return index;
+}
+
+int Compiler::name_constant(std::string_view name) {
+  const Symbol *symbol = intern(name);
+  auto found = current->name_constants.find(symbol);
+  if (found != current->name_constants.end())
+    return found->second;
+
+  int index = make_constant(interned_string(symbol));
+  current->name_constants.insert_or_assign(symbol, index);
+  return index;
+}
+
+// Emits `local + constant` or `local - constant` as one instruction, if
+// `expr` is one of those.
+bool Compiler::compile_local_constant(BinaryExpr *expr) {
+  if ((expr->op.type != PLUS && expr->op.type != MINUS) ||
+      expr->left.getType() != VARIABLE_REFERENCE_EXPR ||
+      expr->right.getType() != LITERAL_EXPR)
+    return false;
+
+  const Literal &constant = ((LiteralExpr *)&expr->right)->value;
+  if (constant.type != NUM && constant.type != STR)
+    return false;
+
+  int slot =
+      resolve_local(current, ((VariableReferenceExpr *)&expr->left)->op.lexeme);
+  if (slot == -1)
+    return false;
+
+  line = expr->op.line;
+  emit(expr->op.type == PLUS ? OP_ADD_LOCAL_CONSTANT
+                             : OP_SUBTRACT_LOCAL_CONSTANT);
+  emit(slot);
+  chunk().write_u16(make_constant(literal_to_value(constant)), line);
+  return true;
+}
+
+// Compiles `condition` followed by a jump taken when it is false, which for
+// an ordering comparison is a single compare-and-jump instruction. Returns
+// the jump's offset for patch_jump.
+int Compiler::compile_condition_jump(Expression *condition) {
+  if (condition->getType() == BINARY_EXPR) {
+    BinaryExpr *binary = (BinaryExpr *)condition;
+    OpCode jump = OP_COUNT;
+    switch (binary->op.type) {
+    case LESS:
+      jump = OP_JUMP_IF_NOT_LESS;
+      break;
+    case LESS_EQUAL:
+      jump = OP_JUMP_IF_NOT_LESS_EQUAL;
+      break;
+    case GREATER:
+      jump = OP_JUMP_IF_NOT_GREATER;
+      break;
+    case GREATER_EQUAL:
+      jump = OP_JUMP_IF_NOT_GREATER_EQUAL;
+      break;
+    default:
+      break;
+    }
+
+    if (jump != OP_COUNT) {
+      compile_expr(&binary->left);
+      compile_expr(&binary->right);
+      line = binary->op.line;
+      return emit_jump(jump);
+    }
+  }
+
+  compile_expr(condition);
+  return emit_jump(OP_JUMP_IF_FALSE);
+}
+
+void Compiler::visit(BinaryExpr *expr) {
+  if (compile_local_constant(expr))
+    return;
+
+  compile_expr(&expr->left);
+  compile_expr(&expr->right);
+
+  line = expr->op.line;
+
+  switch (expr->op.type) {
+  case MINUS:
+    return emit(OP_SUBTRACT);
+  case SLASH:
+    return emit(OP_DIVIDE);
+  case STAR:
+    return emit(OP_MULTIPLY);
+  case PLUS:
+    return emit(OP_ADD);
+  case GREATER:
+    return emit(OP_GREATER);
+  case GREATER_EQUAL:
+    return emit(OP_GREATER_EQUAL);
+  case LESS:
+    return emit(OP_LESS);
+  case LESS_EQUAL:
+    return emit(OP_LESS_EQUAL);
+  case EQUAL_EQUAL:
+    return emit(OP_EQUAL);
+  case BANG_EQUAL:
+    return emit(OP_NOT_EQUAL);
+  default:
+    // The tree-walker yields nil for operators it does not know.
+    emit(OP_POP);
+    emit(OP_POP);
+    emit(OP_NIL);
+  }
+};
+
+void Compiler::visit(GroupingExpr *expr) { compile_expr(&expr->expr); };
+
+void Compiler::visit(LiteralExpr *expr) {
+  switch (expr->value.type) {
+  case NIL_:
+    return emit(OP_NIL);
+  case BOOL:
+    return emit(std::get<bool>(expr->value.value) ? OP_TRUE : OP_FALSE);
+  case NUM:
+  case STR:
+    return emit(OP_CONSTANT, make_constant(literal_to_value(expr->value)));
+  }
+};
+
+void Compiler::visit(UnaryExpr *expr) {
+  compile_expr(&expr->right);
+
+  line = expr->op.line;
+
+  switch (expr->op.type) {
+  case MINUS:
+    return emit(OP_NEGATE);
+  case BANG:
+    return emit(OP_NOT);
+  default:
+    throw "Expected unary operation, found " + std::string(expr->op.lexeme);
+  }
+};
+
+void Compiler::visit(CallExpr *expr) {
+  if (expr->arguments.size() > UINT8_MAX)
+    throw "Can't have more than 255 arguments.";
+
+  // `obj.name(args)` leaves `obj` where the callee would go, so a method can
+  // use it as `this` without a bound method being created.
+  if (expr->callee->getType() == GET_EXPR) {
+    GetExpr *get = (GetExpr *)expr->callee;
+    compile_expr(get->obj);
+    for (Expression *arg : expr->arguments)
+      compile_expr(arg);
+
+    line = expr->paren.line;
+    emit(OP_INVOKE, name_constant(get->name.lexeme));
+    chunk().write_u16(chunk().add_property_cache(), line);
+    emit(expr->arguments.size());
+    return;
+  }
+
+  compile_expr(expr->callee);
+  for (Expression *arg : expr->arguments)
+    compile_expr(arg);
+
+  line = expr->paren.line;
+  emit(OP_CALL);
+  emit(expr->arguments.size());
+};
+
+void Compiler::visit(VariableReferenceExpr *expr) {
+  line = expr->op.line;
+  emit_variable_get(expr->op.lexeme);
+};
+
+void Compiler::visit(GetExpr *expr) {
+  // Reading a property of a local, `this` included, is one instruction.
+  int slot = -1;
+  if (expr->obj->getType() == VARIABLE_REFERENCE_EXPR)
+    slot = resolve_local(current,
+                         ((VariableReferenceExpr *)expr->obj)->op.lexeme);
+  else if (expr->obj->getType() == THIS_EXPR)
+    slot = resolve_local(current, "this");
+
+  line = expr->name.line;
+  if (slot != -1) {
+    emit(OP_GET_LOCAL_PROPERTY);
+    emit(slot);
+    chunk().write_u16(name_constant(expr->name.lexeme), line);
+    chunk().write_u16(chunk().add_property_cache(), line);
+    return;
+  }
+
+  compile_expr(expr->obj);
+  line = expr->name.line;
+  emit(OP_GET_PROPERTY, name_constant(expr->name.lexeme));
+  chunk().write_u16(chunk().add_property_cache(), line);
+};
+
+void Compiler::visit(SetExpr *expr) {
+  compile_expr(expr->obj);
+  compile_expr(expr->value);
+  line = expr->name.line;
+  emit(OP_SET_PROPERTY, name_constant(expr->name.lexeme));
+  chunk().write_u16(chunk().add_property_cache(), line);
+};
+
+void Compiler::visit(ThisExpr *expr) {
+  line = expr->keyword.line;
+  emit_variable_get("this");
+};
+
+void Compiler::visit(ArrayExpr *expr) {
+  compile_expr(expr->length);
+  for (Expression *value : expr->values)
+    compile_expr(value);
+
+  if (expr->values.size() > UINT16_MAX)
+    throw "Too many values in array literal.";
+
+  emit(OP_ARRAY, expr->values.size());
+};
+
+// Index operands are evaluated index-first to match the tree-walker.
+void Compiler::visit(IndexExpr *expr) {
+  compile_expr(expr->index);
+  compile_expr(expr->obj);
+  emit(OP_GET_INDEX);
+};
+
+void Compiler::visit(SetIndexExpr *expr) {
+  compile_expr(expr->value);
+  compile_expr(expr->index);
+  compile_expr(expr->obj);
+  emit(OP_SET_INDEX);
+};
+
+void Compiler::visit(ExpressionStmt *stmt) {
+  compile_expr(stmt->expression);
+  emit(OP_POP);
+};
+
+void Compiler::visit(PrintStmt *stmt) {
+  compile_expr(stmt->expression);
+  emit(OP_PRINT);
+};
+
+void Compiler::visit(VariableDeclarationStmt *stmt) {
+  line = stmt->name.line;
+  declare_variable(stmt->name.lexeme);
+  compile_expr(stmt->initializer);
+  define_variable(stmt->name.lexeme);
+};
+
+void Compiler::visit(AssignmentStmt *stmt) {
+  compile_expr(stmt->value);
+  line = stmt->name.line;
+  emit_variable_set(stmt->name.lexeme);
+};
+
+void Compiler::visit(BlockStmt *stmt) {
+  begin_scope();
+  for (Statement *statement : stmt->statements)
+    compile_expr(statement);
+  end_scope();
+};
+
+void Compiler::visit(IfStmt *stmt) {
+  int else_jump = compile_condition_jump(stmt->condition);
+
+  compile_branch(stmt->then_branch);
+  if (stmt->else_branch == nullptr)
+    return patch_jump(else_jump);
+
+  int end_jump = emit_jump(OP_JUMP);
+
+  patch_jump(else_jump);
+  compile_branch(stmt->else_branch);
+  patch_jump(end_jump);
+};
+
+void Compiler::visit(WhileStmt *stmt) {
+  int loop_start = chunk().code.size();
+  int exit_jump = compile_condition_jump(stmt->condition);
+
+  compile_branch(stmt->body);
+  emit_loop(loop_start);
+
+  patch_jump(exit_jump);
+};
+
+void Compiler::visit(ForStmt *stmt) {
+  begin_scope();
+  if (stmt->initializer != nullptr)
+    compile_expr(stmt->initializer);
+
+  int loop_start = chunk().code.size();
+  int exit_jump = compile_condition_jump(stmt->condition);
+
+  compile_branch(stmt->body);
+  if (stmt->increment != nullptr) {
+    compile_expr(stmt->increment);
+    emit(OP_POP);
+  }
+  emit_loop(loop_start);
+
+  patch_jump(exit_jump);
+  end_scope();
+};
+
+void Compiler::visit(ReturnStmt *stmt) {
+  compile_expr(stmt->value);
+  line = stmt->keyword.line;
+  emit(OP_RETURN);
+};
+
+void Compiler::visit(ClassStmt *stmt) {
+  line = stmt->name.line;
+  int name = name_constant(stmt->name.lexeme);
+
+  declare_variable(stmt->name.lexeme);
+  emit(OP_CLASS, name);
+  define_variable(stmt->name.lexeme);
+
+  emit_variable_get(stmt->name.lexeme);
+  for (FunctionDeclarationStmt *method : stmt->methods) {
+    compile_function(method, CMP_FN_METHOD);
+    line = method->name.line;
+    emit(OP_METHOD, name_constant(method->name.lexeme));
+  }
+  emit(OP_POP);
+};
+
+void Compiler::visit(FunctionDeclarationStmt *stmt) {
+  line = stmt->name.line;
+  declare_variable(stmt->name.lexeme);
+
+  // Mark a local function initialized up front so its body can recurse.
+  if (current->scope_depth > 0)
+    current->locals.back().depth = current->scope_depth;
+
+  compile_function(stmt, CMP_FN_FUNCTION);
+  define_variable(stmt->name.lexeme);
+};
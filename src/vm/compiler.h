@@ -0,0 +1,109 @@
+#pragma once
+
+#include "../parser/expression.h"
+#include "../variable/global_table.h"
+#include "vm_objects.h"
+
+enum CompilerFunctionType {
+  CMP_FN_SCRIPT,
+  CMP_FN_FUNCTION,
+  CMP_FN_METHOD,
+};
+
+struct CompilerLocal {
+  std::string_view name;
+  int depth;
+  bool is_captured;
+};
+
+struct CompilerUpvalue {
+  uint8_t index;
+  bool is_local;
+};
+
+// Per-function compilation state. Locals mirror the layout of the function's
+// window on the VM stack: slot 0 holds the callee (or `this` for methods).
+struct CompilerFunctionState {
+  CompilerFunctionState *enclosing;
+  RuntimeBytecodeFunction *function;
+  CompilerFunctionType type;
+  std::vector<CompilerLocal> locals;
+  std::vector<CompilerUpvalue> upvalues;
+  SymbolMap<int> name_constants;
+  int scope_depth;
+};
+
+// Lowers a resolved program into bytecode for the VM. The Resolver has already
+// rejected invalid programs, so the compiler only has to lay out storage.
+class Compiler : public ExpressionVisitor<void>, public GcRootSource {
+public:
+  Compiler(GlobalTable *globals)
+      : globals(globals), current(nullptr), line(1) {
+    runtime_heap.add_root_source(this);
+  }
+
+  ~Compiler() { runtime_heap.remove_root_source(this); }
+
+  RuntimeBytecodeFunction *compile(std::vector<Expression *> exprs);
+  void mark_roots(Heap &heap) override;
+
+  void visit(BinaryExpr *expr) override;
+  void visit(GroupingExpr *expr) override;
+  void visit(LiteralExpr *expr) override;
+  void visit(UnaryExpr *expr) override;
+  void visit(CallExpr *expr) override;
+  void visit(VariableReferenceExpr *expr) override;
+  void visit(GetExpr *expr) override;
+  void visit(SetExpr *expr) override;
+  void visit(ThisExpr *expr) override;
+  void visit(ArrayExpr *expr) override;
+  void visit(IndexExpr *expr) override;
+  void visit(SetIndexExpr *expr) override;
+
+  void visit(ExpressionStmt *stmt) override;
+  void visit(PrintStmt *stmt) override;
+  void visit(VariableDeclarationStmt *stmt) override;
+  void visit(AssignmentStmt *stmt) override;
+  void visit(BlockStmt *stmt) override;
+  void visit(IfStmt *stmt) override;
+  void visit(WhileStmt *stmt) override;
+  void visit(ForStmt *stmt) override;
+  void visit(ReturnStmt *stmt) override;
+  void visit(ClassStmt *stmt) override;
+  void visit(FunctionDeclarationStmt *stmt) override;
+
+private:
+  void compile_expr(Expression *expr);
+  void compile_branch(Statement *stmt);
+  bool compile_local_constant(BinaryExpr *expr);
+  int compile_condition_jump(Expression *condition);
+  void compile_function(FunctionDeclarationStmt *declaration,
+                        CompilerFunctionType type);
+
+  void begin_function(CompilerFunctionState *state, std::string name,
+                      int arity, CompilerFunctionType type);
+  RuntimeBytecodeFunction *end_function();
+  void begin_scope();
+  void end_scope();
+
+  void declare_variable(std::string_view name);
+  void define_variable(std::string_view name);
+  void emit_variable_get(std::string_view name);
+  void emit_variable_set(std::string_view name);
+  int resolve_local(CompilerFunctionState *state, std::string_view name);
+  int resolve_upvalue(CompilerFunctionState *state, std::string_view name);
+  int add_upvalue(CompilerFunctionState *state, uint8_t index, bool is_local);
+
+  void emit(uint8_t byte);
+  void emit(OpCode op, uint16_t operand);
+  int emit_jump(OpCode op);
+  void patch_jump(int offset);
+  void emit_loop(int loop_start);
+  int make_constant(Value value);
+  int name_constant(std::string_view name);
+  Chunk &chunk();
+
+  GlobalTable *globals;
+  CompilerFunctionState *current;
+  int line;
+};
@@ -0,0 +1,1036 @@
+#include "jit.h"
+#include "vm.h"
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#ifdef ORCA_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+Jit::~Jit() {
+#ifdef ORCA_JIT
+  for (const std::unique_ptr<JitCode> &code : compiled)
+    munmap(code->memory, code->mapped_size);
+#endif
+}
+
+bool Jit::is_supported() {
+#ifdef ORCA_JIT
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Jit::run(JitCode *code, CallFrame *frame) {
+  const uint8_t *start = frame->closure->function->chunk.code.data();
+  if (code->entry(vm, frame, code->memory + code->offsets[frame->ip - start]))
+    return;
+
+  std::exception_ptr thrown = error;
+  error = nullptr;
+  std::rethrow_exception(thrown);
+}
+
+void Jit::print_stats(FILE *out) const {
+  fprintf(out, "-- jit stats --\n");
+  fprintf(out, "functions:         %zu\n", compiled.size());
+  fprintf(out, "code bytes:        %zu\n", code_bytes);
+}
+
+#ifndef ORCA_JIT
+JitCode *Jit::compile(RuntimeBytecodeFunction *function) { return nullptr; }
+#else
+
+// ===============
+// === Runtime ===
+// ===============
+
+// What compiled code calls for anything it does not do inline. Each takes
+// the VM and the running frame, with the VM's stack top and the frame's ip
+// already written back, followed by the instruction's decoded operands.
+class JitRuntime {
+public:
+  static void binary(VM &vm, CallFrame *frame, int op) {
+    Value b = vm.pop();
+    Value a = vm.pop();
+
+    switch (op) {
+    case OP_ADD:
+      vm.site_kind = "binary";
+      return vm.push(a + b);
+    case OP_SUBTRACT:
+      return vm.push(a - b);
+    case OP_MULTIPLY:
+      return vm.push(a * b);
+    case OP_DIVIDE:
+      return vm.push(a / b);
+    case OP_EQUAL:
+      return vm.push(Value::boolean(a == b));
+    case OP_NOT_EQUAL:
+      return vm.push(Value::boolean(a != b));
+    case OP_GREATER:
+      return vm.push(Value::boolean(a > b));
+    case OP_GREATER_EQUAL:
+      return vm.push(Value::boolean(a >= b));
+    case OP_LESS:
+      return vm.push(Value::boolean(a < b));
+    case OP_LESS_EQUAL:
+      return vm.push(Value::boolean(a <= b));
+    }
+    throw "Invalid instruction.";
+  }
+
+  static void add_local_constant(VM &vm, CallFrame *frame, int slot,
+                                 Value constant) {
+    vm.site_kind = "binary";
+    vm.push(frame->slots[slot] + constant);
+  }
+
+  static void subtract_local_constant(VM &vm, CallFrame *frame, int slot,
+                                      Value constant) {
+    vm.push(frame->slots[slot] - constant);
+  }
+
+  static void not_(VM &vm, CallFrame *frame) {
+    vm.push(Value::boolean(!vm.pop().is_truthy()));
+  }
+
+  static void negate(VM &vm, CallFrame *frame) {
+    Value right = vm.pop();
+    vm.push(right.is_number() ? Value::number(0) - right : Value::nil());
+  }
+
+  static void get_upvalue(VM &vm, CallFrame *frame, int index) {
+    vm.push(*frame->closure->upvalues[index]->location);
+  }
+
+  static void set_upvalue(VM &vm, CallFrame *frame, int index) {
+    *frame->closure->upvalues[index]->location = vm.peek(0);
+  }
+
+  static void get_global(VM &vm, CallFrame *frame, int index) {
+    vm.push(vm.globals.get(index));
+  }
+
+  static void define_global(VM &vm, CallFrame *frame, int index) {
+    vm.globals.define(index, vm.pop());
+  }
+
+  static void set_global(VM &vm, CallFrame *frame, int index) {
+    vm.globals.assign(index, vm.peek(0));
+  }
+
+  static void close_upvalue(VM &vm, CallFrame *frame) {
+    vm.close_upvalues(vm.stack_top - 1);
+    vm.pop();
+  }
+
+  static void get_property(VM &vm, CallFrame *frame, const Symbol *name,
+                           PropertyCache *cache) {
+    vm.stack_top[-1] = vm.get_property(vm.peek(0), name, *cache);
+  }
+
+  static void get_local_property(VM &vm, CallFrame *frame, int slot,
+                                 const Symbol *name, PropertyCache *cache) {
+    vm.push(vm.get_property(frame->slots[slot], name, *cache));
+  }
+
+  static void set_property(VM &vm, CallFrame *frame, const Symbol *name,
+                           PropertyCache *cache) {
+    vm.set_property(name, *cache);
+  }
+
+  static void get_index(VM &vm, CallFrame *frame) { vm.get_index(); }
+  static void set_index(VM &vm, CallFrame *frame) { vm.set_index(); }
+  static void array(VM &vm, CallFrame *frame, int count) {
+    vm.make_array(count);
+  }
+
+  static void print(VM &vm, CallFrame *frame) {
+    printf("%s\n", vm.pop().as_string().c_str());
+  }
+
+  // A callee that was not compiled itself runs in a nested interpreter loop,
+  // which returns once the callee does.
+  static void call(VM &vm, CallFrame *frame, int argc) {
+    int caller_count = vm.frame_count;
+    vm.site_kind = "call";
+    vm.call_value(vm.peek(argc), argc);
+    if (vm.frame_count > caller_count)
+      vm.run();
+  }
+
+  static void invoke(VM &vm, CallFrame *frame, const Symbol *name,
+                     PropertyCache *cache, int argc) {
+    int caller_count = vm.frame_count;
+    vm.invoke(name, *cache, argc);
+    if (vm.frame_count > caller_count)
+      vm.run();
+  }
+
+  static void closure(VM &vm, CallFrame *frame,
+                      RuntimeBytecodeFunction *function,
+                      const uint8_t *operands) {
+    vm.make_closure(frame, function, operands);
+  }
+
+  static void return_(VM &vm, CallFrame *frame) { vm.return_from(frame); }
+
+  static void class_(VM &vm, CallFrame *frame, const Symbol *name) {
+    vm.site_kind = "class";
+    vm.push(Value::object(runtime_heap.allocate<RuntimeClass>(
+        name->name, SymbolMap<RuntimeCallable *>())));
+  }
+
+  static void method(VM &vm, CallFrame *frame, const Symbol *name) {
+    RuntimeCallable *method = (RuntimeCallable *)vm.pop().as_object();
+    ((RuntimeClass *)vm.peek(0).as_object())
+        ->methods.insert_or_assign(name, method);
+  }
+
+  static void overflow(VM &vm, CallFrame *frame) { throw "Stack overflow."; }
+
+  static int32_t stack_top_offset(VM *vm) {
+    return (char *)&vm->stack_top - (char *)vm;
+  }
+
+  static Value *stack_limit(VM *vm) {
+    return vm->stack.get() + VM::STACK_MAX;
+  }
+
+  static void set_error(VM *vm) { vm->jit->error = std::current_exception(); }
+};
+
+// Machine code cannot be unwound through, so every call into the runtime
+// goes through one of these, which turns an exception into a false return
+// for the compiled code to pass on.
+template <auto body> struct Guarded;
+
+template <typename... Args, void (*body)(VM &, CallFrame *, Args...)>
+struct Guarded<body> {
+  static bool call(VM *vm, CallFrame *frame, Args... args) {
+    try {
+      body(*vm, frame, args...);
+      return true;
+    } catch (...) {
+      JitRuntime::set_error(vm);
+      return false;
+    }
+  }
+};
+
+// =================
+// === Assembler ===
+// =================
+
+enum Register : uint8_t {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+enum Xmm : uint8_t { XMM0, XMM1 };
+
+// Negating a condition flips its lowest bit.
+enum Condition : uint8_t {
+  CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6,
+  CC_A = 0x7, CC_S = 0x8, CC_P = 0xa, CC_NP = 0xb, CC_L = 0xc, CC_GE = 0xd,
+  CC_LE = 0xe, CC_G = 0xf,
+};
+
+// A jump target. Jumps to a label that is not bound yet leave their rel32
+// to be filled in by bind().
+struct Label {
+  int offset = -1;
+  std::vector<int> uses;
+};
+
+// Just enough of x86-64 for the templates below.
+class Assembler {
+public:
+  std::vector<uint8_t> code;
+
+  int size() const { return code.size(); }
+
+  void byte(uint8_t value) { code.push_back(value); }
+  void u32(uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+      byte(value >> (8 * i));
+  }
+  void u64(uint64_t value) {
+    for (int i = 0; i < 8; ++i)
+      byte(value >> (8 * i));
+  }
+
+  void mov(Register dst, Register src) { alu64(0x89, dst, src); }
+  void mov_imm(Register dst, uint64_t value) {
+    if (value <= UINT32_MAX) {
+      rex(false, 0, dst);
+      byte(0xb8 + (dst & 7));
+      u32(value);
+    } else {
+      rex(true, 0, dst);
+      byte(0xb8 + (dst & 7));
+      u64(value);
+    }
+  }
+  void load(Register dst, Register base, int32_t disp) {
+    rex(true, dst, base);
+    byte(0x8b);
+    memory(dst, base, disp);
+  }
+  void store(Register base, int32_t disp, Register src) {
+    rex(true, src, base);
+    byte(0x89);
+    memory(src, base, disp);
+  }
+
+  // 64-bit `op dst, src` for the 0x01 (add), 0x09 (or), 0x29 (sub), 0x39
+  // (cmp), 0x85 (test) and 0x89 (mov) forms.
+  void alu64(uint8_t op, Register dst, Register src) {
+    rex(true, src, dst);
+    byte(op);
+    direct(src, dst);
+  }
+  // The same, on the low 32 bits, which zeroes the upper ones.
+  void alu32(uint8_t op, Register dst, Register src) {
+    rex(false, src, dst);
+    byte(op);
+    direct(src, dst);
+  }
+  void imul32(Register dst, Register src) {
+    rex(false, dst, src);
+    byte(0x0f);
+    byte(0xaf);
+    direct(dst, src);
+  }
+  // `op dst, imm` where `ext` is 0 (add), 4 (and), 5 (sub) or 7 (cmp).
+  void alu64_imm(int ext, Register dst, int32_t value) {
+    rex(true, 0, dst);
+    immediate(ext, dst, value);
+  }
+  void alu32_imm(int ext, Register dst, int32_t value) {
+    rex(false, 0, dst);
+    immediate(ext, dst, value);
+  }
+  void shr64(Register dst, uint8_t count) {
+    rex(true, 0, dst);
+    byte(0xc1);
+    direct(5, dst);
+    byte(count);
+  }
+  // Only for the registers whose low byte needs no REX prefix.
+  void setcc(Condition cc, Register dst) {
+    byte(0x0f);
+    byte(0x90 + cc);
+    direct(0, dst);
+  }
+  void movzx8(Register dst, Register src) {
+    byte(0x0f);
+    byte(0xb6);
+    direct(dst, src);
+  }
+  void test8(Register reg) {
+    byte(0x84);
+    direct(reg, reg);
+  }
+
+  // Scalar double `op dst, src` with the given mandatory prefix, such as
+  // 0xf2 0x58 for addsd.
+  void sse(uint8_t prefix, uint8_t op, Xmm dst, Xmm src) {
+    byte(prefix);
+    byte(0x0f);
+    byte(op);
+    direct(dst, src);
+  }
+  void ucomisd(Xmm a, Xmm b) { sse(0x66, 0x2e, a, b); }
+  void cvtsi2sd(Xmm dst, Register src) {
+    byte(0xf2);
+    rex(false, dst, src);
+    byte(0x0f);
+    byte(0x2a);
+    direct(dst, src);
+  }
+  void cvttsd2si(Register dst, Xmm src) {
+    byte(0xf2);
+    rex(false, dst, src);
+    byte(0x0f);
+    byte(0x2c);
+    direct(dst, src);
+  }
+  void movq(Xmm dst, Register src) {
+    byte(0x66);
+    rex(true, dst, src);
+    byte(0x0f);
+    byte(0x6e);
+    direct(dst, src);
+  }
+  void movq(Register dst, Xmm src) {
+    byte(0x66);
+    rex(true, src, dst);
+    byte(0x0f);
+    byte(0x7e);
+    direct(src, dst);
+  }
+
+  void push(Register reg) {
+    rex(false, 0, reg);
+    byte(0x50 + (reg & 7));
+  }
+  void pop(Register reg) {
+    rex(false, 0, reg);
+    byte(0x58 + (reg & 7));
+  }
+  void call(Register reg) {
+    rex(false, 0, reg);
+    byte(0xff);
+    direct(2, reg);
+  }
+  void jmp(Register reg) {
+    rex(false, 0, reg);
+    byte(0xff);
+    direct(4, reg);
+  }
+  void ret() { byte(0xc3); }
+  void ud2() {
+    byte(0x0f);
+    byte(0x0b);
+  }
+
+  void jmp(Label &label) {
+    byte(0xe9);
+    target(label);
+  }
+  void jcc(Condition cc, Label &label) {
+    byte(0x0f);
+    byte(0x80 + cc);
+    target(label);
+  }
+
+  void bind(Label &label) {
+    label.offset = size();
+    for (int use : label.uses)
+      patch(use, label.offset);
+    label.uses.clear();
+  }
+
+private:
+  void rex(bool wide, int reg, int rm) {
+    uint8_t prefix = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+    if (prefix != 0x40)
+      byte(prefix);
+  }
+  void direct(int reg, int rm) { byte(0xc0 | ((reg & 7) << 3) | (rm & 7)); }
+  void memory(int reg, Register base, int32_t disp) {
+    bool short_disp = disp >= -128 && disp <= 127;
+    byte((short_disp ? 0x40 : 0x80) | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP)
+      byte(0x24);
+    if (short_disp)
+      byte(disp);
+    else
+      u32(disp);
+  }
+  void immediate(int ext, Register dst, int32_t value) {
+    if (value >= -128 && value <= 127) {
+      byte(0x83);
+      direct(ext, dst);
+      byte(value);
+    } else {
+      byte(0x81);
+      direct(ext, dst);
+      u32(value);
+    }
+  }
+
+  void target(Label &label) {
+    int at = size();
+    u32(0);
+    if (label.offset >= 0)
+      patch(at, label.offset);
+    else
+      label.uses.push_back(at);
+  }
+  void patch(int at, int destination) {
+    uint32_t rel = destination - (at + 4);
+    memcpy(&code[at], &rel, sizeof(rel));
+  }
+};
+
+// =====================
+// === CodeGenerator ===
+// =====================
+
+// Registers that hold the same thing throughout a compiled function. All are
+// callee-saved, so they survive calls into the runtime.
+static const Register VM_REG = RBX;
+static const Register FRAME = R12;
+static const Register TOP = R13;
+static const Register SLOTS = R14;
+static const Register LIMIT = R15;
+
+static const uint32_t INT_TAG_HIGH = Value::integer(0).bits >> 32;
+static const uint64_t INT_TAG = Value::integer(0).bits;
+// The quiet NaN bits, from bit 50 up.
+static const int32_t QNAN_HIGH = 0x1fff;
+
+// Emits one template per instruction, in bytecode order, so that any
+// instruction can be jumped to or entered at.
+class CodeGenerator {
+public:
+  CodeGenerator(VM *vm, RuntimeBytecodeFunction *function)
+      : labels(function->chunk.code.size()), vm(vm), chunk(function->chunk),
+        top_offset(JitRuntime::stack_top_offset(vm)) {}
+
+  void generate() {
+    prologue();
+    for (int offset = 0; offset < (int)chunk.code.size();) {
+      masm.bind(labels[offset]);
+      offset = instruction(offset);
+    }
+    // The compiler always ends a function with a return.
+    masm.ud2();
+    epilogue();
+  }
+
+  Assembler masm;
+  std::vector<Label> labels;
+
+private:
+  // Called with the VM, the frame and the target's address; sets up the
+  // fixed registers and jumps to the target.
+  void prologue() {
+    masm.push(RBP);
+    masm.mov(RBP, RSP);
+    masm.push(VM_REG);
+    masm.push(FRAME);
+    masm.push(TOP);
+    masm.push(SLOTS);
+    masm.push(LIMIT);
+    // Keeps the stack 16-byte aligned at calls.
+    masm.alu64_imm(5, RSP, 8);
+
+    masm.mov(VM_REG, RDI);
+    masm.mov(FRAME, RSI);
+    masm.load(TOP, VM_REG, top_offset);
+    masm.load(SLOTS, FRAME, offsetof(CallFrame, slots));
+    masm.mov_imm(LIMIT, (uint64_t)JitRuntime::stack_limit(vm));
+    masm.jmp(RDX);
+  }
+
+  void epilogue() {
+    masm.bind(returned);
+    masm.store(VM_REG, top_offset, TOP);
+    masm.mov_imm(RAX, 1);
+    Label done;
+    masm.jmp(done);
+
+    masm.bind(overflowed);
+    call_runtime<JitRuntime::overflow>(0);
+
+    masm.bind(failed);
+    masm.mov_imm(RAX, 0);
+
+    masm.bind(done);
+    masm.alu64_imm(0, RSP, 8);
+    masm.pop(LIMIT);
+    masm.pop(SLOTS);
+    masm.pop(TOP);
+    masm.pop(FRAME);
+    masm.pop(VM_REG);
+    masm.pop(RBP);
+    masm.ret();
+  }
+
+  // Writes back the stack top and the ip `next`, calls `body` with the
+  // given operands and reloads the stack top, leaving through `failed` if it
+  // threw.
+  template <auto body, typename... Args>
+  void call_runtime(int next, Args... args) {
+    static const Register ARGUMENTS[] = {RDX, RCX, R8, R9};
+    uint64_t values[] = {0, (uint64_t)args...};
+
+    masm.store(VM_REG, top_offset, TOP);
+    masm.mov_imm(RAX, (uint64_t)(chunk.code.data() + next));
+    masm.store(FRAME, offsetof(CallFrame, ip), RAX);
+    masm.mov(RDI, VM_REG);
+    masm.mov(RSI, FRAME);
+    for (size_t i = 0; i < sizeof...(args); ++i)
+      masm.mov_imm(ARGUMENTS[i], values[i + 1]);
+    masm.mov_imm(RAX, (uint64_t)&Guarded<body>::call);
+    masm.call(RAX);
+    masm.test8(RAX);
+    masm.jcc(CC_E, failed);
+    masm.load(TOP, VM_REG, top_offset);
+  }
+
+  void push(Register reg) {
+    masm.alu64(0x39, TOP, LIMIT);
+    masm.jcc(CC_AE, overflowed);
+    masm.store(TOP, 0, reg);
+    masm.alu64_imm(0, TOP, 8);
+  }
+
+  void push_constant(uint64_t bits) {
+    masm.mov_imm(RAX, bits);
+    push(RAX);
+  }
+
+  // Jumps to `slow` unless `reg` holds a small integer. Clobbers RDX.
+  void check_int(Register reg, Label &slow) {
+    masm.mov(RDX, reg);
+    masm.shr64(RDX, 32);
+    masm.alu32_imm(7, RDX, INT_TAG_HIGH);
+    masm.jcc(CC_NE, slow);
+  }
+
+  // Loads the two operands on top of the stack into RAX and RCX.
+  void load_operands() {
+    masm.load(RAX, TOP, -16);
+    masm.load(RCX, TOP, -8);
+  }
+
+  // Converts the number in `reg` to a double in `xmm`, jumping to `slow` if
+  // it is not a number. Clobbers RDX.
+  void load_double(Register reg, Xmm xmm, Label &slow) {
+    Label is_double, done;
+    check_int(reg, is_double);
+    masm.cvtsi2sd(xmm, reg);
+    masm.jmp(done);
+
+    // Anything else with all of the quiet NaN bits set is boxed.
+    masm.bind(is_double);
+    masm.mov(RDX, reg);
+    masm.shr64(RDX, 50);
+    masm.alu32_imm(4, RDX, QNAN_HIGH);
+    masm.alu32_imm(7, RDX, QNAN_HIGH);
+    masm.jcc(CC_E, slow);
+    masm.movq(xmm, reg);
+    masm.bind(done);
+  }
+
+  // Boxes the double in XMM0 into RAX the way Value::number() does: as a
+  // small integer if it is one, and with NaN made canonical.
+  void box_double() {
+    Label not_int, boxed;
+    masm.cvttsd2si(RCX, XMM0);
+    masm.cvtsi2sd(XMM1, RCX);
+    masm.ucomisd(XMM0, XMM1);
+    masm.jcc(CC_NE, not_int);
+    masm.jcc(CC_P, not_int);
+    // Zero is only an integer if it is not -0.
+    masm.movq(RAX, XMM0);
+    masm.alu64(0x85, RAX, RAX);
+    masm.jcc(CC_S, not_int);
+    masm.alu32(0x89, RAX, RCX);
+    masm.mov_imm(RDX, INT_TAG);
+    masm.alu64(0x09, RAX, RDX);
+    masm.jmp(boxed);
+
+    masm.bind(not_int);
+    masm.movq(RAX, XMM0);
+    masm.ucomisd(XMM0, XMM0);
+    masm.jcc(CC_NP, boxed);
+    masm.mov_imm(RAX, Value::number(NAN).bits);
+    masm.bind(boxed);
+  }
+
+  // Replaces the two operands with RAX.
+  void store_result() {
+    masm.store(TOP, -16, RAX);
+    masm.alu64_imm(5, TOP, 8);
+  }
+
+  // Replaces the two operands with whether `cc` holds.
+  void store_condition(Condition cc) {
+    masm.setcc(cc, RDX);
+    masm.movzx8(RDX, RDX);
+    masm.mov_imm(RAX, Value::boolean(false).bits);
+    masm.alu64(0x01, RAX, RDX);
+    store_result();
+  }
+
+  // Two small integers are worked on directly and any other pair of numbers
+  // as doubles; on overflow the integers are redone as doubles, as is a zero
+  // product of a negative integer, which is -0.
+  void arithmetic(int offset, OpCode op) {
+    Label doubles, slow, done;
+    load_operands();
+    if (op != OP_DIVIDE) {
+      check_int(RAX, doubles);
+      check_int(RCX, doubles);
+      if (op == OP_ADD)
+        masm.alu32(0x01, RAX, RCX);
+      else if (op == OP_SUBTRACT)
+        masm.alu32(0x29, RAX, RCX);
+      else
+        masm.imul32(RAX, RCX);
+      masm.jcc(CC_O, doubles);
+      if (op == OP_MULTIPLY) {
+        Label nonzero;
+        masm.alu32(0x85, RAX, RAX);
+        masm.jcc(CC_NE, nonzero);
+        masm.load(RAX, TOP, -16);
+        masm.alu32(0x09, RAX, RCX);
+        masm.jcc(CC_S, doubles);
+        masm.alu32(0x31, RAX, RAX);
+        masm.bind(nonzero);
+      }
+      masm.mov_imm(RDX, INT_TAG);
+      masm.alu64(0x09, RAX, RDX);
+      store_result();
+      masm.jmp(done);
+
+      masm.bind(doubles);
+      load_operands();
+    }
+
+    load_double(RAX, XMM0, slow);
+    load_double(RCX, XMM1, slow);
+    static const uint8_t SSE_OPS[] = {0x58, 0x5c, 0x59, 0x5e};
+    masm.sse(0xf2, SSE_OPS[op - OP_ADD], XMM0, XMM1);
+    box_double();
+    store_result();
+    masm.jmp(done);
+
+    masm.bind(slow);
+    call_runtime<JitRuntime::binary>(offset + 1, (int)op);
+    masm.bind(done);
+  }
+
+  static Condition int_condition(OpCode op) {
+    switch (op) {
+    case OP_EQUAL:
+      return CC_E;
+    case OP_NOT_EQUAL:
+      return CC_NE;
+    case OP_GREATER:
+      return CC_G;
+    case OP_GREATER_EQUAL:
+      return CC_GE;
+    case OP_LESS:
+      return CC_L;
+    default:
+      return CC_LE;
+    }
+  }
+
+  // Compares XMM0 with XMM1 so that the returned condition holds if `op`
+  // does. Every ordered comparison with NaN is false, and ucomisd reports an
+  // unordered pair as below and equal, so only "above" conditions are used.
+  Condition double_condition(OpCode op) {
+    if (op == OP_LESS || op == OP_LESS_EQUAL)
+      masm.ucomisd(XMM1, XMM0);
+    else
+      masm.ucomisd(XMM0, XMM1);
+    return op == OP_LESS || op == OP_GREATER ? CC_A : CC_AE;
+  }
+
+  // Equality of anything but two small integers is left to the runtime,
+  // since it covers strings and NaN.
+  void comparison(int offset, OpCode op) {
+    Label doubles, slow, done;
+    load_operands();
+    check_int(RAX, doubles);
+    check_int(RCX, doubles);
+    masm.alu32(0x39, RAX, RCX);
+    store_condition(int_condition(op));
+    masm.jmp(done);
+
+    masm.bind(doubles);
+    if (op != OP_EQUAL && op != OP_NOT_EQUAL) {
+      load_double(RAX, XMM0, slow);
+      load_double(RCX, XMM1, slow);
+      store_condition(double_condition(op));
+      masm.jmp(done);
+    }
+
+    masm.bind(slow);
+    call_runtime<JitRuntime::binary>(offset + 1, (int)op);
+    masm.bind(done);
+  }
+
+  // Pops the condition and jumps to `target` if it is nil or false, which
+  // are the two values just below true.
+  void jump_if_false(Label &target) {
+    masm.load(RAX, TOP, -8);
+    masm.alu64_imm(5, TOP, 8);
+    masm.mov_imm(RCX, Value::nil().bits);
+    masm.alu64(0x29, RAX, RCX);
+    masm.alu64_imm(7, RAX, 1);
+    masm.jcc(CC_BE, target);
+  }
+
+  void compare_jump(int offset, OpCode compare, Label &target) {
+    Label doubles, slow, done;
+    load_operands();
+    check_int(RAX, doubles);
+    check_int(RCX, doubles);
+    masm.alu64_imm(5, TOP, 16);
+    masm.alu32(0x39, RAX, RCX);
+    masm.jcc((Condition)(int_condition(compare) ^ 1), target);
+    masm.jmp(done);
+
+    masm.bind(doubles);
+    load_double(RAX, XMM0, slow);
+    load_double(RCX, XMM1, slow);
+    masm.alu64_imm(5, TOP, 16);
+    masm.jcc((Condition)(double_condition(compare) ^ 1), target);
+    masm.jmp(done);
+
+    masm.bind(slow);
+    call_runtime<JitRuntime::binary>(offset + 3, (int)compare);
+    jump_if_false(target);
+    masm.bind(done);
+  }
+
+  void local_constant(int offset, OpCode op) {
+    int slot = chunk.code[offset + 1];
+    Value constant = chunk.constants[chunk.read_u16(offset + 2)];
+    Label slow, done;
+
+    if (constant.is_int()) {
+      masm.load(RAX, SLOTS, 8 * slot);
+      check_int(RAX, slow);
+      masm.alu32_imm(op == OP_ADD_LOCAL_CONSTANT ? 0 : 5, RAX,
+                     constant.as_int());
+      masm.jcc(CC_O, slow);
+      masm.mov_imm(RDX, INT_TAG);
+      masm.alu64(0x09, RAX, RDX);
+      push(RAX);
+      masm.jmp(done);
+    }
+
+    masm.bind(slow);
+    if (op == OP_ADD_LOCAL_CONSTANT)
+      call_runtime<JitRuntime::add_local_constant>(offset + 4, slot,
+                                                   constant.bits);
+    else
+      call_runtime<JitRuntime::subtract_local_constant>(offset + 4, slot,
+                                                        constant.bits);
+    masm.bind(done);
+  }
+
+  const Symbol *symbol_at(int offset) {
+    return ((RuntimeString *)chunk.constants[chunk.read_u16(offset)]
+                .as_object())
+        ->symbol;
+  }
+
+  PropertyCache *cache_at(int offset) {
+    return &chunk.property_caches[chunk.read_u16(offset)];
+  }
+
+  // Emits the template for the instruction at `offset` and returns the
+  // offset of the next one.
+  int instruction(int offset) {
+    OpCode op = (OpCode)chunk.code[offset];
+    const uint8_t *code = chunk.code.data();
+
+    switch (op) {
+    case OP_CONSTANT:
+      push_constant(chunk.constants[chunk.read_u16(offset + 1)].bits);
+      return offset + 3;
+    case OP_NIL:
+      push_constant(Value::nil().bits);
+      return offset + 1;
+    case OP_TRUE:
+      push_constant(Value::boolean(true).bits);
+      return offset + 1;
+    case OP_FALSE:
+      push_constant(Value::boolean(false).bits);
+      return offset + 1;
+    case OP_POP:
+      masm.alu64_imm(5, TOP, 8);
+      return offset + 1;
+
+    case OP_GET_LOCAL:
+      masm.load(RAX, SLOTS, 8 * code[offset + 1]);
+      push(RAX);
+      return offset + 2;
+    case OP_SET_LOCAL:
+      masm.load(RAX, TOP, -8);
+      masm.store(SLOTS, 8 * code[offset + 1], RAX);
+      return offset + 2;
+    case OP_GET_UPVALUE:
+      call_runtime<JitRuntime::get_upvalue>(offset + 2, (int)code[offset + 1]);
+      return offset + 2;
+    case OP_SET_UPVALUE:
+      call_runtime<JitRuntime::set_upvalue>(offset + 2, (int)code[offset + 1]);
+      return offset + 2;
+    case OP_GET_GLOBAL:
+      call_runtime<JitRuntime::get_global>(offset + 3,
+                                           (int)chunk.read_u16(offset + 1));
+      return offset + 3;
+    case OP_DEFINE_GLOBAL:
+      call_runtime<JitRuntime::define_global>(offset + 3,
+                                              (int)chunk.read_u16(offset + 1));
+      return offset + 3;
+    case OP_SET_GLOBAL:
+      call_runtime<JitRuntime::set_global>(offset + 3,
+                                           (int)chunk.read_u16(offset + 1));
+      return offset + 3;
+    case OP_CLOSE_UPVALUE:
+      call_runtime<JitRuntime::close_upvalue>(offset + 1);
+      return offset + 1;
+
+    case OP_GET_PROPERTY:
+      call_runtime<JitRuntime::get_property>(offset + 5, symbol_at(offset + 1),
+                                             cache_at(offset + 3));
+      return offset + 5;
+    case OP_SET_PROPERTY:
+      call_runtime<JitRuntime::set_property>(offset + 5, symbol_at(offset + 1),
+                                             cache_at(offset + 3));
+      return offset + 5;
+    case OP_GET_INDEX:
+      call_runtime<JitRuntime::get_index>(offset + 1);
+      return offset + 1;
+    case OP_SET_INDEX:
+      call_runtime<JitRuntime::set_index>(offset + 1);
+      return offset + 1;
+    case OP_ARRAY:
+      call_runtime<JitRuntime::array>(offset + 3,
+                                      (int)chunk.read_u16(offset + 1));
+      return offset + 3;
+
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_GREATER:
+    case OP_GREATER_EQUAL:
+    case OP_LESS:
+    case OP_LESS_EQUAL:
+      comparison(offset, op);
+      return offset + 1;
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+      arithmetic(offset, op);
+      return offset + 1;
+    case OP_DIVIDE:
+      call_runtime<JitRuntime::binary>(offset + 1, (int)op);
+      return offset + 1;
+    case OP_NOT:
+      call_runtime<JitRuntime::not_>(offset + 1);
+      return offset + 1;
+    case OP_NEGATE:
+      call_runtime<JitRuntime::negate>(offset + 1);
+      return offset + 1;
+
+    case OP_PRINT:
+      call_runtime<JitRuntime::print>(offset + 1);
+      return offset + 1;
+    case OP_JUMP:
+      masm.jmp(labels[offset + 3 + chunk.read_u16(offset + 1)]);
+      return offset + 3;
+    case OP_JUMP_IF_FALSE:
+      jump_if_false(labels[offset + 3 + chunk.read_u16(offset + 1)]);
+      return offset + 3;
+    case OP_LOOP:
+      masm.jmp(labels[offset + 3 - chunk.read_u16(offset + 1)]);
+      return offset + 3;
+
+    case OP_CALL:
+      call_runtime<JitRuntime::call>(offset + 2, (int)code[offset + 1]);
+      return offset + 2;
+    case OP_INVOKE:
+      call_runtime<JitRuntime::invoke>(offset + 6, symbol_at(offset + 1),
+                                       cache_at(offset + 3),
+                                       (int)code[offset + 5]);
+      return offset + 6;
+    case OP_CLOSURE: {
+      RuntimeBytecodeFunction *function =
+          (RuntimeBytecodeFunction *)chunk.constants[chunk.read_u16(offset + 1)]
+              .as_object();
+      int next = offset + 3 + 2 * function->upvalue_count;
+      call_runtime<JitRuntime::closure>(next, function, code + offset + 3);
+      return next;
+    }
+    case OP_RETURN:
+      call_runtime<JitRuntime::return_>(offset + 1);
+      masm.jmp(returned);
+      return offset + 1;
+    case OP_CLASS:
+      call_runtime<JitRuntime::class_>(offset + 3, symbol_at(offset + 1));
+      return offset + 3;
+    case OP_METHOD:
+      call_runtime<JitRuntime::method>(offset + 3, symbol_at(offset + 1));
+      return offset + 3;
+
+    case OP_ADD_LOCAL_CONSTANT:
+    case OP_SUBTRACT_LOCAL_CONSTANT:
+      local_constant(offset, op);
+      return offset + 4;
+    case OP_GET_LOCAL_PROPERTY:
+      call_runtime<JitRuntime::get_local_property>(
+          offset + 6, (int)code[offset + 1], symbol_at(offset + 2),
+          cache_at(offset + 4));
+      return offset + 6;
+    case OP_JUMP_IF_NOT_LESS:
+    case OP_JUMP_IF_NOT_LESS_EQUAL:
+    case OP_JUMP_IF_NOT_GREATER:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL: {
+      static const OpCode COMPARES[] = {OP_LESS, OP_LESS_EQUAL, OP_GREATER,
+                                        OP_GREATER_EQUAL};
+      compare_jump(offset, COMPARES[op - OP_JUMP_IF_NOT_LESS],
+                   labels[offset + 3 + chunk.read_u16(offset + 1)]);
+      return offset + 3;
+    }
+
+    case OP_COUNT:
+      break;
+    }
+    throw "Invalid instruction.";
+  }
+
+  VM *vm;
+  Chunk &chunk;
+  int32_t top_offset;
+  Label returned;
+  Label overflowed;
+  Label failed;
+};
+
+JitCode *Jit::compile(RuntimeBytecodeFunction *function) {
+  CodeGenerator generator(vm, function);
+  generator.generate();
+  const std::vector<uint8_t> &code = generator.masm.code;
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t mapped_size = (code.size() + page - 1) / page * page;
+  void *memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    // Stay interpreted for another round before trying again.
+    function->calls = 0;
+    function->back_edges = 0;
+    return nullptr;
+  }
+
+  // Never writable and executable at once.
+  memcpy(memory, code.data(), code.size());
+  if (mprotect(memory, mapped_size, PROT_READ | PROT_EXEC) != 0) {
+    // The system will not let us run code we wrote, and will not for any
+    // other function either, so the rest of the run stays interpreted.
+    munmap(memory, mapped_size);
+    function->calls = 0;
+    function->back_edges = 0;
+    disabled = true;
+    return nullptr;
+  }
+
+  auto compiled_code = std::make_unique<JitCode>();
+  compiled_code->entry = (JitCode::Entry)memory;
+  compiled_code->memory = (uint8_t *)memory;
+  compiled_code->mapped_size = mapped_size;
+  for (const Label &label : generator.labels)
+    compiled_code->offsets.push_back(label.offset < 0 ? 0 : label.offset);
+
+  function->jit_code = compiled_code.get();
+  code_bytes += code.size();
+  compiled.push_back(std::move(compiled_code));
+  return function->jit_code;
+}
+
+#endif
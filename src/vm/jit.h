@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vm_objects.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <vector>
+
+// The JIT emits x86-64 code for the System V calling convention and maps it
+// with mmap, so it is only built on x86-64 Linux. Elsewhere every function
+// stays interpreted.
+#if defined(__x86_64__) && defined(__linux__)
+#define ORCA_JIT
+#endif
+
+class VM;
+struct CallFrame;
+
+// The machine code for one function. `entry` runs `frame` from `target`, the
+// code of the instruction the frame's ip points at, until the function
+// returns, and answers false if it threw instead.
+struct JitCode {
+  typedef bool (*Entry)(VM *vm, CallFrame *frame, const uint8_t *target);
+
+  Entry entry;
+  uint8_t *memory;
+  size_t mapped_size;
+  // Where the code of each instruction starts, by bytecode offset.
+  std::vector<uint32_t> offsets;
+};
+
+// A baseline compiler from bytecode to machine code. Each instruction turns
+// into a fixed template: locals, constants, jumps, and arithmetic and
+// comparisons on numbers are done inline on the VM stack, and everything
+// else, as well as any operand that is not a number, calls back into the
+// VM's own instruction bodies. There is no register allocation and no
+// inlining across instructions, which keeps compiling a function about as
+// cheap as disassembling it.
+//
+// Compiled code keeps the top of the stack in a register and writes it back
+// before every call into the runtime, along with the frame's ip, so the
+// collector, the profilers and error messages all see what the interpreter
+// would show them.
+class Jit {
+public:
+  Jit(VM *vm, uint32_t threshold) : vm(vm), threshold(threshold) {}
+  ~Jit();
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+
+  static bool is_supported();
+
+  // Count a call of, or a back edge in, `function`. Each returns the
+  // function's code, compiling it when the count reaches the threshold, or
+  // null while it should stay interpreted.
+  JitCode *count_call(RuntimeBytecodeFunction *function) {
+    if (function->jit_code == nullptr && !disabled &&
+        ++function->calls >= threshold)
+      return compile(function);
+    return function->jit_code;
+  }
+  JitCode *count_back_edge(RuntimeBytecodeFunction *function) {
+    if (function->jit_code == nullptr && !disabled &&
+        ++function->back_edges >= threshold)
+      return compile(function);
+    return function->jit_code;
+  }
+
+  // Runs `frame` in `code` from its current ip until it returns, rethrowing
+  // whatever the function threw.
+  void run(JitCode *code, CallFrame *frame);
+
+  void print_stats(FILE *out) const;
+
+  // Set by a call into the runtime that threw, for run() to rethrow once
+  // the compiled code has unwound itself.
+  std::exception_ptr error;
+
+private:
+  JitCode *compile(RuntimeBytecodeFunction *function);
+
+  VM *vm;
+  uint32_t threshold;
+  // Set once the system refuses to make generated code executable.
+  bool disabled = false;
+  std::vector<std::unique_ptr<JitCode>> compiled;
+  size_t code_bytes = 0;
+};
@@ -0,0 +1,600 @@
+#include "vm.h"
+#include "../evaluator/native.h"
+#include <algorithm>
+#include <cstdio>
+
+// GCC and Clang support taking the address of a label, which lets each
+// instruction jump straight to the next one's code through a table instead
+// of returning to a shared switch. Every instruction then has an indirect
+// branch of its own, which the branch predictor can learn separately.
+#if defined(__GNUC__) && !defined(ORCA_NO_COMPUTED_GOTO)
+#define ORCA_COMPUTED_GOTO
+#endif
+
+#ifdef ORCA_COMPUTED_GOTO
+// Every opcode, in the order of OpCode.
+#define VM_OPCODES(X)                                                          \
+  X(OP_CONSTANT) X(OP_NIL) X(OP_TRUE) X(OP_FALSE) X(OP_POP) X(OP_GET_LOCAL)    \
+  X(OP_SET_LOCAL) X(OP_GET_UPVALUE) X(OP_SET_UPVALUE) X(OP_GET_GLOBAL)         \
+  X(OP_DEFINE_GLOBAL) X(OP_SET_GLOBAL) X(OP_CLOSE_UPVALUE) X(OP_GET_PROPERTY)  \
+  X(OP_SET_PROPERTY) X(OP_GET_INDEX) X(OP_SET_INDEX) X(OP_ARRAY) X(OP_EQUAL)   \
+  X(OP_NOT_EQUAL) X(OP_GREATER) X(OP_GREATER_EQUAL) X(OP_LESS)                 \
+  X(OP_LESS_EQUAL) X(OP_ADD) X(OP_SUBTRACT) X(OP_MULTIPLY) X(OP_DIVIDE)        \
+  X(OP_NOT) X(OP_NEGATE) X(OP_PRINT) X(OP_JUMP) X(OP_JUMP_IF_FALSE) X(OP_LOOP) \
+  X(OP_CALL) X(OP_INVOKE) X(OP_CLOSURE) X(OP_RETURN) X(OP_CLASS) X(OP_METHOD)  \
+  X(OP_ADD_LOCAL_CONSTANT) X(OP_SUBTRACT_LOCAL_CONSTANT)                       \
+  X(OP_GET_LOCAL_PROPERTY) X(OP_JUMP_IF_NOT_LESS)                              \
+  X(OP_JUMP_IF_NOT_LESS_EQUAL) X(OP_JUMP_IF_NOT_GREATER)                       \
+  X(OP_JUMP_IF_NOT_GREATER_EQUAL) X(OP_COUNT)
+
+#define OPCODE_VALUE(op) op,
+static constexpr OpCode OPCODE_ORDER[] = {VM_OPCODES(OPCODE_VALUE)};
+#undef OPCODE_VALUE
+
+static constexpr bool opcodes_in_order() {
+  for (int i = 0; i <= OP_COUNT; ++i)
+    if (OPCODE_ORDER[i] != i)
+      return false;
+  return true;
+}
+static_assert(sizeof(OPCODE_ORDER) / sizeof(OpCode) == OP_COUNT + 1 &&
+                  opcodes_in_order(),
+              "VM_OPCODES has to list every opcode in order.");
+#endif
+
+void VM::mark_roots(Heap &heap) {
+  for (Value *slot = stack.get(); slot < stack_top; ++slot)
+    heap.mark(*slot);
+
+  for (int i = 0; i < frame_count; ++i)
+    heap.mark(frames[i].closure);
+
+  for (RuntimeUpvalue *upvalue = open_upvalues; upvalue != nullptr;
+       upvalue = upvalue->next)
+    heap.mark(upvalue);
+
+  for (Value value : globals.values)
+    heap.mark(value);
+}
+
+void VM::enable_jit(uint32_t threshold) {
+  if (Jit::is_supported())
+    jit = std::make_unique<Jit>(this, threshold);
+}
+
+void VM::interpret(RuntimeBytecodeFunction *script) {
+  RuntimeClosure *closure = runtime_heap.allocate<RuntimeClosure>(script);
+  push(Value::object(closure));
+  call_closure(closure, 0, false);
+  // A script compiled on its first call has already run.
+  if (frame_count > 0)
+    run();
+}
+
+void VM::call_value(Value callee, int argc) {
+  switch (callee.get_type()) {
+  case RT_CLOSURE:
+    return call_closure((RuntimeClosure *)callee.as_object(), argc, false);
+
+  case RT_BOUND_METHOD: {
+    RuntimeBoundMethod *bound = (RuntimeBoundMethod *)callee.as_object();
+    stack_top[-argc - 1] = bound->receiver;
+    return call_closure((RuntimeClosure *)bound->method, argc, false);
+  }
+
+  case RT_CLASS: {
+    RuntimeClass *class_ = (RuntimeClass *)callee.as_object();
+    stack_top[-argc - 1] =
+        Value::object(runtime_heap.allocate<RuntimeClassInstance>(class_));
+
+    RuntimeCallable *initializer = class_->find_initializer();
+    if (initializer != nullptr)
+      return call_closure((RuntimeClosure *)initializer, argc, true);
+
+    if (argc != 0)
+      throw "Received incorrect number of args.";
+    return;
+  }
+
+  case RT_NATIVE: {
+    RuntimeNativeFunction *native = (RuntimeNativeFunction *)callee.as_object();
+    if (argc != native->arity())
+      throw "Received incorrect number of args.";
+
+    // The arguments stay on the stack, and so stay rooted, during the call.
+    Value result = native->function(stack_top - argc);
+    stack_top -= argc + 1;
+    push(result);
+    return;
+  }
+
+  default:
+    throw "Attempted to call non-callable object.";
+  }
+}
+
+void VM::call_closure(RuntimeClosure *closure, int argc, bool is_initializer) {
+  if (argc != closure->function->arity)
+    throw "Received incorrect number of args.";
+
+  if (frame_count == FRAMES_MAX)
+    throw "Stack overflow.";
+
+  CallFrame *frame = &frames[frame_count];
+  frame->closure = closure;
+  frame->ip = closure->function->chunk.code.data();
+  frame->slots = stack_top - argc - 1;
+  frame->is_initializer = is_initializer;
+  std::atomic_signal_fence(std::memory_order_release);
+  frame_count = frame_count + 1;
+
+  if (jit != nullptr) {
+    JitCode *code = jit->count_call(closure->function);
+    if (code != nullptr)
+      jit->run(code, frame);
+  }
+}
+
+// Every frame but the innermost is stopped just past a call, so its line is
+// the one of the instruction before its ip.
+int VM::capture_stack(ProfileFrame *out, int capacity) {
+  int count = frame_count;
+  int first = std::max(0, count - capacity);
+
+  for (int i = first; i < count; ++i) {
+    const RuntimeBytecodeFunction *function = frames[i].closure->function;
+    int offset = frames[i].ip - function->chunk.code.data();
+    out[i - first] =
+        ProfileFrame{i == 0 ? "<script>" : std::string_view(function->name),
+                     function->chunk.line_at(std::max(0, offset - 1))};
+  }
+  return count - first;
+}
+
+AllocationSite VM::allocation_site() const {
+  if (frame_count == 0)
+    return AllocationSite{site_kind, 0};
+
+  const CallFrame &frame = frames[frame_count - 1];
+  const Chunk &chunk = frame.closure->function->chunk;
+  int offset = frame.ip - chunk.code.data();
+  return AllocationSite{site_kind, chunk.line_at(std::max(0, offset - 1))};
+}
+
+RuntimeUpvalue *VM::capture_upvalue(Value *local) {
+  RuntimeUpvalue *previous = nullptr;
+  RuntimeUpvalue *upvalue = open_upvalues;
+  while (upvalue != nullptr && upvalue->location > local) {
+    previous = upvalue;
+    upvalue = upvalue->next;
+  }
+
+  if (upvalue != nullptr && upvalue->location == local)
+    return upvalue;
+
+  RuntimeUpvalue *created = runtime_heap.allocate<RuntimeUpvalue>(local);
+  created->next = upvalue;
+
+  if (previous == nullptr)
+    open_upvalues = created;
+  else
+    previous->next = created;
+
+  return created;
+}
+
+void VM::close_upvalues(Value *last) {
+  while (open_upvalues != nullptr && open_upvalues->location >= last) {
+    RuntimeUpvalue *upvalue = open_upvalues;
+    upvalue->closed = *upvalue->location;
+    upvalue->location = &upvalue->closed;
+    open_upvalues = upvalue->next;
+  }
+}
+
+Value VM::get_property(Value obj, const Symbol *name, PropertyCache &cache) {
+  if (obj.get_type() != RT_INSTANCE)
+    throw "Only object instances have properties.";
+
+  site_kind = "get";
+  return ((RuntimeClassInstance *)obj.as_object())->get(name, cache);
+}
+
+void VM::set_property(const Symbol *name, PropertyCache &cache) {
+  Value value = pop();
+  Value obj = pop();
+
+  if (obj.get_type() != RT_INSTANCE)
+    throw "Only instances have fields.";
+
+  ((RuntimeClassInstance *)obj.as_object())->set(name, value, cache);
+  push(value);
+}
+
+void VM::get_index() {
+  Value obj = pop();
+  Value index = pop();
+
+  if (obj.get_type() != RT_ARRAY && obj.get_type() != RT_STRING)
+    throw "Index should be into an array or string.";
+
+  if (!index.is_number())
+    throw "Index key should be a number.";
+
+  if (obj.get_type() == RT_STRING) {
+    std::string_view str = string_value(obj);
+    int64_t at = element_index(index, str.size());
+    if (at < 0)
+      throw "Index key not in range.";
+
+    site_kind = "index";
+    push(character_string(str[at]));
+    return;
+  }
+
+  const std::vector<Value> &values =
+      ((RuntimeArrayValue *)obj.as_object())->array_values;
+  int64_t at = element_index(index, values.size());
+  if (at < 0)
+    throw "Index key out of bounds.";
+  push(values[at]);
+}
+
+void VM::set_index() {
+  Value obj = pop();
+  Value index = pop();
+  Value value = pop();
+
+  if (obj.get_type() != RT_ARRAY)
+    throw "Index should be into an array.";
+
+  if (!index.is_number())
+    throw "Index key should be a number.";
+
+  RuntimeArrayValue *array = (RuntimeArrayValue *)obj.as_object();
+  int64_t at = element_index(index, array->array_values.size());
+  if (at < 0)
+    throw "Index key not in range.";
+
+  array->array_values[at] = value;
+  push(Value::nil());
+}
+
+void VM::make_array(int count) {
+  Value *values = stack_top - count;
+  int length = values[-1].as_number();
+
+  std::vector<Value> array_values;
+  for (int i = 0; i < length; ++i)
+    array_values.push_back(i < count ? values[i] : Value::nil());
+
+  stack_top -= count + 1;
+  site_kind = "array";
+  push(Value::object(runtime_heap.allocate<RuntimeArrayValue>(array_values)));
+}
+
+void VM::invoke(const Symbol *name, PropertyCache &cache, int argc) {
+  Value obj = peek(argc);
+  site_kind = "call";
+
+  if (obj.get_type() == RT_ARRAY) {
+    // The receiver and arguments stay on the stack, and so stay rooted,
+    // until the method returns.
+    Value result = ((RuntimeArrayValue *)obj.as_object())
+                       ->call_method(name->name, stack_top - argc, argc);
+    stack_top -= argc + 1;
+    push(result);
+    return;
+  }
+
+  if (obj.get_type() != RT_INSTANCE)
+    throw "Only object instances have properties.";
+
+  RuntimeClassInstance *instance = (RuntimeClassInstance *)obj.as_object();
+  Value *field = instance->find_field(name, cache);
+  if (field != nullptr) {
+    stack_top[-argc - 1] = *field;
+    return call_value(*field, argc);
+  }
+
+  RuntimeCallable *method = instance->class_->find_method(name);
+  if (method == nullptr)
+    throw "Undefined property " + name->name;
+  call_closure((RuntimeClosure *)method, argc, false);
+}
+
+void VM::make_closure(CallFrame *frame, RuntimeBytecodeFunction *function,
+                      const uint8_t *operands) {
+  site_kind = "function";
+  RuntimeClosure *closure = runtime_heap.allocate<RuntimeClosure>(function);
+  push(Value::object(closure));
+
+  for (int i = 0; i < function->upvalue_count; ++i) {
+    uint8_t is_local = operands[2 * i];
+    uint8_t index = operands[2 * i + 1];
+    closure->upvalues[i] = is_local ? capture_upvalue(frame->slots + index)
+                                    : frame->closure->upvalues[index];
+  }
+}
+
+void VM::return_from(CallFrame *frame) {
+  Value result = pop();
+  close_upvalues(frame->slots);
+
+  if (frame->is_initializer)
+    result = frame->slots[0];
+
+  frame_count = frame_count - 1;
+  stack_top = frame->slots;
+  push(result);
+}
+
+void VM::run() {
+  int base_frame = frame_count - 1;
+  CallFrame *frame = &frames[frame_count - 1];
+
+#define READ_BYTE() (*frame->ip++)
+#define READ_U16() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
+#define READ_CONSTANT() (frame->closure->function->chunk.constants[READ_U16()])
+#define READ_NAME() (string_value(READ_CONSTANT()))
+#define READ_SYMBOL() (((RuntimeString *)READ_CONSTANT().as_object())->symbol)
+#define READ_PROPERTY_CACHE()                                                  \
+  (frame->closure->function->chunk.property_caches[READ_U16()])
+#define BINARY_OP(op)                                                          \
+  do {                                                                         \
+    Value b = pop();                                                           \
+    Value a = pop();                                                           \
+    push(a op b);                                                              \
+  } while (false)
+#define COMPARE_OP(op)                                                         \
+  do {                                                                         \
+    Value b = pop();                                                           \
+    Value a = pop();                                                           \
+    push(Value::boolean(a op b));                                              \
+  } while (false)
+#define COMPARE_JUMP(op)                                                       \
+  do {                                                                         \
+    uint16_t offset = READ_U16();                                              \
+    Value b = pop();                                                           \
+    Value a = pop();                                                           \
+    if (!(a op b))                                                             \
+      frame->ip += offset;                                                     \
+  } while (false)
+
+#ifdef ORCA_COMPUTED_GOTO
+#define OPCODE_LABEL(op) &&do_##op,
+  static void *const dispatch_table[] = {VM_OPCODES(OPCODE_LABEL)};
+#undef OPCODE_LABEL
+
+#define INTERPRET_LOOP DISPATCH();
+#define CASE(op) do_##op
+#define DISPATCH() goto *dispatch_table[READ_BYTE()]
+#else
+#define INTERPRET_LOOP                                                         \
+  while (true)                                                                 \
+    switch ((OpCode)READ_BYTE())
+#define CASE(op) case op
+#define DISPATCH() break
+#endif
+
+  INTERPRET_LOOP {
+    CASE(OP_CONSTANT):
+      push(READ_CONSTANT());
+      DISPATCH();
+    CASE(OP_NIL):
+      push(Value::nil());
+      DISPATCH();
+    CASE(OP_TRUE):
+      push(Value::boolean(true));
+      DISPATCH();
+    CASE(OP_FALSE):
+      push(Value::boolean(false));
+      DISPATCH();
+    CASE(OP_POP):
+      pop();
+      DISPATCH();
+
+    CASE(OP_GET_LOCAL):
+      push(frame->slots[READ_BYTE()]);
+      DISPATCH();
+    CASE(OP_SET_LOCAL):
+      frame->slots[READ_BYTE()] = peek(0);
+      DISPATCH();
+    CASE(OP_GET_UPVALUE):
+      push(*frame->closure->upvalues[READ_BYTE()]->location);
+      DISPATCH();
+    CASE(OP_SET_UPVALUE):
+      *frame->closure->upvalues[READ_BYTE()]->location = peek(0);
+      DISPATCH();
+    CASE(OP_GET_GLOBAL):
+      push(globals.get(READ_U16()));
+      DISPATCH();
+    CASE(OP_DEFINE_GLOBAL):
+      globals.define(READ_U16(), pop());
+      DISPATCH();
+    CASE(OP_SET_GLOBAL):
+      globals.assign(READ_U16(), peek(0));
+      DISPATCH();
+    CASE(OP_CLOSE_UPVALUE):
+      close_upvalues(stack_top - 1);
+      pop();
+      DISPATCH();
+
+    CASE(OP_GET_PROPERTY): {
+      const Symbol *name = READ_SYMBOL();
+      PropertyCache &cache = READ_PROPERTY_CACHE();
+      stack_top[-1] = get_property(peek(0), name, cache);
+      DISPATCH();
+    }
+    CASE(OP_SET_PROPERTY): {
+      const Symbol *name = READ_SYMBOL();
+      set_property(name, READ_PROPERTY_CACHE());
+      DISPATCH();
+    }
+    CASE(OP_GET_INDEX):
+      get_index();
+      DISPATCH();
+    CASE(OP_SET_INDEX):
+      set_index();
+      DISPATCH();
+    CASE(OP_ARRAY):
+      make_array(READ_U16());
+      DISPATCH();
+
+    CASE(OP_EQUAL):
+      COMPARE_OP(==);
+      DISPATCH();
+    CASE(OP_NOT_EQUAL):
+      COMPARE_OP(!=);
+      DISPATCH();
+    CASE(OP_GREATER):
+      COMPARE_OP(>);
+      DISPATCH();
+    CASE(OP_GREATER_EQUAL):
+      COMPARE_OP(>=);
+      DISPATCH();
+    CASE(OP_LESS):
+      COMPARE_OP(<);
+      DISPATCH();
+    CASE(OP_LESS_EQUAL):
+      COMPARE_OP(<=);
+      DISPATCH();
+    CASE(OP_ADD):
+      site_kind = "binary";
+      BINARY_OP(+);
+      DISPATCH();
+    CASE(OP_SUBTRACT):
+      BINARY_OP(-);
+      DISPATCH();
+    CASE(OP_MULTIPLY):
+      BINARY_OP(*);
+      DISPATCH();
+    CASE(OP_DIVIDE):
+      BINARY_OP(/);
+      DISPATCH();
+    CASE(OP_NOT):
+      push(Value::boolean(!pop().is_truthy()));
+      DISPATCH();
+    CASE(OP_NEGATE): {
+      Value right = pop();
+      push(right.is_number() ? Value::number(0) - right : Value::nil());
+      DISPATCH();
+    }
+
+    CASE(OP_PRINT):
+      printf("%s\n", pop().as_string().c_str());
+      DISPATCH();
+    CASE(OP_JUMP): {
+      uint16_t offset = READ_U16();
+      frame->ip += offset;
+      DISPATCH();
+    }
+    CASE(OP_JUMP_IF_FALSE): {
+      uint16_t offset = READ_U16();
+      if (!pop().is_truthy())
+        frame->ip += offset;
+      DISPATCH();
+    }
+    CASE(OP_LOOP): {
+      uint16_t offset = READ_U16();
+      frame->ip -= offset;
+      if (jit != nullptr) {
+        JitCode *code = jit->count_back_edge(frame->closure->function);
+        if (code != nullptr) {
+          // Runs the rest of the frame, from the loop header on.
+          jit->run(code, frame);
+          if (frame_count == base_frame)
+            return;
+          frame = &frames[frame_count - 1];
+        }
+      }
+      DISPATCH();
+    }
+
+    CASE(OP_CALL): {
+      int argc = READ_BYTE();
+      site_kind = "call";
+      call_value(peek(argc), argc);
+      frame = &frames[frame_count - 1];
+      DISPATCH();
+    }
+    CASE(OP_INVOKE): {
+      const Symbol *name = READ_SYMBOL();
+      PropertyCache &cache = READ_PROPERTY_CACHE();
+      invoke(name, cache, READ_BYTE());
+      frame = &frames[frame_count - 1];
+      DISPATCH();
+    }
+    CASE(OP_CLOSURE): {
+      RuntimeBytecodeFunction *function =
+          (RuntimeBytecodeFunction *)READ_CONSTANT().as_object();
+      make_closure(frame, function, frame->ip);
+      frame->ip += 2 * function->upvalue_count;
+      DISPATCH();
+    }
+    CASE(OP_RETURN):
+      return_from(frame);
+      if (frame_count == base_frame)
+        return;
+      frame = &frames[frame_count - 1];
+      DISPATCH();
+    CASE(OP_CLASS):
+      site_kind = "class";
+      push(Value::object(runtime_heap.allocate<RuntimeClass>(
+          std::string(READ_NAME()), SymbolMap<RuntimeCallable *>())));
+      DISPATCH();
+    CASE(OP_METHOD): {
+      const Symbol *name = READ_SYMBOL();
+      RuntimeCallable *method = (RuntimeCallable *)pop().as_object();
+      ((RuntimeClass *)peek(0).as_object())
+          ->methods.insert_or_assign(name, method);
+      DISPATCH();
+    }
+
+    CASE(OP_ADD_LOCAL_CONSTANT): {
+      Value local = frame->slots[READ_BYTE()];
+      site_kind = "binary";
+      push(local + READ_CONSTANT());
+      DISPATCH();
+    }
+    CASE(OP_SUBTRACT_LOCAL_CONSTANT): {
+      Value local = frame->slots[READ_BYTE()];
+      push(local - READ_CONSTANT());
+      DISPATCH();
+    }
+    CASE(OP_GET_LOCAL_PROPERTY): {
+      Value obj = frame->slots[READ_BYTE()];
+      const Symbol *name = READ_SYMBOL();
+      push(get_property(obj, name, READ_PROPERTY_CACHE()));
+      DISPATCH();
+    }
+    CASE(OP_JUMP_IF_NOT_LESS):
+      COMPARE_JUMP(<);
+      DISPATCH();
+    CASE(OP_JUMP_IF_NOT_LESS_EQUAL):
+      COMPARE_JUMP(<=);
+      DISPATCH();
+    CASE(OP_JUMP_IF_NOT_GREATER):
+      COMPARE_JUMP(>);
+      DISPATCH();
+    CASE(OP_JUMP_IF_NOT_GREATER_EQUAL):
+      COMPARE_JUMP(>=);
+      DISPATCH();
+
+    CASE(OP_COUNT):
+      throw "Invalid instruction.";
+  }
+
+#undef READ_BYTE
+#undef READ_U16
+#undef READ_CONSTANT
+#undef READ_NAME
+#undef READ_SYMBOL
+#undef READ_PROPERTY_CACHE
+#undef BINARY_OP
+#undef COMPARE_OP
+#undef COMPARE_JUMP
+#undef INTERPRET_LOOP
+#undef CASE
+#undef DISPATCH
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../evaluator/builtins.h"
+#include "../profiler.h"
+#include "../variable/global_table.h"
+#include "jit.h"
+#include "vm_objects.h"
+#include <memory>
+
+struct CallFrame {
+  RuntimeClosure *closure;
+  uint8_t *ip;
+  Value *slots;
+  bool is_initializer;
+};
+
+// A stack machine that executes the bytecode produced by Compiler. It shares
+// the runtime object model (arrays, classes, instances) with the Evaluator, so
+// both engines print and compare values identically.
+//
+// The profiler samples the VM's own call frames, so profiling costs the
+// interpreter loop nothing. Instructions that may allocate note their kind
+// for the allocation profiler, which finds their line from the innermost
+// frame.
+//
+// With the JIT enabled, a function that has been called or has looped often
+// enough is compiled to machine code, which then runs its frames in place of
+// the interpreter loop: from the start on a call, or from the loop header on
+// a back edge. Compiled code keeps the same stack and frames, so nothing else
+// can tell the difference.
+class VM : public GcRootSource,
+           public ProfileSource,
+           public AllocationSiteSource {
+public:
+  static constexpr int FRAMES_MAX = 1024;
+  static constexpr int STACK_MAX = FRAMES_MAX * 256;
+
+  VM()
+      : stack(new Value[STACK_MAX]), stack_top(stack.get()),
+        frame_count(0), open_upvalues(nullptr) {
+    runtime_heap.add_root_source(this);
+    install_stdlib(globals);
+  }
+
+  ~VM() { runtime_heap.remove_root_source(this); }
+
+  // Compiles functions once they are called or loop `threshold` times. Does
+  // nothing where there is no JIT.
+  void enable_jit(uint32_t threshold);
+  void interpret(RuntimeBytecodeFunction *script);
+  void mark_roots(Heap &heap) override;
+  int capture_stack(ProfileFrame *frames, int capacity) override;
+  AllocationSite allocation_site() const override;
+
+  GlobalTable globals;
+  // Null unless the JIT is enabled.
+  std::unique_ptr<Jit> jit;
+
+private:
+  friend class JitRuntime;
+
+  void run();
+
+  void push(Value value) {
+    if (stack_top == stack.get() + STACK_MAX)
+      throw "Stack overflow.";
+    *stack_top++ = value;
+  }
+  Value pop() { return *--stack_top; }
+  Value peek(int distance) { return stack_top[-1 - distance]; }
+
+  void call_value(Value callee, int argc);
+  void call_closure(RuntimeClosure *closure, int argc, bool is_initializer);
+  RuntimeUpvalue *capture_upvalue(Value *local);
+  void close_upvalues(Value *last);
+
+  // Instruction bodies shared by the interpreter loop and compiled code.
+  Value get_property(Value obj, const Symbol *name, PropertyCache &cache);
+  void set_property(const Symbol *name, PropertyCache &cache);
+  void get_index();
+  void set_index();
+  void make_array(int count);
+  void invoke(const Symbol *name, PropertyCache &cache, int argc);
+  // `operands` are the closure instruction's (is_local, index) pairs.
+  void make_closure(CallFrame *frame, RuntimeBytecodeFunction *function,
+                    const uint8_t *operands);
+  // Pops `frame` and pushes its result for the caller.
+  void return_from(CallFrame *frame);
+
+  std::unique_ptr<Value[]> stack;
+  Value *stack_top;
+  CallFrame frames[FRAMES_MAX];
+  // Only counts a frame once it is filled in, for the profiler's sake.
+  volatile int frame_count;
+  RuntimeUpvalue *open_upvalues;
+  const char *site_kind = "script";
+};
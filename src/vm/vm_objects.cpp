@@ -0,0 +1,6 @@
+#include "vm_objects.h"
+
+RuntimeCallable *RuntimeClosure::bind(RuntimeObject *instance) {
+  return runtime_heap.allocate<RuntimeBoundMethod>(Value::object(instance),
+                                                   this);
+}
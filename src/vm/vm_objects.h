@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../evaluator/runtime_callable.h"
+#include "chunk.h"
+
+struct JitCode;
+
+// A compiled function body. It is never called directly: the VM always wraps
+// it in a RuntimeClosure that carries the captured upvalues.
+class RuntimeBytecodeFunction : public RuntimeObject {
+public:
+  RuntimeBytecodeFunction(std::string name, int arity)
+      : name(name), arity(arity), upvalue_count(0) {}
+
+  RuntimeValueType get_type() const override { return RT_BYTECODE_FUNCTION; }
+  std::string as_string() const override { return "<func : " + name + ">"; }
+
+  void trace(Heap &heap) override {
+    for (Value constant : chunk.constants)
+      heap.mark(constant);
+  }
+
+  size_t owned_bytes() const override {
+    return chunk.code.capacity() + chunk.constants.capacity() * sizeof(Value) +
+           chunk.lines.capacity() * sizeof(LineStart) +
+           chunk.property_caches.capacity() * sizeof(PropertyCache);
+  }
+
+  std::string name;
+  int arity;
+  int upvalue_count;
+  Chunk chunk;
+
+  // How often the function has been called and has jumped back to the top of
+  // a loop, which decide when the JIT compiles it.
+  uint32_t calls = 0;
+  uint32_t back_edges = 0;
+  // Owned by the VM's Jit; null until compiled.
+  JitCode *jit_code = nullptr;
+};
+
+// A captured variable. While the variable is still live on the VM stack the
+// upvalue is "open" and points at the stack slot; once that slot is popped
+// the value is moved into `closed` and `location` is redirected to it.
+class RuntimeUpvalue : public RuntimeObject {
+public:
+  RuntimeUpvalue(Value *location)
+      : location(location), closed(Value::nil()), next(nullptr) {}
+
+  RuntimeValueType get_type() const override { return RT_UPVALUE; }
+  std::string as_string() const override { return "<upvalue>"; }
+
+  // An open upvalue's value lives on the VM stack, which is a root already.
+  void trace(Heap &heap) override { heap.mark(closed); }
+
+  Value *location;
+  Value closed;
+  RuntimeUpvalue *next;
+};
+
+class RuntimeClosure : public RuntimeCallable {
+public:
+  RuntimeClosure(RuntimeBytecodeFunction *function)
+      : function(function), upvalues(function->upvalue_count, nullptr) {}
+
+  RuntimeValueType get_type() const override { return RT_CLOSURE; }
+  std::string as_string() const override { return function->as_string(); }
+  int arity() const override { return function->arity; }
+  RuntimeCallable *bind(RuntimeObject *instance) override;
+
+  void trace(Heap &heap) override {
+    heap.mark(function);
+    for (RuntimeUpvalue *upvalue : upvalues)
+      heap.mark(upvalue);
+  }
+
+  size_t owned_bytes() const override {
+    return upvalues.capacity() * sizeof(RuntimeUpvalue *);
+  }
+
+  RuntimeBytecodeFunction *function;
+  std::vector<RuntimeUpvalue *> upvalues;
+};